@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// Bump allocator for short-lived per-message work. Memory comes from a list
+// of blocks that is only ever appended to; reset() rewinds to the first block
+// without returning anything to the heap, so after warm-up a thread handles
+// every message without calling malloc. Individual frees are no-ops.
+class MonotonicArena
+{
+public:
+    explicit MonotonicArena(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+
+    MonotonicArena(const MonotonicArena &) = delete;
+    MonotonicArena &operator=(const MonotonicArena &) = delete;
+
+    ~MonotonicArena()
+    {
+        for (Block &block : blocks)
+        {
+            std::free(block.data);
+        }
+    }
+
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        while (current < blocks.size())
+        {
+            Block &block = blocks[current];
+            size_t offset = (used + alignment - 1) & ~(alignment - 1);
+            if (offset + size <= block.size)
+            {
+                used = offset + size;
+                bytes += size;
+                return block.data + offset;
+            }
+            ++current;
+            used = 0;
+        }
+        // Oversized requests get a block of their own, kept for reuse like the others
+        size_t capacity = size + alignment > blockSize ? size + alignment : blockSize;
+        char *data = static_cast<char *>(std::malloc(capacity));
+        if (data == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        blocks.push_back({data, capacity});
+        heapAllocations++;
+        current = blocks.size() - 1;
+        used = 0;
+        return allocate(size, alignment);
+    }
+
+    // Invalidates everything allocated since the last reset
+    void reset()
+    {
+        current = 0;
+        used = 0;
+        bytes = 0;
+    }
+
+    size_t bytesInUse() const
+    {
+        return bytes;
+    }
+
+    size_t capacity() const
+    {
+        size_t total = 0;
+        for (const Block &block : blocks)
+        {
+            total += block.size;
+        }
+        return total;
+    }
+
+    // Blocks taken from the heap over the arena's lifetime
+    uint64_t getHeapAllocations() const
+    {
+        return heapAllocations;
+    }
+
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    const size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t used = 0;
+    size_t bytes = 0;
+    uint64_t heapAllocations = 0;
+};
+
+// The calling thread's arena
+inline MonotonicArena &threadArena()
+{
+    thread_local MonotonicArena arena;
+    return arena;
+}
+
+// Resets the thread's arena when the current message is done. Anything
+// allocated from the arena inside the scope must not outlive it.
+class ArenaScope
+{
+public:
+    ArenaScope() = default;
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+    ~ArenaScope()
+    {
+        threadArena().reset();
+    }
+};
+
+// Stateless allocator over the calling thread's arena. nlohmann::json
+// default-constructs its allocators, so the arena cannot be passed in and is
+// found through the thread instead; containers using it must stay on the
+// thread that created them.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &) {}
+
+    T *allocate(size_t count)
+    {
+        return static_cast<T *>(threadArena().allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &) const
+    {
+        return false;
+    }
+};
+
+using arena_string = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// nlohmann::json whose objects, arrays and strings all live in the thread's
+// arena; use inside an ArenaScope, for one message at a time
+using arena_json = nlohmann::basic_json<std::map, std::vector, arena_string, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
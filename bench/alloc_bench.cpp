@@ -0,0 +1,127 @@
+// Counts global heap allocations per message for the server's per-message
+// work: parsing a client request with nlohmann::json on the default allocator
+// and with arena_json, and serializing a 20-level book update with
+// nlohmann::json against serializeUpdate, which the broadcast path uses.
+//
+//   g++ -std=c++17 -O2 -I . bench/alloc_bench.cpp -o alloc_bench -lboost_system -lssl -lcrypto -lpthread
+//   ./alloc_bench [messages]
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include "arena.hpp"
+#include "wire_format.hpp"
+
+// The replacement new/delete below pair malloc with free, which GCC cannot see
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+static std::atomic<uint64_t> allocations{0};
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// onMessage parses the request and reads the action and symbol
+template <typename Json>
+size_t parseRequest(const std::string &request)
+{
+    Json parsed = Json::parse(request);
+    return parsed["action"] == "subscribe" ? parsed["symbol"].template get_ref<const typename Json::string_t &>().size() : 0;
+}
+
+MarketUpdate makeBook()
+{
+    MarketUpdate update{};
+    update.kind = UpdateKind::Book;
+    update.setSymbol("BTC-27DEC24-60000-C");
+    update.exchangeMs = 1729000000000LL;
+    update.bidCount = update.askCount = 20;
+    for (int level = 0; level < 20; ++level)
+    {
+        update.bids[level] = {3000.0 - level * 0.05, 125.5 + level};
+        update.asks[level] = {3000.05 + level * 0.05, 98.0 + level};
+    }
+    return update;
+}
+
+// The book update the way serializeUpdate wrote it when it built json
+size_t dumpBook(const MarketUpdate &update, uint64_t sequence, std::string &message)
+{
+    nlohmann::json out = {{"symbol", update.getSymbol()}, {"timestamp", update.exchangeMs}, {"seq", sequence}, {"type", "book"}};
+    nlohmann::json bids = nlohmann::json::array(), asks = nlohmann::json::array();
+    for (int i = 0; i < update.bidCount; ++i)
+    {
+        bids.push_back({update.bids[i].price, update.bids[i].amount});
+    }
+    for (int i = 0; i < update.askCount; ++i)
+    {
+        asks.push_back({update.asks[i].price, update.asks[i].amount});
+    }
+    out["best_bid"] = update.bids[0].price;
+    out["best_ask"] = update.asks[0].price;
+    out["bids"] = std::move(bids);
+    out["asks"] = std::move(asks);
+    message = out.dump();
+    return message.size();
+}
+
+template <typename Work>
+void run(const char *name, size_t messages, Work work)
+{
+    size_t checksum = 0;
+    // Warm-up: the arena and the output buffer reach their steady size
+    for (int i = 0; i < 100; ++i)
+    {
+        checksum += work(i);
+    }
+    uint64_t before = allocations.load();
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < messages; ++i)
+    {
+        checksum += work(i);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << name << ": " << static_cast<double>(allocations.load() - before) / messages << " heap allocations per message, "
+              << seconds * 1e9 / messages << " ns per message (checksum " << checksum % 1000 << ")" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    const std::string request = R"({"action":"subscribe","symbol":"BTC-27DEC24-60000-C","client_id":"client1","ts":{"src":1729000000000000000}})";
+    const MarketUpdate book = makeBook();
+    std::string message;
+
+    run("request, nlohmann::json", messages, [&](size_t)
+        { return parseRequest<nlohmann::json>(request); });
+    run("request, arena_json    ", messages, [&](size_t)
+        {
+            ArenaScope scope;
+            return parseRequest<arena_json>(request); });
+    run("update, nlohmann::json ", messages, [&](size_t i)
+        { return dumpBook(book, i, message); });
+    run("update, serializeUpdate", messages, [&](size_t i)
+        {
+            serializeUpdate(book, i, message);
+            return message.size(); });
+    std::cout << "Arena: " << threadArena().capacity() / 1024 << " KiB in " << threadArena().getHeapAllocations() << " block(s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+// Bandwidth of depth-limited book streams (book_stream.hpp) against the full
+// book updates, on replayed data. Every book in a recording made with
+// FEED_RECORD is published as the server does; the deltas are applied to a
+// local book the way client.cpp does, and compared with the source book at
+// every step.
+//
+//   g++ -std=c++17 -O2 -I . bench/book_bench.cpp -o book_bench -lboost_system -lssl -lcrypto -lpthread
+//   ./book_bench feed.log
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "book_stream.hpp"
+#include "wire_format.hpp"
+
+template <typename Side>
+void applyLevels(const nlohmann::json &levels, size_t depth, Side &side)
+{
+    for (const nlohmann::json &level : levels)
+    {
+        double price = level[0].get<double>(), amount = level[1].get<double>();
+        if (amount == 0)
+        {
+            side.erase(price);
+        }
+        else
+        {
+            side[price] = amount;
+        }
+    }
+    while (side.size() > depth)
+    {
+        side.erase(std::prev(side.end()));
+    }
+}
+
+// The local side must equal the top `depth` levels of the source side
+template <typename Side>
+bool matches(const Side &side, const PriceLevel *levels, int count, int depth)
+{
+    count = std::min(count, depth);
+    if (static_cast<int>(side.size()) != count)
+    {
+        return false;
+    }
+    int i = 0;
+    for (const auto &[price, amount] : side)
+    {
+        if (price != levels[i].price || amount != levels[i].amount)
+        {
+            return false;
+        }
+        ++i;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <recording>" << std::endl;
+        return 1;
+    }
+    std::ifstream input(argv[1]);
+    std::vector<MarketUpdate> books;
+    DeribitNormalizer normalizer;
+    std::string line;
+    while (std::getline(input, line))
+    {
+        size_t space = line.find(' ');
+        if (space != std::string::npos)
+        {
+            normalizer.normalize(line.substr(space + 1), 0, [&books](const MarketUpdate &update)
+                                 {
+                                     if (update.kind == UpdateKind::Book)
+                                     {
+                                         books.push_back(update);
+                                     } });
+        }
+    }
+    if (books.empty())
+    {
+        std::cerr << "No books in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::string message;
+    size_t fullBytes = 0;
+    for (size_t i = 0; i < books.size(); ++i)
+    {
+        serializeUpdate(books[i], i, message);
+        fullBytes += message.size();
+    }
+    std::cout << books.size() << " book updates, full book: " << fullBytes / books.size() << " bytes per update" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "depth  levels changed  bytes/update  vs full  deltas  us/update  consistent" << std::endl;
+
+    for (int depth : {1, 5, 10, 20})
+    {
+        std::map<std::string, DepthBook> streams;
+        std::map<std::string, std::map<double, double, std::greater<double>>> bids;
+        std::map<std::string, std::map<double, double>> asks;
+        size_t bytes = 0, deltas = 0, changedLevels = 0;
+        bool consistent = true;
+        double seconds = 0;
+        for (const MarketUpdate &book : books)
+        {
+            std::string symbol(book.getSymbol());
+            DepthBook &stream = streams.try_emplace(symbol, depth).first->second;
+            auto begin = std::chrono::steady_clock::now();
+            bool first = !stream.ready();
+            bool changed = stream.apply(book, message);
+            if (first)
+            {
+                stream.snapshot(message);
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            if (first || changed)
+            {
+                bytes += message.size();
+                deltas += changed;
+                auto parsed = nlohmann::json::parse(message);
+                changedLevels += changed ? parsed["bids"].size() + parsed["asks"].size() : 0;
+                applyLevels(parsed["bids"], depth, bids[symbol]);
+                applyLevels(parsed["asks"], depth, asks[symbol]);
+            }
+            consistent = consistent && matches(bids[symbol], book.bids, book.bidCount, depth) && matches(asks[symbol], book.asks, book.askCount, depth);
+        }
+        std::cout << std::setw(5) << depth << std::setw(16) << static_cast<double>(changedLevels) / std::max<size_t>(deltas, 1)
+                  << std::setw(14) << static_cast<double>(bytes) / books.size() << std::setw(8) << 100.0 * bytes / fullBytes << "%"
+                  << std::setw(8) << deltas << std::setw(11) << seconds * 1e6 / books.size() << std::setw(12) << (consistent ? "yes" : "NO") << std::endl;
+    }
+    return 0;
+}
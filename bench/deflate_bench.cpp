@@ -0,0 +1,136 @@
+// Bytes against CPU time for permessage-deflate on replayed market data.
+// Every update in a recording made with FEED_RECORD is normalized and
+// serialized exactly as the server sends it, then framed uncompressed and
+// compressed at several levels, with and without context takeover. Each
+// compressed message is inflated again to check it.
+//
+// Without context takeover one compressed frame is shared by all clients in
+// a compression group, so the CPU cost per update does not grow with the
+// number of clients. With context takeover every client has its own
+// compressor; the last column shows what that costs for `clients` clients.
+//
+//   g++ -std=c++17 -O2 -I . bench/deflate_bench.cpp -o deflate_bench -lboost_system -lssl -lcrypto -lpthread -lz
+//   ./deflate_bench feed.log [clients]
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "deflate.hpp"
+#include "tracing.hpp"
+#include "wire_format.hpp"
+
+// Payload plus the frame header the server writes in front of it
+size_t frameSize(size_t payload)
+{
+    return payload + (payload < 126 ? 2 : payload < 65536 ? 4 : 10);
+}
+
+// Inflates every compressed message like a client would; false on any mismatch
+bool verify(const std::vector<std::string> &messages, const std::vector<std::string> &compressed, bool contextTakeover)
+{
+    z_stream stream{};
+    inflateInit2(&stream, -kMaxDeflateWindowBits);
+    std::string input, output;
+    bool ok = true;
+    for (size_t i = 0; i < messages.size() && ok; ++i)
+    {
+        input = compressed[i];
+        input.append("\x00\x00\xff\xff", 4);
+        output.assign(messages[i].size() + 64, '\0');
+        stream.next_in = reinterpret_cast<Bytef *>(&input[0]);
+        stream.avail_in = static_cast<uInt>(input.size());
+        stream.next_out = reinterpret_cast<Bytef *>(&output[0]);
+        stream.avail_out = static_cast<uInt>(output.size());
+        int result = inflate(&stream, Z_SYNC_FLUSH);
+        output.resize(output.size() - stream.avail_out);
+        ok = (result == Z_OK || result == Z_STREAM_END) && output == messages[i];
+        if (!contextTakeover)
+        {
+            inflateReset(&stream);
+        }
+    }
+    inflateEnd(&stream);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <recording> [clients]" << std::endl;
+        return 1;
+    }
+    size_t clients = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+    // Downstream messages, as WebSocketServer::publish builds them
+    std::ifstream input(argv[1]);
+    std::vector<std::string> messages;
+    DeribitNormalizer normalizer;
+    std::string line, message;
+    uint64_t sequence = 0;
+    while (std::getline(input, line))
+    {
+        size_t space = line.find(' ');
+        if (space == std::string::npos)
+        {
+            continue;
+        }
+        int64_t receiveNs = std::stoll(line.substr(0, space));
+        normalizer.normalize(line.substr(space + 1), receiveNs, [&](const MarketUpdate &update)
+                             {
+                                 StageTimestamps ts;
+                                 ts.stamp(TraceStage::SourceReceive, update.receiveNs);
+                                 ts.stamp(TraceStage::BookUpdate, update.receiveNs + 2500);
+                                 serializeUpdate(update, sequence++, message);
+                                 ts.stamp(TraceStage::Serialize, update.receiveNs + 9000);
+                                 ts.stamp(TraceStage::Enqueue, update.receiveNs + 9500);
+                                 message.back() = ',';
+                                 ts.appendJson(message);
+                                 message += '}';
+                                 messages.push_back(message); });
+    }
+    if (messages.empty())
+    {
+        std::cerr << "No updates in " << argv[1] << std::endl;
+        return 1;
+    }
+
+    size_t rawBytes = 0;
+    for (const std::string &m : messages)
+    {
+        rawBytes += frameSize(m.size());
+    }
+    std::cout << messages.size() << " updates, uncompressed " << static_cast<double>(rawBytes) / messages.size() << " bytes per frame" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "level  context        bytes/frame  ratio  compress us/update  CPU us/update for " << clients << " clients  valid" << std::endl;
+
+    std::vector<std::string> compressed(messages.size());
+    for (bool contextTakeover : {false, true})
+    {
+        for (int level : {1, 3, 6, 9})
+        {
+            MessageDeflater deflater(level, kMaxDeflateWindowBits, contextTakeover);
+            size_t wireBytes = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < messages.size(); ++i)
+            {
+                compressed[i].clear();
+                deflater.compress(messages[i].data(), messages[i].size(), compressed[i]);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            for (const std::string &c : compressed)
+            {
+                wireBytes += frameSize(c.size());
+            }
+            double perUpdate = seconds * 1e6 / messages.size();
+            std::cout << std::setw(5) << level << "  " << std::left << std::setw(13) << (contextTakeover ? "per client" : "shared") << std::right
+                      << std::setw(13) << static_cast<double>(wireBytes) / messages.size() << std::setw(7) << static_cast<double>(rawBytes) / wireBytes
+                      << std::setw(20) << perUpdate << std::setw(35) << (contextTakeover ? perUpdate * clients : perUpdate)
+                      << std::setw(7) << (verify(messages, compressed, contextTakeover) ? "yes" : "NO") << std::endl;
+        }
+    }
+    return 0;
+}
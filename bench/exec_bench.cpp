@@ -0,0 +1,121 @@
+// Measures the execution scheduler's own cost: timer wheel operations and a
+// full child decision, with many parent orders on one thread and a gateway
+// that answers instantly.
+//
+//   g++ -std=c++17 -O2 -I . bench/exec_bench.cpp -o exec_bench
+//   ./exec_bench [parent orders]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "exec_algos.hpp"
+#include "latency.hpp"
+
+int main(int argc, char *argv[])
+{
+    size_t parents = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+
+    // Timer wheel alone: schedule one timer per parent, then fire them all
+    {
+        TimerWheel wheel;
+        auto now = TimerWheel::Clock::now();
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < parents; ++i)
+        {
+            wheel.schedule(i, now + std::chrono::milliseconds(i % 5000));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        size_t fired = 0;
+        wheel.advance(now + std::chrono::seconds(6), [&fired](uint64_t)
+                      { ++fired; });
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << "Timer wheel: schedule " << std::chrono::duration<double, std::nano>(t1 - t0).count() / parents << " ns, expire "
+                  << std::chrono::duration<double, std::nano>(t2 - t1).count() / fired << " ns per timer (" << fired << " fired)" << std::endl;
+    }
+
+    // Full scheduler: every parent is a TWAP re-planned every 10 ms; the
+    // gateway keeps resting children in a map and fills nothing
+    std::unordered_map<uint64_t, std::vector<LiveQuote>> resting;
+    uint64_t orderIds = 0;
+    size_t requests = 0;
+    ExecutionGateway gateway;
+    gateway.depth = [](const std::string &, MarketDepth &depth)
+    {
+        depth.bids = {{99.5, 20}, {99, 40}, {98.5, 60}};
+        depth.asks = {{100.5, 20}, {101, 40}, {101.5, 60}};
+        return true;
+    };
+    gateway.state = [&resting](uint64_t parent, std::vector<LiveQuote> &live)
+    {
+        live = resting[parent];
+        return 0.0;
+    };
+    gateway.send = [&](uint64_t parent, const std::vector<QuoteAction> &actions)
+    {
+        std::vector<LiveQuote> &live = resting[parent];
+        for (const QuoteAction &action : actions)
+        {
+            ++requests;
+            if (action.type == QuoteActionType::New)
+            {
+                live.push_back({std::to_string(++orderIds), action.instrument, action.side, action.price, action.amount});
+                continue;
+            }
+            for (size_t i = 0; i < live.size(); ++i)
+            {
+                if (live[i].orderId == action.orderId)
+                {
+                    if (action.type == QuoteActionType::Cancel)
+                    {
+                        live.erase(live.begin() + i);
+                    }
+                    else
+                    {
+                        live[i].price = action.price;
+                        live[i].amount = action.amount;
+                    }
+                    break;
+                }
+            }
+        }
+    };
+
+    ExecutionScheduler scheduler(gateway);
+    for (size_t i = 0; i < parents; ++i)
+    {
+        AlgoParams params;
+        params.type = AlgoType::Twap;
+        params.instrument = "BTC-PERPETUAL";
+        params.side = i % 2 ? Side::Sell : Side::Buy;
+        params.amount = 100000;
+        params.duration = std::chrono::seconds(60);
+        params.interval = std::chrono::milliseconds(10);
+        params.tickSize = 0.5;
+        params.minAmount = 1;
+        scheduler.submit(params);
+    }
+
+    LatencyHistogram pollLatency;
+    double busyNs = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(2))
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        scheduler.poll();
+        auto t1 = std::chrono::steady_clock::now();
+        pollLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        busyNs += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+    uint64_t decisions = 0;
+    for (const AlgoStatus &status : scheduler.status())
+    {
+        decisions += status.decisions;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    std::cout << parents << " parent orders: " << decisions / seconds << " decisions/s, " << requests / seconds
+              << " child requests/s, " << busyNs / decisions << " ns per decision, poll p50 " << pollLatency.percentile(50) / 1000.0 << " us, p99 " << pollLatency.percentile(99) / 1000.0
+              << " us" << std::endl;
+    return 0;
+}
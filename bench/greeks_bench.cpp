@@ -0,0 +1,87 @@
+// Measures a full option chain IV + Greeks recompute at each SIMD level.
+//
+//   g++ -std=c++17 -O2 -I . bench/greeks_bench.cpp -o greeks_bench
+//   ./greeks_bench [options in chain]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include "greeks.hpp"
+#include "latency.hpp"
+
+int main(int argc, char *argv[])
+{
+    // Roughly every BTC and ETH option listed on Deribit
+    size_t options = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    constexpr int kRounds = 200;
+
+    // Quote the chain at known vols, so the solved IVs can be checked
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> unit(0, 1);
+    OptionChain quotes;
+    std::vector<double> trueVol;
+    for (size_t i = 0; i < options; ++i)
+    {
+        double forward = i % 2 ? 60000 : 3000;
+        double strike = forward * std::exp((unit(rng) - 0.5) * 1.2);
+        double vol = 0.3 + unit(rng) * 0.9;
+        quotes.add(forward, strike, 1.0 / 365 + unit(rng) * 1.5, unit(rng) < 0.5, 0, vol, 0.02);
+        trueVol.push_back(vol);
+    }
+    evaluateChain(quotes, SimdLevel::Scalar);
+
+    OptionChain chain;
+    for (size_t i = 0; i < options; ++i)
+    {
+        chain.add(quotes.forward[i], quotes.strike[i], quotes.expiry[i], quotes.callPut[i] > 0, quotes.price[i], 0.6, quotes.rate[i]);
+    }
+
+    SimdLevel best = detectSimdLevel();
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Avx2, SimdLevel::Avx512})
+    {
+        if (static_cast<int>(level) > static_cast<int>(best))
+        {
+            std::cout << simdLevelName(level) << ": not supported on this CPU" << std::endl;
+            continue;
+        }
+        // Cold: every solve starts from 60% vol
+        LatencyHistogram histogram;
+        for (int round = 0; round < kRounds; ++round)
+        {
+            std::fill(chain.volatility.begin(), chain.volatility.end(), 0.6);
+            auto t0 = std::chrono::steady_clock::now();
+            evaluateChain(chain, level);
+            auto t1 = std::chrono::steady_clock::now();
+            histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+
+        // Warm: each solve starts from the previous tick's IV, 1% away, as on a live book update
+        LatencyHistogram warm;
+        for (int round = 0; round < kRounds; ++round)
+        {
+            for (size_t i = 0; i < options; ++i)
+            {
+                chain.volatility[i] = trueVol[i] * (round % 2 ? 1.01 : 0.99);
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            evaluateChain(chain, level);
+            auto t1 = std::chrono::steady_clock::now();
+            warm.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+
+        double maxError = 0;
+        for (size_t i = 0; i < options; ++i)
+        {
+            if (std::isfinite(chain.impliedVol[i]))
+            {
+                maxError = std::max(maxError, std::fabs(chain.impliedVol[i] - trueVol[i]));
+            }
+        }
+        std::cout << simdLevelName(level) << ": " << options << " options, cold p50 " << histogram.percentile(50) / 1000.0
+                  << " us (" << histogram.percentile(50) / static_cast<double>(options) << " ns/option), warm p50 "
+                  << warm.percentile(50) / 1000.0 << " us, max IV error " << maxError << std::endl;
+    }
+    return 0;
+}
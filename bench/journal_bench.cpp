@@ -0,0 +1,50 @@
+// Measures journal append latency on the order path in both durability modes.
+//
+//   g++ -std=c++17 -O2 -I . bench/journal_bench.cpp -o journal_bench -pthread
+//   ./journal_bench [journal path]
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "journal.hpp"
+#include "latency.hpp"
+
+void run(const std::string &path, JournalDurability durability, const char *name)
+{
+    constexpr size_t kRecords = 500000;
+    unlink(path.c_str());
+    OrderJournal journal(path, kRecords, durability, std::chrono::microseconds(500));
+
+    // Touch every page once so first-write page faults are not measured
+    for (size_t i = 0; i < kRecords; ++i)
+    {
+        journal.append(JournalEvent::Intent, 0, "", "BTC-PERPETUAL", "", Side::Buy, 10, 50000);
+    }
+    std::vector<RecoveredOrder> none;
+    journal.compact(none);
+
+    LatencyHistogram histogram;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kRecords; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        journal.append(i % 3 ? JournalEvent::Fill : JournalEvent::Intent, i, "ETH-1234567890",
+                       "BTC-PERPETUAL", "mm-quote", i & 1 ? Side::Buy : Side::Sell, 10, 50000.5);
+        auto t1 = std::chrono::steady_clock::now();
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+    auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << name << ": " << kRecords / elapsed / 1e6 << " M appends/s, p50/p99/p99.9/max "
+              << histogram.percentile(50) << " / " << histogram.percentile(99) << " / "
+              << histogram.percentile(99.9) << " / " << histogram.max() << " ns" << std::endl;
+    unlink(path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    std::string path = argc > 1 ? argv[1] : "journal_bench.bin";
+    run(path, JournalDurability::Async, "async       ");
+    run(path, JournalDurability::BatchedSync, "batched sync");
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Compares the scanner-based feed normalizer with the nlohmann::json one:
+// checks that both produce identical updates for every message, then
+// measures throughput of each in MB/s and messages/s.
+//
+// Input is a feed recorded with FEED_RECORD ("<receive ns> <json>" per line);
+// without one, a synthetic Deribit-like feed is generated.
+//
+//   g++ -std=c++17 -O2 -I . -I include bench/json_bench.cpp -o json_bench -lboost_system -lssl -lcrypto -lpthread
+//   ./json_bench [feed.log]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "feed_handler.hpp"
+
+std::vector<std::string> syntheticFeed(size_t count)
+{
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<std::string> messages;
+    double mid = 3012.35;
+    char buffer[256];
+    for (size_t i = 0; i < count; ++i)
+    {
+        mid = std::round(mid * (1 + (unit(rng) - 0.5) * 0.001) * 20) / 20;
+        long long timestamp = 1729000000000LL + static_cast<long long>(i) * 7;
+        std::string message;
+        if (i % 10 < 7)
+        {
+            message = "{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{\"channel\":\"book.ETH-PERPETUAL.none.20.100ms\",\"data\":{\"type\":\"snapshot\",\"timestamp\":";
+            message += std::to_string(timestamp) + ",\"instrument_name\":\"ETH-PERPETUAL\",\"change_id\":" + std::to_string(9000000 + i) + ",\"bids\":[";
+            for (int level = 0; level < 20; ++level)
+            {
+                std::snprintf(buffer, sizeof(buffer), "%s[%.2f,%.1f]", level ? "," : "", mid - 0.05 * (level + 1), std::round(unit(rng) * 50000) / 10);
+                message += buffer;
+            }
+            message += "],\"asks\":[";
+            for (int level = 0; level < 20; ++level)
+            {
+                std::snprintf(buffer, sizeof(buffer), "%s[%.2f,%.1f]", level ? "," : "", mid + 0.05 * level, std::round(unit(rng) * 50000) / 10);
+                message += buffer;
+            }
+            message += "]}}}";
+        }
+        else if (i % 10 < 9)
+        {
+            std::snprintf(buffer, sizeof(buffer),
+                          "{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{\"channel\":\"ticker.ETH-PERPETUAL.100ms\",\"data\":{\"timestamp\":%lld,",
+                          timestamp);
+            message = buffer;
+            std::snprintf(buffer, sizeof(buffer),
+                          "\"stats\":{\"volume_usd\":1.2345e8,\"volume\":41234.5,\"price_change\":-1.0321,\"low\":2950.1,\"high\":3050.25},\"state\":\"open\",\"settlement_price\":%.4f,",
+                          mid * 0.999);
+            message += buffer;
+            std::snprintf(buffer, sizeof(buffer),
+                          "\"open_interest\":98765432,\"min_price\":%.2f,\"max_price\":%.2f,\"mark_price\":%.4f,\"last_price\":%.2f,\"instrument_name\":\"ETH-PERPETUAL\",",
+                          mid * 0.97, mid * 1.03, mid + 0.0123, mid);
+            message += buffer;
+            std::snprintf(buffer, sizeof(buffer),
+                          "\"index_price\":%.4f,\"funding_8h\":0.00001234,\"current_funding\":0,\"best_bid_price\":%.2f,\"best_bid_amount\":%.1f,\"best_ask_price\":%.2f,\"best_ask_amount\":%.1f}}}",
+                          mid - 0.0321, mid - 0.05, std::round(unit(rng) * 50000) / 10, mid, std::round(unit(rng) * 50000) / 10);
+            message += buffer;
+        }
+        else
+        {
+            message = "{\"jsonrpc\":\"2.0\",\"method\":\"subscription\",\"params\":{\"channel\":\"trades.ETH-PERPETUAL.100ms\",\"data\":[";
+            for (int trade = 0; trade < 3; ++trade)
+            {
+                std::snprintf(buffer, sizeof(buffer),
+                              "%s{\"trade_seq\":%zu,\"trade_id\":\"ETH-%zu\",\"timestamp\":%lld,\"tick_direction\":1,\"price\":%.2f,\"mark_price\":%.4f,\"instrument_name\":\"ETH-PERPETUAL\",\"index_price\":%.4f,\"direction\":\"%s\",\"amount\":%.0f}",
+                              trade ? "," : "", 500000 + i * 3 + trade, 800000 + i * 3 + trade, timestamp, mid, mid + 0.01, mid - 0.03, unit(rng) < 0.5 ? "buy" : "sell",
+                              std::round(unit(rng) * 100));
+                message += buffer;
+            }
+            message += "]}}";
+        }
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+bool sameUpdate(const MarketUpdate &a, const MarketUpdate &b)
+{
+    if (a.kind != b.kind || a.getSymbol() != b.getSymbol() || a.sequence != b.sequence || a.exchangeMs != b.exchangeMs || a.bidCount != b.bidCount ||
+        a.askCount != b.askCount || a.direction != b.direction || a.price != b.price || a.amount != b.amount || a.markPrice != b.markPrice ||
+        a.indexPrice != b.indexPrice || a.lastPrice != b.lastPrice)
+    {
+        return false;
+    }
+    int bids = a.kind == UpdateKind::Ticker ? 1 : a.bidCount;
+    int asks = a.kind == UpdateKind::Ticker ? 1 : a.askCount;
+    for (int i = 0; i < bids; ++i)
+    {
+        if (a.bids[i].price != b.bids[i].price || a.bids[i].amount != b.bids[i].amount)
+        {
+            return false;
+        }
+    }
+    for (int i = 0; i < asks; ++i)
+    {
+        if (a.asks[i].price != b.asks[i].price || a.asks[i].amount != b.asks[i].amount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> messages;
+    if (argc > 1)
+    {
+        std::ifstream input(argv[1]);
+        std::string line;
+        while (std::getline(input, line))
+        {
+            size_t space = line.find(' ');
+            if (space != std::string::npos)
+            {
+                messages.push_back(line.substr(space + 1));
+            }
+        }
+    }
+    else
+    {
+        messages = syntheticFeed(100000);
+    }
+    size_t bytes = 0;
+    for (const std::string &message : messages)
+    {
+        bytes += message.size();
+    }
+    std::cout << messages.size() << " messages, " << bytes / 1e6 << " MB" << std::endl;
+
+    // Validation: both paths must emit the same updates
+    DeribitNormalizer normalizer;
+    std::vector<MarketUpdate> fast, reference;
+    size_t mismatches = 0, fallbacks = 0, updates = 0;
+    for (const std::string &message : messages)
+    {
+        fast.clear();
+        reference.clear();
+        size_t count = 0;
+        if (!normalizer.normalizeFast(message, 0, [&fast](const MarketUpdate &update)
+                                      { fast.push_back(update); },
+                                      count))
+        {
+            fallbacks++;
+            continue;
+        }
+        normalizer.normalizeDom(message, 0, [&reference](const MarketUpdate &update)
+                                { reference.push_back(update); });
+        updates += reference.size();
+        bool same = fast.size() == reference.size();
+        for (size_t i = 0; same && i < fast.size(); ++i)
+        {
+            same = sameUpdate(fast[i], reference[i]);
+        }
+        if (!same && mismatches++ < 5)
+        {
+            std::cerr << "Mismatch: " << message.substr(0, 200) << std::endl;
+        }
+    }
+    std::cout << "Validated " << updates << " updates: " << mismatches << " mismatches, " << fallbacks << " messages left to the full parser" << std::endl;
+
+    auto measure = [&](const char *name, auto &&parse)
+    {
+        size_t emitted = 0;
+        int rounds = 0;
+        auto begin = std::chrono::steady_clock::now();
+        double seconds = 0;
+        while (seconds < 2.0)
+        {
+            for (const std::string &message : messages)
+            {
+                emitted += parse(message);
+            }
+            ++rounds;
+            seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+        std::cout << name << ": " << bytes * rounds / seconds / 1e6 << " MB/s, " << messages.size() * rounds / seconds / 1e6 << " M msgs/s, "
+                  << seconds * 1e9 / (messages.size() * rounds) << " ns/msg (" << emitted / rounds << " updates per pass)" << std::endl;
+    };
+    auto sink = [](const MarketUpdate &) {};
+    measure("nlohmann", [&](const std::string &message)
+                         { return normalizer.normalizeDom(message, 0, sink); });
+    measure("scanner ", [&](const std::string &message)
+                          { size_t count = 0; normalizer.normalizeFast(message, 0, sink, count); return count; });
+    return mismatches == 0 ? 0 : 1;
+}
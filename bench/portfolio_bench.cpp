@@ -0,0 +1,93 @@
+// Measures portfolio risk updates, exposure queries and the scenario grid.
+//
+//   g++ -std=c++17 -O2 -I . bench/portfolio_bench.cpp -o portfolio_bench -pthread
+//   ./portfolio_bench [options held] [threads]
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency.hpp"
+#include "portfolio_risk.hpp"
+
+int main(int argc, char *argv[])
+{
+    size_t options = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+    unsigned threads = argc > 2 ? static_cast<unsigned>(std::strtoul(argv[2], nullptr, 10)) : std::max(1u, std::thread::hardware_concurrency());
+    constexpr int kRounds = 2000;
+
+    // Options on BTC and ETH across a year of expiries, plus the perpetuals
+    static const char *months[] = {"JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> unit(0, 1);
+    PortfolioRisk risk;
+    risk.update("BTC-PERPETUAL", -250000, 60000, 60000);
+    risk.update("ETH-PERPETUAL", 40000, 3000, 3000);
+    std::vector<std::string> names;
+    for (size_t i = 0; i < options; ++i)
+    {
+        bool btc = i % 2 == 0;
+        double spot = btc ? 60000 : 3000;
+        char name[64];
+        std::snprintf(name, sizeof(name), "%s-%zu%s%d-%d-%c", btc ? "BTC" : "ETH", 1 + (i / 2) % 28, months[(i / 56) % 12],
+                      27, static_cast<int>(spot * (0.5 + (i / 2 % 41) * 0.025)), i % 4 < 2 ? 'C' : 'P');
+        names.push_back(name);
+        risk.update(name, std::round((unit(rng) - 0.5) * 20), 0.02 + unit(rng) * 0.05, 0);
+    }
+
+    LatencyHistogram update, query, underlying;
+    for (int round = 0; round < kRounds; ++round)
+    {
+        const std::string &name = names[rng() % names.size()];
+        auto t0 = std::chrono::steady_clock::now();
+        risk.update(name, std::round((unit(rng) - 0.5) * 20), 0.02 + unit(rng) * 0.05, 0);
+        auto t1 = std::chrono::steady_clock::now();
+        CurrencyExposure exposure = risk.exposure(name.substr(0, 3));
+        auto t2 = std::chrono::steady_clock::now();
+        update.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        query.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+        if (exposure.positions == 0)
+        {
+            std::cerr << "Error: lost positions" << std::endl;
+        }
+    }
+    for (int round = 0; round < kRounds / 10; ++round)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        risk.setUnderlying("BTC", 60000 * (1 + (unit(rng) - 0.5) * 0.01));
+        auto t1 = std::chrono::steady_clock::now();
+        underlying.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+    }
+
+    std::vector<double> spotShocks, volShocks;
+    for (int i = -10; i <= 10; ++i)
+    {
+        spotShocks.push_back(i * 0.02);
+    }
+    for (int i = -3; i <= 3; ++i)
+    {
+        volShocks.push_back(i * 0.05);
+    }
+    LatencyHistogram grid, gridSingle;
+    for (int round = 0; round < 20; ++round)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        risk.scenarios(spotShocks, volShocks, threads);
+        auto t1 = std::chrono::steady_clock::now();
+        risk.scenarios(spotShocks, volShocks, 1);
+        auto t2 = std::chrono::steady_clock::now();
+        grid.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        gridSingle.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count());
+    }
+
+    std::cout << options << " options: position update p50 " << update.percentile(50) << " ns, p99 " << update.percentile(99)
+              << " ns; exposure query p50 " << query.percentile(50) << " ns" << std::endl;
+    std::cout << "Underlying move (full BTC reprice) p50 " << underlying.percentile(50) / 1000.0 << " us" << std::endl;
+    std::cout << spotShocks.size() << "x" << volShocks.size() << " scenario grid p50 " << grid.percentile(50) / 1e6 << " ms on "
+              << threads << " threads, " << gridSingle.percentile(50) / 1e6 << " ms on 1 thread" << std::endl;
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Scale-out of the relay tier on one host. For each edge count the bench
+// starts a root server on the mock feed, that many edge servers fed by it
+// over a Unix socket (each serving its RELAY_SHARD of the symbols), and one
+// loadgen per edge with the same number of connections, then adds up the
+// loadgen reports. With enough cores, connections and delivered messages per
+// second should grow in proportion to the edges while the delay stays flat.
+//
+//   g++ -std=c++17 -O2 server.cpp -o server -lboost_system -lpthread -lssl -lcrypto -lrt -lz
+//   g++ -std=c++17 -O2 loadgen.cpp -o loadgen -lboost_system -lpthread
+//   g++ -std=c++17 -O2 -I . bench/relay_bench.cpp -o relay_bench -lboost_system -lssl -lcrypto -lpthread
+//   ./relay_bench [connections per edge] [seconds] [edge counts] [symbols]
+//   ./relay_bench 2000 30 1,2,4 ETH-PERPETUAL,BTC-PERPETUAL,SOL-PERPETUAL,XRP-PERPETUAL
+//
+// Runs ./server and ./loadgen from the current directory, which must hold the
+// .env with the client credentials; every process gets its own copy of it
+// with the relay settings in front (ENV_FILE).
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "relay.hpp"
+
+using json = nlohmann::json;
+
+const std::string kDir = "/tmp/relay_bench";
+constexpr int kRootPort = 9100;
+
+std::vector<std::string> split(const std::string &str, char delimiter)
+{
+    std::vector<std::string> parts;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, delimiter))
+    {
+        if (!item.empty())
+        {
+            parts.push_back(item);
+        }
+    }
+    return parts;
+}
+
+std::string join(const std::vector<std::string> &parts)
+{
+    std::string out;
+    for (const std::string &part : parts)
+    {
+        out += (out.empty() ? "" : ",") + part;
+    }
+    return out;
+}
+
+// EnvConfig keeps the first value of a key, so the overrides go first
+std::string writeEnv(const std::string &name, const std::vector<std::string> &overrides)
+{
+    std::string path = kDir + "/" + name + ".env";
+    std::ofstream out(path);
+    for (const std::string &line : overrides)
+    {
+        out << line << "\n";
+    }
+    out << std::ifstream(".env").rdbuf();
+    return path;
+}
+
+pid_t spawn(const std::vector<std::string> &args, const std::string &envFile, const std::string &logFile)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setenv("ENV_FILE", envFile.c_str(), 1);
+        if (!freopen(logFile.c_str(), "w", stdout) || !freopen(logFile.c_str(), "a", stderr))
+        {
+            _exit(127);
+        }
+        std::vector<char *> argv;
+        for (const std::string &arg : args)
+        {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+void stopAll(const std::vector<pid_t> &pids)
+{
+    for (pid_t pid : pids)
+    {
+        kill(pid, SIGTERM);
+    }
+    for (pid_t pid : pids)
+    {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int connections = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int seconds = argc > 2 ? std::atoi(argv[2]) : 30;
+    std::vector<std::string> edgeCounts = split(argc > 3 ? argv[3] : "1,2,4", ',');
+    std::vector<std::string> symbols = split(argc > 4 ? argv[4] : "ETH-PERPETUAL,BTC-PERPETUAL,SOL-PERPETUAL,XRP-PERPETUAL", ',');
+    if (system(("mkdir -p " + kDir).c_str()) != 0)
+    {
+        std::cerr << "Cannot create " << kDir << std::endl;
+        return 1;
+    }
+    std::string relayAddress = "unix:" + kDir + "/root.sock";
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "edges  connections  msgs/s (steady)  msgs/s per edge  worst p50 us  worst p99 us" << std::endl;
+    for (const std::string &count : edgeCounts)
+    {
+        int edges = std::max(1, std::atoi(count.c_str()));
+        std::vector<pid_t> servers;
+        servers.push_back(spawn({"./server"}, writeEnv("root", {"FEED_SOURCE=mock", "FEED_SYMBOLS=" + join(symbols), "RELAY_LISTEN=" + relayAddress, "WS_PORT=" + std::to_string(kRootPort), "SHM_BUS_NAME="}),
+                                kDir + "/root.log"));
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        // Edge i serves the symbols of shard i. An edge whose shard is empty
+        // (more edges than symbols) runs unsharded and serves all of them.
+        std::vector<std::vector<std::string>> shards(edges);
+        for (const std::string &symbol : symbols)
+        {
+            shards[relayShardOf(symbol, edges)].push_back(symbol);
+        }
+        for (int i = 0; i < edges; ++i)
+        {
+            bool sharded = !shards[i].empty();
+            if (!sharded)
+            {
+                shards[i] = symbols;
+            }
+            std::string name = "edge" + std::to_string(i);
+            std::vector<std::string> settings = {"FEED_SOURCE=relay", "FEED_URL=" + relayAddress, "FEED_SYMBOLS=" + join(shards[i]),
+                                                 "WS_PORT=" + std::to_string(kRootPort + 1 + i), "RELAY_LISTEN=", "SHM_BUS_NAME="};
+            if (sharded)
+            {
+                settings.push_back("RELAY_SHARD=" + std::to_string(i) + "/" + std::to_string(edges));
+            }
+            servers.push_back(spawn({"./server"}, writeEnv(name, settings), kDir + "/" + name + ".log"));
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        std::vector<pid_t> loads;
+        for (int i = 0; i < edges; ++i)
+        {
+            std::string name = "load" + std::to_string(i);
+            std::remove((kDir + "/" + name + ".json").c_str());
+            loads.push_back(spawn({"./loadgen", "--url", "ws://localhost:" + std::to_string(kRootPort + 1 + i), "--connections", std::to_string(connections),
+                                   "--threads", "2", "--rate", std::to_string(std::max(500, connections / 5)), "--duration", std::to_string(seconds),
+                                   "--symbols", join(shards[i]), "--report", kDir + "/" + name + ".json"},
+                                  writeEnv(name, {}), kDir + "/" + name + ".log"));
+        }
+        for (pid_t pid : loads)
+        {
+            waitpid(pid, nullptr, 0);
+        }
+        stopAll(servers);
+
+        uint64_t opened = 0;
+        double messagesPerSec = 0, p50 = 0, p99 = 0;
+        for (int i = 0; i < edges; ++i)
+        {
+            std::ifstream input(kDir + "/load" + std::to_string(i) + ".json");
+            json report = json::parse(input, nullptr, false);
+            if (report.is_discarded())
+            {
+                std::cerr << "No report from loadgen " << i << ", see " << kDir << "/load" << i << ".log" << std::endl;
+                continue;
+            }
+            opened += report["connections"]["opened"].get<uint64_t>();
+            messagesPerSec += report["throughput"]["steady_state_messages_per_sec"].get<double>();
+            p50 = std::max(p50, report["propagation_delay"]["p50_us"].get<double>());
+            p99 = std::max(p99, report["propagation_delay"]["p99_us"].get<double>());
+        }
+        std::cout << std::setw(5) << edges << std::setw(13) << opened << std::setw(17) << messagesPerSec << std::setw(17) << messagesPerSec / edges
+                  << std::setw(14) << p50 << std::setw(14) << p99 << std::endl;
+    }
+    return 0;
+}
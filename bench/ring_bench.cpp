@@ -0,0 +1,293 @@
+// Throughput and cross-core latency of the ring buffers in ring_buffer.hpp
+// with 64-byte messages. Threads are pinned to the given cores (default 0,1,2,3).
+//
+// Throughput: SPSC one producer -> one consumer; MPSC with several producers;
+// multicast with one producer, two independent consumers and a third that
+// depends on the first (sequence barrier).
+// Latency: ping-pong between two cores over a pair of rings; one-way latency
+// is half the round trip.
+//
+//   g++ -std=c++17 -O2 -I . bench/ring_bench.cpp -o ring_bench -lpthread
+//   ./ring_bench [core list, e.g. 2,4,6,8] [messages]
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency.hpp"
+#include "ring_buffer.hpp"
+
+struct Message
+{
+    uint64_t sequence;
+    int64_t sentNs;
+    char payload[48];
+};
+
+static std::vector<int> cores = {0, 1, 2, 3};
+
+// Busy-spin while waiting, except on a single core where the other side
+// cannot run until the waiter gives up its time slice
+static const bool singleCore = std::thread::hardware_concurrency() < 2;
+
+inline void relax()
+{
+    if (singleCore)
+    {
+        std::this_thread::yield();
+    }
+}
+
+void pin(size_t index)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cores[index % cores.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+double elapsed(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void spscThroughput(uint64_t count)
+{
+    SpscRing<Message> ring(4096);
+    auto begin = std::chrono::steady_clock::now();
+    std::thread consumer([&]()
+                         {
+                             pin(1);
+                             Message message;
+                             for (uint64_t received = 0; received < count;)
+                             {
+                                 if (ring.tryPop(message))
+                                 {
+                                     ++received;
+                                 }
+                                 else
+                                 {
+                                     relax();
+                                 }
+                             } });
+    pin(0);
+    Message message{};
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        message.sequence = i;
+        while (!ring.tryPush(message))
+        {
+            relax();
+        }
+    }
+    consumer.join();
+    std::cout << "SPSC      1 -> 1: " << count / elapsed(begin) / 1e6 << " M msgs/s" << std::endl;
+}
+
+void mpscThroughput(uint64_t count, size_t producers)
+{
+    MpscRing<Message> ring(4096);
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p]()
+                             {
+                                 pin(p + 1);
+                                 Message message{};
+                                 for (uint64_t i = 0; i < count / producers; ++i)
+                                 {
+                                     message.sequence = i;
+                                     while (!ring.tryPush(message))
+                                     {
+                                         relax();
+                                     }
+                                 } });
+    }
+    pin(0);
+    Message message;
+    uint64_t total = count / producers * producers;
+    for (uint64_t received = 0; received < total;)
+    {
+        if (ring.tryPop(message))
+        {
+            ++received;
+        }
+        else
+        {
+            relax();
+        }
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    std::cout << "MPSC      " << producers << " -> 1: " << total / elapsed(begin) / 1e6 << " M msgs/s" << std::endl;
+}
+
+void multicastThroughput(uint64_t count)
+{
+    MulticastRing<Message> ring(4096);
+    RingConsumer<Message> first(ring);
+    RingConsumer<Message> second(ring);
+    RingConsumer<Message> dependent(ring, {&first.getSequence()});
+    std::vector<uint64_t> checksums(3);
+    auto consume = [&](RingConsumer<Message> &consumer, size_t index)
+    {
+        pin(index + 1);
+        uint64_t received = 0;
+        while (received < count)
+        {
+            size_t polled = consumer.poll([&](const Message &message, int64_t)
+                                          { checksums[index] += message.sequence; });
+            if (polled == 0)
+            {
+                relax();
+            }
+            received += polled;
+        }
+    };
+    auto begin = std::chrono::steady_clock::now();
+    std::thread a(consume, std::ref(first), 0);
+    std::thread b(consume, std::ref(second), 1);
+    std::thread c(consume, std::ref(dependent), 2);
+    pin(0);
+    Message message{};
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        message.sequence = i;
+        while (!ring.tryPublish(message))
+        {
+            relax();
+        }
+    }
+    a.join();
+    b.join();
+    c.join();
+    bool consistent = checksums[0] == checksums[1] && checksums[1] == checksums[2];
+    std::cout << "Multicast 1 -> 3: " << count / elapsed(begin) / 1e6 << " M msgs/s per consumer" << (consistent ? "" : " (checksum mismatch!)") << std::endl;
+}
+
+// Ping-pong over two rings; Push/Pop adapt the ring's interface
+template <typename Ring, typename Push, typename Pop>
+void pingPong(const char *name, uint64_t rounds, Push push, Pop pop)
+{
+    Ring ping(1024), pong(1024);
+    std::thread echo([&]()
+                     {
+                         pin(1);
+                         Message message;
+                         for (uint64_t i = 0; i < rounds; ++i)
+                         {
+                             while (!pop(ping, message))
+                             {
+                                 relax();
+                             }
+                             while (!push(pong, message))
+                             {
+                                 relax();
+                             }
+                         } });
+    pin(0);
+    LatencyHistogram oneWay;
+    Message message{};
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        message.sequence = i;
+        int64_t start = nowNanos();
+        while (!push(ping, message))
+        {
+            relax();
+        }
+        while (!pop(pong, message))
+        {
+            relax();
+        }
+        oneWay.record((nowNanos() - start) / 2);
+    }
+    echo.join();
+    std::cout << name << " cross-core one-way latency: p50 " << oneWay.percentile(50) << " ns, p99 " << oneWay.percentile(99) << " ns, p99.9 "
+              << oneWay.percentile(99.9) << " ns" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        cores.clear();
+        std::stringstream list(argv[1]);
+        std::string core;
+        while (std::getline(list, core, ','))
+        {
+            cores.push_back(std::stoi(core));
+        }
+    }
+    const uint64_t count = argc > 2 ? std::stoull(argv[2]) : 20000000;
+    spscThroughput(count);
+    mpscThroughput(count, 1);
+    mpscThroughput(count, 3);
+    multicastThroughput(count);
+
+    const uint64_t rounds = std::max<uint64_t>(count / 100, 1000);
+    pingPong<SpscRing<Message>>(
+        "SPSC     ", rounds, [](SpscRing<Message> &ring, const Message &message)
+        { return ring.tryPush(message); },
+        [](SpscRing<Message> &ring, Message &message)
+        { return ring.tryPop(message); });
+    pingPong<MpscRing<Message>>(
+        "MPSC     ", rounds, [](MpscRing<Message> &ring, const Message &message)
+        { return ring.tryPush(message); },
+        [](MpscRing<Message> &ring, Message &message)
+        { return ring.tryPop(message); });
+
+    // Multicast rings need their consumer registered before publishing
+    MulticastRing<Message> ping(1024), pong(1024);
+    RingConsumer<Message> pingReader(ping), pongReader(pong);
+    auto readOne = [](RingConsumer<Message> &reader, Message &message)
+    {
+        return reader.poll([&message](const Message &m, int64_t)
+                           { message = m; },
+                           1) == 1;
+    };
+    std::thread echo([&]()
+                     {
+                         pin(1);
+                         Message message;
+                         for (uint64_t i = 0; i < rounds; ++i)
+                         {
+                             while (!readOne(pingReader, message))
+                             {
+                                 relax();
+                             }
+                             while (!pong.tryPublish(message))
+                             {
+                                 relax();
+                             }
+                         } });
+    pin(0);
+    LatencyHistogram oneWay;
+    Message message{};
+    for (uint64_t i = 0; i < rounds; ++i)
+    {
+        int64_t start = nowNanos();
+        while (!ping.tryPublish(message))
+        {
+            relax();
+        }
+        while (!readOne(pongReader, message))
+        {
+            relax();
+        }
+        oneWay.record((nowNanos() - start) / 2);
+    }
+    echo.join();
+    std::cout << "Multicast cross-core one-way latency: p50 " << oneWay.percentile(50) << " ns, p99 " << oneWay.percentile(99) << " ns, p99.9 "
+              << oneWay.percentile(99.9) << " ns" << std::endl;
+    return 0;
+}
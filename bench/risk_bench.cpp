@@ -0,0 +1,99 @@
+// Measures the cost the pre-trade risk layer adds to the order path.
+//
+//   g++ -std=c++17 -O2 -I . bench/risk_bench.cpp -o risk_bench -pthread
+//   ./risk_bench
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "latency.hpp"
+#include "risk.hpp"
+
+int main()
+{
+    constexpr int kInstruments = 2000;
+    constexpr int kIterations = 2000000;
+
+    PreTradeRisk risk(1000000);
+    InstrumentLimits limits;
+    limits.maxOpenOrders = 1000000;
+    for (int i = 0; i < kInstruments; ++i)
+    {
+        std::string currency = i % 2 ? "BTC" : "ETH";
+        int id = risk.registerInstrument(currency + "-" + std::to_string(i), currency, limits);
+        risk.updateMid(id, 999.5, 1000.5);
+    }
+    risk.setCurrencyLimit("BTC", 1e12);
+    risk.setCurrencyLimit("ETH", 1e12);
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> pick(0, kInstruments - 1);
+    std::vector<int> ids(kIterations);
+    for (auto &id : ids)
+    {
+        id = pick(rng);
+    }
+
+    // Throughput: check + release pairs, as an accepted-then-cancelled order would do
+    auto start = std::chrono::steady_clock::now();
+    uint64_t accepted = 0;
+    for (int i = 0; i < kIterations; ++i)
+    {
+        Side side = i & 1 ? Side::Buy : Side::Sell;
+        if (risk.checkAndReserve(ids[i], side, 10, 1000.0 + (i % 7)) == RiskResult::Accepted)
+        {
+            accepted++;
+            risk.release(ids[i], side, 10, 1000.0 + (i % 7), true);
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    // Per-call distribution of checkAndReserve alone (includes ~20ns of clock overhead)
+    LatencyHistogram histogram;
+    for (int i = 0; i < kIterations; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        RiskResult result = risk.checkAndReserve(ids[i], Side::Buy, 10, 1000.0);
+        auto t1 = std::chrono::steady_clock::now();
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        if (result == RiskResult::Accepted)
+        {
+            risk.release(ids[i], Side::Buy, 10, 1000.0, true);
+        }
+    }
+
+    // Contended: several threads hammering the same instruments
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    auto contendedStart = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&risk, &ids, t]()
+                             {
+                                 for (int i = 0; i < kIterations / 4; ++i)
+                                 {
+                                     int id = ids[(i + t * 7919) % kIterations] % 16;
+                                     if (risk.checkAndReserve(id, Side::Buy, 1, 1000.0) == RiskResult::Accepted)
+                                     {
+                                         risk.release(id, Side::Buy, 1, 1000.0, true);
+                                     }
+                                 } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    auto contended = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - contendedStart).count();
+
+    std::cout << "instruments:                 " << kInstruments << '\n'
+              << "accepted:                    " << accepted << " / " << kIterations << '\n'
+              << "check+release mean:          " << elapsed / kIterations << " ns\n"
+              << "checkAndReserve p50/p99/p999: " << histogram.percentile(50) << " / " << histogram.percentile(99)
+              << " / " << histogram.percentile(99.9) << " ns\n"
+              << "contended (" << threads << " threads, 16 instruments) check+release mean: "
+              << contended / (static_cast<double>(kIterations) / 4 * threads) * threads << " ns per thread-op\n"
+              << "open orders after run:       " << risk.openOrderCount() << std::endl;
+    return 0;
+}
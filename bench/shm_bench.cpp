@@ -0,0 +1,106 @@
+// Delivery latency of the shared-memory bus against a WebSocket client on
+// loopback, for the same updates from a running server. Start the server with
+// SHM_BUS_NAME set in .env (FEED_SOURCE=mock gives a steady local stream), then:
+//
+//   g++ -std=c++17 -O2 -I . bench/shm_bench.cpp -o shm_bench -lboost_system -lssl -lcrypto -lpthread -lrt
+//   ./shm_bench [bus name] [symbol] [seconds]
+//
+// Latency is measured from the moment the server normalized the update (the
+// `book` trace stamp) to the moment each consumer has it in hand: a seqlock
+// copy out of the log for shared memory; a received and parsed frame for the
+// WebSocket.
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <nlohmann/json.hpp>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "config.hpp"
+#include "latency.hpp"
+#include "shm_bus.hpp"
+
+using json = nlohmann::json;
+typedef websocketpp::client<websocketpp::config::asio_client> ws_client;
+
+void report(const char *name, const LatencyHistogram &histogram, uint64_t count)
+{
+    std::cout << name << count << " updates, p50 " << histogram.percentile(50) / 1000.0 << " us, p90 " << histogram.percentile(90) / 1000.0 << " us, p99 "
+              << histogram.percentile(99) / 1000.0 << " us, p99.9 " << histogram.percentile(99.9) / 1000.0 << " us" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string busName = argc > 1 ? argv[1] : "/deribit_md";
+    std::string symbol = argc > 2 ? argv[2] : "ETH-PERPETUAL";
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 30;
+    std::atomic<bool> running{true};
+
+    // Shared memory: one busy-polling reader thread
+    LatencyHistogram shmLatency;
+    uint64_t shmCount = 0;
+    std::thread shmThread([&]()
+                          {
+                              ShmBusReader reader(busName);
+                              while (running)
+                              {
+                                  reader.poll([&](const MarketUpdate &update)
+                                              {
+                                                  int64_t now = nowNanos();
+                                                  if (update.getSymbol() == symbol)
+                                                  {
+                                                      shmLatency.record(now - update.normalizedNs);
+                                                      ++shmCount;
+                                                  } });
+                              }
+                              if (reader.getGaps() != 0)
+                              {
+                                  std::cerr << "Shared memory reader skipped " << reader.getGaps() << " updates" << std::endl;
+                              } });
+
+    // WebSocket: authenticate, subscribe, stamp each frame on arrival
+    LatencyHistogram wsLatency;
+    uint64_t wsCount = 0;
+    ws_client client;
+    client.clear_access_channels(websocketpp::log::alevel::all);
+    client.clear_error_channels(websocketpp::log::elevel::all);
+    client.init_asio();
+    client.set_open_handler([&](websocketpp::connection_hdl hdl)
+                            {
+                                json authenticate = {{"action", "authenticate"}, {"client_id", envConfig().get("CLIENT_ID")}, {"client_secret", envConfig().get("CLIENT_SECRET")}};
+                                client.send(hdl, authenticate.dump(), websocketpp::frame::opcode::text);
+                                json subscribe = {{"action", "subscribe"}, {"symbol", symbol}};
+                                client.send(hdl, subscribe.dump(), websocketpp::frame::opcode::text); });
+    client.set_message_handler([&](websocketpp::connection_hdl, ws_client::message_ptr message)
+                               {
+                                   auto parsed = json::parse(message->get_payload(), nullptr, false);
+                                   int64_t now = nowNanos();
+                                   if (!parsed.is_discarded() && parsed.contains("ts") && parsed["ts"].contains("book"))
+                                   {
+                                       wsLatency.record(now - parsed["ts"]["book"].get<int64_t>());
+                                       ++wsCount;
+                                   } });
+    websocketpp::lib::error_code ec;
+    ws_client::connection_ptr connection = client.get_connection("ws://localhost:9000", ec);
+    if (ec)
+    {
+        std::cerr << "Connection error: " << ec.message() << std::endl;
+        running = false;
+        shmThread.join();
+        return 1;
+    }
+    client.connect(connection);
+    std::thread wsThread([&client]()
+                         { client.run(); });
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    running = false;
+    shmThread.join();
+    client.stop();
+    wsThread.join();
+
+    report("Shared memory: ", shmLatency, shmCount);
+    report("WebSocket:     ", wsLatency, wsCount);
+    return 0;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "feed_handler.hpp"
+#include "wire_format.hpp"
+
+// Depth-limited book stream for one symbol: clients get a snapshot of the
+// top `depth` levels, then sequenced deltas holding only the levels that
+// changed since the previous published book, so an update costs bandwidth
+// in proportion to what moved rather than to the depth.
+//
+//   {"symbol":..,"type":"book_snapshot","depth":10,"seq":41,"timestamp":..,"bids":[[p,a],..],"asks":[..]}
+//   {"symbol":..,"type":"book_delta","depth":10,"seq":42,"timestamp":..,"bids":[[p,a],..],"asks":[..]}
+//
+// A delta level with amount 0 is removed; after applying a delta the client
+// keeps only the best `depth` levels per side, so levels pushed out by better
+// ones are not sent as removals. Deltas apply to the book with the previous
+// seq; a client that sees a gap must resubscribe for a new snapshot.
+class DepthBook
+{
+public:
+    explicit DepthBook(int depth) : depth(std::min(std::max(depth, 1), kMaxDepth)) {}
+
+    int getDepth() const
+    {
+        return depth;
+    }
+
+    uint64_t getSequence() const
+    {
+        return sequence;
+    }
+
+    // False until the first book has been applied
+    bool ready() const
+    {
+        return hasBook;
+    }
+
+    // Takes the top `depth` levels of `book`. Returns true and writes a delta
+    // to `message` if they differ from the previous book; the first book
+    // only sets the state (send a snapshot instead). `message` is scratch
+    // space otherwise.
+    bool apply(const MarketUpdate &book, std::string &message)
+    {
+        int newBidCount = std::min<int>(book.bidCount, depth);
+        int newAskCount = std::min<int>(book.askCount, depth);
+        bool changed = false;
+        if (hasBook)
+        {
+            message.assign("{\"asks\":[");
+            diffLevels(asks, askCount, book.asks, newAskCount, depth, [](double a, double b)
+                       { return a < b; },
+                       message);
+            changed = message.back() != '[';
+            message += "],\"bids\":[";
+            diffLevels(bids, bidCount, book.bids, newBidCount, depth, [](double a, double b)
+                       { return a > b; },
+                       message);
+            changed = changed || message.back() != '[';
+            if (changed)
+            {
+                ++sequence;
+                message += ']';
+                appendHeader(message, "book_delta", book.getSymbol(), book.exchangeMs);
+            }
+        }
+        std::copy(book.bids, book.bids + newBidCount, bids);
+        std::copy(book.asks, book.asks + newAskCount, asks);
+        bidCount = newBidCount;
+        askCount = newAskCount;
+        exchangeMs = book.exchangeMs;
+        symbol.assign(book.getSymbol());
+        hasBook = true;
+        return changed;
+    }
+
+    // Current state; the next delta has seq + 1
+    void snapshot(std::string &message) const
+    {
+        message.assign("{\"asks\":");
+        appendJsonLevels(message, asks, askCount);
+        message += ",\"bids\":";
+        appendJsonLevels(message, bids, bidCount);
+        appendHeader(message, "book_snapshot", symbol, exchangeMs);
+    }
+
+private:
+    int depth;
+    uint64_t sequence = 0;
+    bool hasBook = false;
+    int bidCount = 0;
+    int askCount = 0;
+    PriceLevel bids[kMaxDepth];
+    PriceLevel asks[kMaxDepth];
+    int64_t exchangeMs = 0;
+    std::string symbol;
+
+    // The fields after the level arrays, in the wire format's key order
+    void appendHeader(std::string &out, const char *type, std::string_view name, int64_t timestamp) const
+    {
+        out += ",\"depth\":";
+        appendJsonInteger(out, depth);
+        out += ",\"seq\":";
+        appendJsonInteger(out, sequence);
+        out += ",\"symbol\":";
+        appendJsonString(out, name);
+        out += ",\"timestamp\":";
+        appendJsonInteger(out, timestamp);
+        out += ",\"type\":\"";
+        out += type;
+        out += "\"}";
+    }
+
+    // Merge walk over two sides sorted best first. Prices come from the same
+    // parser, so equal prices compare exactly.
+    template <typename Better>
+    static void diffLevels(const PriceLevel *before, int beforeCount, const PriceLevel *after, int afterCount, int depth, Better better, std::string &out)
+    {
+        int i = 0, j = 0;
+        while (i < beforeCount || j < afterCount)
+        {
+            if (j == afterCount || (i < beforeCount && better(before[i].price, after[j].price)))
+            {
+                // Level gone, unless the client's truncation to depth drops it
+                if (afterCount < depth || better(before[i].price, after[afterCount - 1].price))
+                {
+                    appendJsonLevel(out, before[i].price, 0.0);
+                }
+                ++i;
+            }
+            else if (i == beforeCount || better(after[j].price, before[i].price))
+            {
+                appendJsonLevel(out, after[j].price, after[j].amount); // new level
+                ++j;
+            }
+            else
+            {
+                if (before[i].amount != after[j].amount)
+                {
+                    appendJsonLevel(out, after[j].price, after[j].amount);
+                }
+                ++i;
+                ++j;
+            }
+        }
+    }
+};
@@ -2,67 +2,179 @@
 #include <websocketpp/client.hpp>
 #include <nlohmann/json.hpp>
 #include <iostream>
+#include <functional>
+#include <map>
+#include <string>
 #include <thread>
-#include <fstream>
+#include <vector>
 #include <chrono>
+#include "config.hpp"
+#include "latency.hpp"
 
 using json = nlohmann::json;
+using websocketpp::connection_hdl;
 
-std::string trim(const std::string &str)
-{
-    size_t first = str.find_first_not_of(" \t\r\n");
-    size_t last = str.find_last_not_of(" \t\r\n");
-    return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
-}
+typedef websocketpp::client<websocketpp::config::asio_client> client;
 
-std::string getEnvVariable(const std::string &key)
+const std::string bookSymbol = "ETH-PERPETUAL";
+
+// Local copy of a server book stream: starts from a book_snapshot and applies
+// every book_delta in seq order. A level with amount 0 is removed, and each
+// side is cut to the stream's depth after every delta. After a gap the book
+// is stale and deltas are ignored until the next snapshot.
+class BookBuilder
 {
-    std::ifstream envFile(".env");
-    if (!envFile.is_open())
+public:
+    // False if `message` reveals a gap, once per gap
+    bool apply(const json &message)
+    {
+        uint64_t seq = message["seq"].get<uint64_t>();
+        if (message["type"] == "book_snapshot")
+        {
+            bids.clear();
+            asks.clear();
+        }
+        else if (!valid)
+        {
+            return true; // waiting for a snapshot
+        }
+        else if (seq != sequence + 1)
+        {
+            valid = false;
+            return false;
+        }
+        size_t depth = message["depth"].get<size_t>();
+        applyLevels(message["bids"], depth, bids);
+        applyLevels(message["asks"], depth, asks);
+        sequence = seq;
+        valid = true;
+        return true;
+    }
+
+    bool ready() const
     {
-        std::cerr << "Error: Could not open .env file.\n";
-        return "";
+        return valid;
     }
 
-    std::string line;
-    while (std::getline(envFile, line))
+    void print(const std::string &symbol) const
     {
-        size_t pos = line.find('=');
-        if (pos != std::string::npos)
+        std::cout << symbol << " #" << sequence << ": " << bids.size() << " bids, " << asks.size() << " asks";
+        if (!bids.empty() && !asks.empty())
         {
-            std::string currentKey = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            currentKey = trim(currentKey);
-            value = trim(value); // Trim whitespace and carriage return
-            if (currentKey == key)
+            std::cout << ", best " << bids.begin()->second << " @ " << bids.begin()->first << " / " << asks.begin()->second << " @ " << asks.begin()->first;
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    std::map<double, double, std::greater<double>> bids;
+    std::map<double, double> asks;
+    uint64_t sequence = 0;
+    bool valid = false;
+
+    template <typename Side>
+    static void applyLevels(const json &levels, size_t depth, Side &side)
+    {
+        for (const json &level : levels)
+        {
+            double price = level[0].get<double>(), amount = level[1].get<double>();
+            if (amount == 0)
             {
-                return value;
+                side.erase(price);
             }
+            else
+            {
+                side[price] = amount;
+            }
+        }
+        while (side.size() > depth)
+        {
+            side.erase(std::prev(side.end()));
         }
     }
-    return "";
+};
+
+std::map<std::string, BookBuilder> books;
+
+// One request for any number of symbols or patterns ("BTC-*"); the reply
+// carries the snapshots of all of them
+void subscribeBooks(client *c, websocketpp::connection_hdl hdl, const std::vector<std::string> &symbols)
+{
+    json subscribeMessage = {
+        {"action", "subscribe"},
+        {"symbols", symbols},
+        {"channel", "book"},
+        {"depth", envConfig().getInt("BOOK_DEPTH", 10)}};
+    c->send(hdl, subscribeMessage.dump(), websocketpp::frame::opcode::text);
 }
-using json = nlohmann::json;
-using websocketpp::connection_hdl;
 
-typedef websocketpp::client<websocketpp::config::asio_client> client;
+void onBookMessage(client *c, websocketpp::connection_hdl hdl, const json &message)
+{
+    std::string symbol = message["symbol"];
+    BookBuilder &book = books[symbol];
+    if (!book.apply(message))
+    {
+        // Missed a delta: a fresh subscription starts with a new snapshot
+        std::cout << "Book gap on " << symbol << ", resubscribing" << std::endl;
+        json unsubscribeMessage = {{"action", "unsubscribe"}, {"symbol", symbol}, {"channel", "book"}};
+        c->send(hdl, unsubscribeMessage.dump(), websocketpp::frame::opcode::text);
+        subscribeBooks(c, hdl, {symbol});
+    }
+    else if (book.ready())
+    {
+        book.print(symbol);
+    }
+}
 
 void onMessage(client *c, websocketpp::connection_hdl hdl, client::message_ptr msg)
 {
+    int64_t receivedNs = nowNanos();
     auto payload = msg->get_payload();
+    auto parsed = json::parse(payload, nullptr, false);
+    if (!parsed.is_discarded() && parsed.contains("type") && (parsed["type"] == "book_snapshot" || parsed["type"] == "book_delta"))
+    {
+        onBookMessage(c, hdl, parsed);
+        return;
+    }
+    if (!parsed.is_discarded() && parsed.contains("snapshots"))
+    {
+        bool bookStreams = parsed.value("channel", "") == "book";
+        std::cout << "Subscribed to " << parsed["symbols"].size() << (bookStreams ? " book(s)" : " symbol(s)") << std::endl;
+        for (const json &snapshot : parsed["snapshots"])
+        {
+            if (bookStreams)
+            {
+                onBookMessage(c, hdl, snapshot);
+            }
+            else
+            {
+                std::cout << "Received: " << snapshot.dump() << std::endl;
+            }
+        }
+        return;
+    }
     std::cout << "Received: " << payload << std::endl;
+
+    // Echo the stage timestamps of sampled updates so the server can
+    // complete its per-hop latency histograms
+    if (!parsed.is_discarded() && parsed.contains("trace") && parsed.contains("ts"))
+    {
+        json echo = {
+            {"action", "trace_echo"},
+            {"ts", parsed["ts"]}};
+        echo["ts"]["rx"] = receivedNs;
+        c->send(hdl, echo.dump(), websocketpp::frame::opcode::text);
+    }
 }
 
 void onOpen(client *c, websocketpp::connection_hdl hdl)
 {
     std::cout << "Connected to server." << std::endl;
-    std::string env_client_id = getEnvVariable("CLIENT_ID");
-    std::string env_client_secret = getEnvVariable("CLIENT_SECRET");
     // Authenticate
     json authMessage = {
         {"action", "authenticate"},
-        {"client_id", env_client_id},
-        {"client_secret", env_client_secret}};
+        {"client_id", envConfig().get("CLIENT_ID")},
+        {"client_secret", envConfig().get("CLIENT_SECRET")}};
     c->send(hdl, authMessage.dump(), websocketpp::frame::opcode::text);
 
     // Subscribe to a symbol
@@ -70,6 +182,9 @@ void onOpen(client *c, websocketpp::connection_hdl hdl)
         {"action", "subscribe"},
         {"symbol", "ETH-PERPETUAL"}};
     c->send(hdl, subscribeMessage.dump(), websocketpp::frame::opcode::text);
+
+    // And to its order book, kept locally from snapshot + deltas
+    subscribeBooks(c, hdl, {bookSymbol});
 }
 
 void onClose(client *c, websocketpp::connection_hdl hdl)
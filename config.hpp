@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+inline std::string trim(const std::string &str)
+{
+    size_t first = str.find_first_not_of(" \t\r\n");
+    size_t last = str.find_last_not_of(" \t\r\n");
+    return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
+}
+
+// Settings from the .env file. The file is read and parsed once; afterwards
+// the object is immutable, so lookups are safe from any thread.
+class EnvConfig
+{
+public:
+    explicit EnvConfig(const std::string &path)
+    {
+        std::ifstream envFile(path);
+        if (!envFile.is_open())
+        {
+            std::cerr << "Error: Could not open " << path << " file.\n";
+            return;
+        }
+
+        std::string line;
+        while (std::getline(envFile, line))
+        {
+            size_t pos = line.find('=');
+            if (pos != std::string::npos)
+            {
+                std::string key = trim(line.substr(0, pos));
+                std::string value = trim(line.substr(pos + 1)); // Trim whitespace and carriage return
+                if (!key.empty() && key[0] != '#')
+                {
+                    values.emplace(key, value);
+                }
+            }
+        }
+    }
+
+    // Returns the value for key, or fallback if the key is missing or empty
+    const std::string &get(const std::string &key, const std::string &fallback = empty()) const
+    {
+        auto it = values.find(key);
+        return it == values.end() || it->second.empty() ? fallback : it->second;
+    }
+
+    double getDouble(const std::string &key, double fallback) const
+    {
+        const std::string &value = get(key);
+        return value.empty() ? fallback : std::strtod(value.c_str(), nullptr);
+    }
+
+    long long getInt(const std::string &key, long long fallback) const
+    {
+        const std::string &value = get(key);
+        return value.empty() ? fallback : std::strtoll(value.c_str(), nullptr, 10);
+    }
+
+private:
+    std::unordered_map<std::string, std::string> values;
+
+    static const std::string &empty()
+    {
+        static const std::string value;
+        return value;
+    }
+};
+
+// Process-wide configuration loaded on first use from the file named by the
+// ENV_FILE environment variable, ./.env by default (so several servers can
+// run from one directory with different settings)
+inline const EnvConfig &envConfig()
+{
+    static const EnvConfig config(std::getenv("ENV_FILE") ? std::getenv("ENV_FILE") : ".env");
+    return config;
+}
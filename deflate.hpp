@@ -0,0 +1,147 @@
+#pragma once
+
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include "config.hpp"
+
+// permessage-deflate (RFC 7692) for outgoing messages. The server frames and
+// compresses market data itself so that one compressed frame can be shared by
+// every client with the same parameters; websocketpp only negotiates the
+// extension and inflates what clients send.
+
+// zlib cannot produce raw deflate streams with an 8-bit window; clients that
+// insist on one get uncompressed messages
+constexpr int kMinDeflateWindowBits = 9;
+constexpr int kMaxDeflateWindowBits = 15;
+
+// The first permessage-deflate offer in a Sec-WebSocket-Extensions header
+struct DeflateOffer
+{
+    bool offered = false;
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    bool serverWindowRequested = false; // must be echoed in the response
+    int serverMaxWindowBits = kMaxDeflateWindowBits;
+};
+
+inline DeflateOffer parseDeflateOffer(const std::string &header)
+{
+    DeflateOffer offer;
+    std::stringstream extensions(header);
+    std::string extension;
+    while (std::getline(extensions, extension, ','))
+    {
+        std::stringstream params(extension);
+        std::string param;
+        std::getline(params, param, ';');
+        if (trim(param) != "permessage-deflate")
+        {
+            continue;
+        }
+        offer.offered = true;
+        while (std::getline(params, param, ';'))
+        {
+            param = trim(param);
+            size_t equals = param.find('=');
+            std::string key = trim(param.substr(0, equals));
+            std::string value = equals == std::string::npos ? "" : trim(param.substr(equals + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+            {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (key == "server_no_context_takeover")
+            {
+                offer.serverNoContextTakeover = true;
+            }
+            else if (key == "client_no_context_takeover")
+            {
+                offer.clientNoContextTakeover = true;
+            }
+            else if (key == "server_max_window_bits" && !value.empty() && std::isdigit(static_cast<unsigned char>(value[0])))
+            {
+                offer.serverWindowRequested = true;
+                offer.serverMaxWindowBits = std::min(std::stoi(value), kMaxDeflateWindowBits);
+            }
+        }
+        return offer;
+    }
+    return offer;
+}
+
+// Response accepting `offer`. Without context takeover the server resets its
+// compressor after every message, which is what lets clients share frames.
+inline std::string deflateResponse(const DeflateOffer &offer, bool contextTakeover)
+{
+    std::string response = "permessage-deflate";
+    if (!contextTakeover)
+    {
+        response += "; server_no_context_takeover";
+    }
+    if (offer.serverWindowRequested)
+    {
+        response += "; server_max_window_bits=" + std::to_string(offer.serverMaxWindowBits);
+    }
+    if (offer.clientNoContextTakeover)
+    {
+        response += "; client_no_context_takeover";
+    }
+    return response;
+}
+
+// One server-side compression context. With context takeover the window
+// carries over between messages (better ratio, one context per client);
+// without it every message is compressed independently.
+class MessageDeflater
+{
+public:
+    MessageDeflater(int level, int windowBits, bool contextTakeover) : contextTakeover(contextTakeover)
+    {
+        stream.zalloc = Z_NULL;
+        stream.zfree = Z_NULL;
+        stream.opaque = Z_NULL;
+        if (deflateInit2(&stream, level, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            throw std::runtime_error("deflateInit2 failed");
+        }
+    }
+
+    ~MessageDeflater()
+    {
+        deflateEnd(&stream);
+    }
+
+    MessageDeflater(const MessageDeflater &) = delete;
+    MessageDeflater &operator=(const MessageDeflater &) = delete;
+
+    // Appends the compressed message to `out`, without the 00 00 ff ff tail
+    // that the receiver adds back before inflating
+    void compress(const char *data, size_t size, std::string &out)
+    {
+        size_t begin = out.size();
+        stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        stream.avail_in = static_cast<uInt>(size);
+        size_t written = begin;
+        do
+        {
+            out.resize(written + deflateBound(&stream, stream.avail_in) + 16);
+            stream.next_out = reinterpret_cast<Bytef *>(&out[written]);
+            stream.avail_out = static_cast<uInt>(out.size() - written);
+            deflate(&stream, Z_SYNC_FLUSH);
+            written = out.size() - stream.avail_out;
+        } while (stream.avail_out == 0);
+        out.resize(written >= begin + 4 ? written - 4 : begin);
+        if (!contextTakeover)
+        {
+            deflateReset(&stream);
+        }
+    }
+
+private:
+    z_stream stream{};
+    bool contextTakeover;
+};
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "quote_engine.hpp"
+#include "risk.hpp"
+
+// Hashed timing wheel. Scheduling is a push into the slot of the deadline's
+// tick; advancing visits only the slots of the ticks that passed. A timer
+// further away than one revolution stays in its slot and is skipped until its
+// tick comes round, so schedule and expiry are both O(1) per timer.
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(std::chrono::microseconds resolution = std::chrono::milliseconds(1), size_t slots = 4096)
+        : resolution(resolution), mask(roundUp(slots) - 1), wheel(mask + 1), origin(Clock::now())
+    {
+    }
+
+    // Fires `id` at the first advance() at or after `deadline`
+    void schedule(uint64_t id, Clock::time_point deadline)
+    {
+        // A timer re-armed from inside advance() fires on a later tick, never in the same pass
+        uint64_t tick = std::max(tickOf(deadline), current + (advancing ? 1 : 0));
+        wheel[tick & mask].push_back({id, tick});
+        ++pending;
+    }
+
+    // Fires every timer due by `now`, in tick order
+    template <typename Callback>
+    void advance(Clock::time_point now, Callback &&fire)
+    {
+        uint64_t target = tickOf(now);
+        advancing = true;
+        for (; current <= target; ++current)
+        {
+            std::vector<Timer> &slot = wheel[current & mask];
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].tick <= current)
+                {
+                    uint64_t id = slot[i].id;
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                    --pending;
+                    fire(id); // may schedule into this slot again
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+            if (pending == 0)
+            {
+                current = target + 1;
+                break;
+            }
+        }
+        advancing = false;
+    }
+
+    size_t size() const
+    {
+        return pending;
+    }
+
+private:
+    struct Timer
+    {
+        uint64_t id;
+        uint64_t tick;
+    };
+
+    std::chrono::microseconds resolution;
+    size_t mask;
+    std::vector<std::vector<Timer>> wheel;
+    Clock::time_point origin;
+    uint64_t current = 0;
+    size_t pending = 0;
+    bool advancing = false;
+
+    static size_t roundUp(size_t value)
+    {
+        size_t power = 1;
+        while (power < value)
+        {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    uint64_t tickOf(Clock::time_point time) const
+    {
+        return time <= origin ? 0 : static_cast<uint64_t>((time - origin) / resolution);
+    }
+};
+
+enum class AlgoType : uint8_t
+{
+    Twap,    // equal slices over the horizon
+    Vwap,    // slices follow a volume curve over the horizon
+    Iceberg, // shows displayAmount at a time at the limit price
+    Peg      // rests at the own-side touch (minus pegOffset), following it
+};
+
+inline const char *algoTypeName(AlgoType type)
+{
+    switch (type)
+    {
+    case AlgoType::Twap:
+        return "TWAP";
+    case AlgoType::Vwap:
+        return "VWAP";
+    case AlgoType::Iceberg:
+        return "Iceberg";
+    case AlgoType::Peg:
+        return "Peg";
+    }
+    return "unknown";
+}
+
+// A parent order: what to trade and how
+struct AlgoParams
+{
+    AlgoType type = AlgoType::Twap;
+    std::string instrument;
+    Side side = Side::Buy;
+    double amount = 0;
+    double limitPrice = 0;                     // never buy above / sell below (0 = no limit)
+    std::chrono::milliseconds duration{60000}; // TWAP/VWAP horizon
+    std::chrono::milliseconds interval{1000};  // time between child decisions
+    std::vector<double> volumeCurve;           // VWAP: relative volume of equal buckets across the horizon
+    double displayAmount = 0;                  // iceberg/peg: largest child shown (0 = everything left)
+    double pegOffset = 0;                      // peg: distance behind the touch
+    double maxBookFraction = 0.25;             // a child takes at most this share of the depth it trades against
+    double tickSize = 0;                       // price rounding (0 = none)
+    double minAmount = 0;                      // contract size; children are multiples of it (0 = none)
+};
+
+// The top levels of the local book (QuoteLevel is a plain price/size pair), best first
+struct MarketDepth
+{
+    std::vector<QuoteLevel> bids;
+    std::vector<QuoteLevel> asks;
+};
+
+// Where the scheduler gets its data and sends its child orders. A parent's
+// children are identified by the parent's id: state() reports the children
+// currently resting and the parent's total filled amount, send() places,
+// edits and cancels them.
+struct ExecutionGateway
+{
+    std::function<bool(const std::string &instrument, MarketDepth &depth)> depth;
+    std::function<double(uint64_t parent, std::vector<LiveQuote> &live)> state;
+    std::function<void(uint64_t parent, const std::vector<QuoteAction> &actions)> send;
+};
+
+struct AlgoStatus
+{
+    uint64_t id;
+    AlgoParams params;
+    double filled;
+    uint64_t decisions; // timer firings
+    uint64_t requests;  // child requests sent
+    bool done;
+};
+
+// Runs parent orders on one thread. Each parent has a single timer in the
+// wheel; when it fires, the parent's child is re-planned from the book and the
+// fills so far, the change is sent through the gateway, and the timer is
+// re-armed. Call poll() from the owning thread.
+class ExecutionScheduler
+{
+public:
+    using Clock = TimerWheel::Clock;
+
+    explicit ExecutionScheduler(ExecutionGateway gateway, std::chrono::microseconds resolution = std::chrono::milliseconds(1))
+        : gateway(std::move(gateway)), timers(resolution)
+    {
+    }
+
+    // Starts a parent order; its first child is planned on the next poll()
+    uint64_t submit(const AlgoParams &params)
+    {
+        uint64_t id = nextId++;
+        Parent &parent = parents[id];
+        parent.params = params;
+        parent.start = Clock::now();
+        parent.end = parent.start + params.duration;
+        timers.schedule(id, parent.start);
+        ++active;
+        return id;
+    }
+
+    // Stops a parent order and pulls its resting child
+    void cancel(uint64_t id)
+    {
+        auto it = parents.find(id);
+        if (it != parents.end() && !it->second.done)
+        {
+            finish(id, it->second);
+        }
+    }
+
+    // Fires every parent whose timer is due
+    void poll(Clock::time_point now = Clock::now())
+    {
+        timers.advance(now, [this, now](uint64_t id)
+                       { decide(id, now); });
+    }
+
+    // Polls until every parent order is done
+    void runUntilDone()
+    {
+        while (active > 0)
+        {
+            poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    size_t activeCount() const
+    {
+        return active;
+    }
+
+    std::vector<AlgoStatus> status() const
+    {
+        std::vector<AlgoStatus> result;
+        for (const auto &[id, parent] : parents)
+        {
+            result.push_back({id, parent.params, parent.filled, parent.decisions, parent.requests, parent.done});
+        }
+        std::sort(result.begin(), result.end(), [](const AlgoStatus &a, const AlgoStatus &b)
+                  { return a.id < b.id; });
+        return result;
+    }
+
+private:
+    struct Parent
+    {
+        AlgoParams params;
+        Clock::time_point start;
+        Clock::time_point end;
+        double filled = 0;
+        uint64_t decisions = 0;
+        uint64_t requests = 0;
+        bool done = false;
+    };
+
+    ExecutionGateway gateway;
+    TimerWheel timers;
+    std::unordered_map<uint64_t, Parent> parents;
+    uint64_t nextId = 1;
+    size_t active = 0;
+
+    void finish(uint64_t id, Parent &parent)
+    {
+        std::vector<LiveQuote> live;
+        parent.filled = gateway.state(id, live);
+        std::vector<QuoteAction> actions = diffQuotes(parent.params.instrument, QuoteLadder(), live);
+        if (!actions.empty())
+        {
+            gateway.send(id, actions);
+            parent.requests += actions.size();
+        }
+        parent.done = true;
+        --active;
+    }
+
+    void decide(uint64_t id, Clock::time_point now)
+    {
+        auto it = parents.find(id);
+        if (it == parents.end() || it->second.done)
+        {
+            return; // cancelled while its timer was pending
+        }
+        Parent &parent = it->second;
+        const AlgoParams &params = parent.params;
+        ++parent.decisions;
+
+        std::vector<LiveQuote> live;
+        parent.filled = gateway.state(id, live);
+        double remaining = params.amount - parent.filled;
+        if (remaining < std::max(params.minAmount, 1e-12) * 0.5)
+        {
+            finish(id, parent);
+            return;
+        }
+
+        QuoteLadder target;
+        MarketDepth depth;
+        if (gateway.depth(params.instrument, depth))
+        {
+            QuoteLevel child;
+            if (planChild(parent, now, depth, live, remaining, child))
+            {
+                (params.side == Side::Buy ? target.bids : target.asks).push_back(child);
+            }
+        }
+        else
+        {
+            // No book: keep what is resting rather than trade blind
+            for (const LiveQuote &quote : live)
+            {
+                (quote.side == Side::Buy ? target.bids : target.asks).push_back({quote.price, quote.amount});
+            }
+        }
+
+        std::vector<QuoteAction> actions = diffQuotes(params.instrument, target, live);
+        if (!actions.empty())
+        {
+            gateway.send(id, actions);
+            parent.requests += actions.size();
+        }
+        timers.schedule(id, now + params.interval);
+    }
+
+    // Share of a TWAP/VWAP parent that should be done by `time`
+    static double scheduleFraction(const Parent &parent, Clock::time_point time)
+    {
+        const AlgoParams &params = parent.params;
+        double elapsed = std::chrono::duration<double>(time - parent.start).count();
+        double horizon = std::chrono::duration<double>(params.duration).count();
+        double fraction = horizon > 0 ? std::min(1.0, std::max(0.0, elapsed / horizon)) : 1.0;
+        if (params.type != AlgoType::Vwap || params.volumeCurve.empty())
+        {
+            return fraction;
+        }
+        // Cumulative volume curve, linear within each bucket
+        const std::vector<double> &curve = params.volumeCurve;
+        double total = 0;
+        for (double weight : curve)
+        {
+            total += weight;
+        }
+        if (!(total > 0))
+        {
+            return fraction;
+        }
+        double position = fraction * curve.size();
+        size_t bucket = std::min(curve.size() - 1, static_cast<size_t>(position));
+        double done = 0;
+        for (size_t i = 0; i < bucket; ++i)
+        {
+            done += curve[i];
+        }
+        return std::min(1.0, (done + curve[bucket] * (position - bucket)) / total);
+    }
+
+    double roundAmount(const AlgoParams &params, double amount) const
+    {
+        return params.minAmount > 0 ? std::floor(amount / params.minAmount + 1e-9) * params.minAmount : amount;
+    }
+
+    // Rounds a price to the tick, away from the market (down for buys, up for sells)
+    static double roundPassive(const AlgoParams &params, double price)
+    {
+        if (!(params.tickSize > 0))
+        {
+            return price;
+        }
+        double ticks = price / params.tickSize;
+        return (params.side == Side::Buy ? std::floor(ticks + 1e-9) : std::ceil(ticks - 1e-9)) * params.tickSize;
+    }
+
+    static double clampToLimit(const AlgoParams &params, double price)
+    {
+        if (params.limitPrice > 0)
+        {
+            return params.side == Side::Buy ? std::min(price, params.limitPrice) : std::max(price, params.limitPrice);
+        }
+        return price;
+    }
+
+    // Plans the one child a parent should have resting now; false means none
+    bool planChild(const Parent &parent, Clock::time_point now, const MarketDepth &depth, const std::vector<LiveQuote> &live,
+                   double remaining, QuoteLevel &child) const
+    {
+        const AlgoParams &params = parent.params;
+        bool buy = params.side == Side::Buy;
+        const std::vector<QuoteLevel> &own = buy ? depth.bids : depth.asks;
+        const std::vector<QuoteLevel> &opposite = buy ? depth.asks : depth.bids;
+        const LiveQuote *resting = live.empty() ? nullptr : &live.front();
+
+        switch (params.type)
+        {
+        case AlgoType::Twap:
+        case AlgoType::Vwap:
+        {
+            // Rest at the touch for what the schedule wants by the next decision;
+            // cross the spread once more than a slice behind, or past the horizon.
+            double due = params.amount * scheduleFraction(parent, now + params.interval) - parent.filled;
+            double dueNow = params.amount * scheduleFraction(parent, now) - parent.filled;
+            double slice = params.amount * (scheduleFraction(parent, now + params.interval) - scheduleFraction(parent, now));
+            bool aggressive = now >= parent.end || dueNow > slice + 1e-12;
+            if (now >= parent.end)
+            {
+                due = remaining;
+            }
+            const std::vector<QuoteLevel> &side = aggressive ? opposite : own;
+            if (side.empty())
+            {
+                return false;
+            }
+            double price = clampToLimit(params, side.front().price);
+            // Size from the depth the child trades against: everything on the
+            // far side up to our price when crossing, the touch when resting
+            double available = 0;
+            for (const QuoteLevel &level : aggressive ? opposite : own)
+            {
+                if (aggressive ? (buy ? level.price <= price : level.price >= price) : level.price == own.front().price)
+                {
+                    available += level.amount;
+                }
+            }
+            double size = std::min(due, remaining);
+            if (available > 0 && params.maxBookFraction > 0)
+            {
+                size = std::min(size, std::max(params.minAmount, params.maxBookFraction * available));
+            }
+            child = {roundPassive(params, price), roundAmount(params, size)};
+            return child.amount > 0;
+        }
+        case AlgoType::Iceberg:
+        {
+            // One visible slice at a time; a partly filled slice is left to finish
+            if (resting != nullptr)
+            {
+                child = {resting->price, resting->amount};
+                return true;
+            }
+            double price = params.limitPrice > 0 ? params.limitPrice : (own.empty() ? 0 : own.front().price);
+            double show = params.displayAmount > 0 ? std::min(params.displayAmount, remaining) : remaining;
+            child = {roundPassive(params, price), roundAmount(params, show)};
+            return child.price > 0 && child.amount > 0;
+        }
+        case AlgoType::Peg:
+        {
+            // The touch, not counting our own child when it is the whole best level
+            size_t level = 0;
+            if (resting != nullptr && !own.empty() && own.front().price == resting->price && own.front().amount <= resting->amount + 1e-12)
+            {
+                level = 1;
+            }
+            if (own.size() <= level)
+            {
+                return false;
+            }
+            double price = own[level].price + (buy ? -params.pegOffset : params.pegOffset);
+            price = roundPassive(params, clampToLimit(params, price));
+            // Follow the touch; a partly filled child keeps its size
+            double show = params.displayAmount > 0 ? std::min(params.displayAmount, remaining) : remaining;
+            child = {price, resting != nullptr ? resting->amount : roundAmount(params, show)};
+            return child.price > 0 && child.amount > 0;
+        }
+        }
+        return false;
+    }
+};
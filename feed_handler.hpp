@@ -0,0 +1,936 @@
+#pragma once
+
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/client.hpp>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "json_scanner.hpp"
+#include "latency.hpp"
+
+enum class UpdateKind : uint8_t
+{
+    Book,   // top kMaxDepth levels of both sides (full snapshot of those levels)
+    Ticker, // best bid/ask, mark, index and last price
+    Trade   // one public trade
+};
+
+constexpr int kMaxDepth = 20;
+
+struct PriceLevel
+{
+    double price;
+    double amount;
+};
+
+// One normalized market data event, independent of the source. Fixed size
+// and trivially copyable, so it moves between threads through a ring buffer
+// without allocating.
+struct MarketUpdate
+{
+    UpdateKind kind;
+    uint8_t bidCount;
+    uint8_t askCount;
+    char direction; // trades: 'b' (buyer aggressed) or 's'
+    char symbol[44];
+    uint64_t sequence;    // exchange change_id (book) or trade_seq (trades)
+    int64_t exchangeMs;   // exchange timestamp
+    int64_t receiveNs;    // read off the upstream socket (TraceStage::SourceReceive)
+    int64_t normalizedNs; // normalized into this struct (TraceStage::BookUpdate)
+    double price;         // trades
+    double amount;        // trades
+    double markPrice;     // ticker
+    double indexPrice;    // ticker
+    double lastPrice;     // ticker
+    PriceLevel bids[kMaxDepth];
+    PriceLevel asks[kMaxDepth];
+
+    void setSymbol(std::string_view name)
+    {
+        size_t length = std::min(name.size(), sizeof(symbol) - 1);
+        std::memcpy(symbol, name.data(), length);
+        symbol[length] = '\0';
+    }
+
+    std::string_view getSymbol() const
+    {
+        return std::string_view(symbol);
+    }
+};
+
+// A stream of normalized market data for a changing set of symbols.
+// Updates are delivered on the source's own (single) thread; subscribe() and
+// unsubscribe() may be called from any thread.
+class MarketDataSource
+{
+public:
+    using Handler = std::function<void(const MarketUpdate &)>;
+
+    virtual ~MarketDataSource() = default;
+    virtual void start(Handler handler) = 0;
+    virtual void stop() = 0;
+    virtual void subscribe(const std::vector<std::string> &symbols) = 0;
+    virtual void unsubscribe(const std::vector<std::string> &symbols) = 0;
+    virtual const char *name() const = 0;
+};
+
+// Turns Deribit subscription notifications (book.*.none.20.*, ticker.*,
+// trades.*) into MarketUpdates. Shared by the live feed and the replay of a
+// recorded one.
+class DeribitNormalizer
+{
+public:
+    static std::vector<std::string> channelsFor(const std::string &symbol)
+    {
+        return {"book." + symbol + ".none.20.100ms", "ticker." + symbol + ".100ms", "trades." + symbol + ".100ms"};
+    }
+
+    // Calls emit(const MarketUpdate &) for every update in `raw`; returns how
+    // many. Uses the scanner and falls back to the full parser only for
+    // messages the scanner cannot handle.
+    template <typename Emit>
+    size_t normalize(const std::string &raw, int64_t receiveNs, Emit &&emit)
+    {
+        size_t count = 0;
+        if (normalizeFast(raw, receiveNs, emit, count) || count != 0)
+        {
+            return count;
+        }
+        return normalizeDom(raw, receiveNs, emit);
+    }
+
+    // Single pass over the text with JsonScanner: no DOM, no allocation.
+    // Returns false if the message could not be scanned; `count` says how
+    // many updates were emitted before that happened.
+    template <typename Emit>
+    bool normalizeFast(std::string_view raw, int64_t receiveNs, Emit &&emit, size_t &count)
+    {
+        count = 0;
+        JsonScanner scanner(raw);
+        bool subscription = false;
+        bool parsed = false;
+        std::string_view channel;
+        const char *data = nullptr;
+        scanner.forEachMember([&](std::string_view key)
+                              {
+                                  if (key == "method")
+                                  {
+                                      std::string_view method;
+                                      scanner.readString(method);
+                                      subscription = method == "subscription";
+                                  }
+                                  else if (key == "params")
+                                  {
+                                      scanner.forEachMember([&](std::string_view key)
+                                                            {
+                                                                if (key == "channel")
+                                                                {
+                                                                    scanner.readString(channel);
+                                                                }
+                                                                else if (key == "data" && subscription && !channel.empty())
+                                                                {
+                                                                    // Usual field order: read the data in place
+                                                                    parsed = true;
+                                                                    scanData(scanner, channel, receiveNs, emit, count);
+                                                                }
+                                                                else if (key == "data")
+                                                                {
+                                                                    data = scanner.position();
+                                                                    scanner.skipValue();
+                                                                }
+                                                                else
+                                                                {
+                                                                    scanner.skipValue();
+                                                                }
+                                                            });
+                                  }
+                                  else
+                                  {
+                                      scanner.skipValue();
+                                  } });
+        if (!scanner.ok())
+        {
+            return false;
+        }
+        if (!parsed && subscription && data != nullptr)
+        {
+            scanner.seek(data);
+            scanData(scanner, channel, receiveNs, emit, count);
+        }
+        return scanner.ok();
+    }
+
+    // Reference implementation on nlohmann::json. Also the fallback for
+    // messages the scanner rejected, so every field is type-checked before
+    // it is read: a malformed message yields no update rather than an
+    // exception on the feed thread.
+    template <typename Emit>
+    size_t normalizeDom(const std::string &raw, int64_t receiveNs, Emit &&emit)
+    {
+        auto message = nlohmann::json::parse(raw, nullptr, false);
+        if (!message.is_object() || text(message, "method") != "subscription")
+        {
+            return 0;
+        }
+        auto params = message.find("params");
+        if (params == message.end() || !params->is_object())
+        {
+            return 0;
+        }
+        std::string channel = text(*params, "channel");
+        auto dataIt = params->find("data");
+        if (dataIt == params->end())
+        {
+            return 0;
+        }
+        const nlohmann::json &data = *dataIt;
+
+        std::memset(&update, 0, offsetof(MarketUpdate, bids));
+        update.receiveNs = receiveNs;
+        if (channel.compare(0, 5, "book.") == 0 && data.is_object())
+        {
+            update.kind = UpdateKind::Book;
+            update.setSymbol(text(data, "instrument_name"));
+            update.sequence = integer<uint64_t>(data, "change_id");
+            update.exchangeMs = integer<int64_t>(data, "timestamp");
+            update.bidCount = copyLevels(data, "bids", update.bids);
+            update.askCount = copyLevels(data, "asks", update.asks);
+            update.normalizedNs = nowNanos();
+            emit(static_cast<const MarketUpdate &>(update));
+            return 1;
+        }
+        if (channel.compare(0, 7, "ticker.") == 0 && data.is_object())
+        {
+            update.kind = UpdateKind::Ticker;
+            update.setSymbol(text(data, "instrument_name"));
+            update.exchangeMs = integer<int64_t>(data, "timestamp");
+            update.bids[0] = {number(data, "best_bid_price"), number(data, "best_bid_amount")};
+            update.asks[0] = {number(data, "best_ask_price"), number(data, "best_ask_amount")};
+            update.bidCount = update.bids[0].price > 0;
+            update.askCount = update.asks[0].price > 0;
+            update.markPrice = number(data, "mark_price");
+            update.indexPrice = number(data, "index_price");
+            update.lastPrice = number(data, "last_price");
+            update.normalizedNs = nowNanos();
+            emit(static_cast<const MarketUpdate &>(update));
+            return 1;
+        }
+        if (channel.compare(0, 7, "trades.") == 0 && data.is_array())
+        {
+            size_t count = 0;
+            for (const nlohmann::json &trade : data)
+            {
+                if (!trade.is_object())
+                {
+                    continue;
+                }
+                update.kind = UpdateKind::Trade;
+                update.setSymbol(text(trade, "instrument_name"));
+                update.sequence = integer<uint64_t>(trade, "trade_seq");
+                update.exchangeMs = integer<int64_t>(trade, "timestamp");
+                update.price = number(trade, "price");
+                update.amount = number(trade, "amount");
+                update.direction = text(trade, "direction") == "sell" ? 's' : 'b';
+                update.normalizedNs = nowNanos();
+                emit(static_cast<const MarketUpdate &>(update));
+                ++count;
+            }
+            return count;
+        }
+        return 0;
+    }
+
+private:
+    MarketUpdate update{};
+
+    template <typename Emit>
+    void scanData(JsonScanner &scanner, std::string_view channel, int64_t receiveNs, Emit &emit, size_t &count)
+    {
+        std::memset(&update, 0, offsetof(MarketUpdate, bids));
+        update.receiveNs = receiveNs;
+        if (channel.compare(0, 5, "book.") == 0)
+        {
+            update.kind = UpdateKind::Book;
+            scanner.forEachMember([&](std::string_view key)
+                                  {
+                                      if (key == "instrument_name")
+                                      {
+                                          std::string_view name;
+                                          scanner.readString(name);
+                                          update.setSymbol(name);
+                                      }
+                                      else if (key == "change_id")
+                                      {
+                                          update.sequence = scanner.readUnsigned();
+                                      }
+                                      else if (key == "timestamp")
+                                      {
+                                          update.exchangeMs = static_cast<int64_t>(scanner.readUnsigned());
+                                      }
+                                      else if (key == "bids")
+                                      {
+                                          update.bidCount = scanLevels(scanner, update.bids);
+                                      }
+                                      else if (key == "asks")
+                                      {
+                                          update.askCount = scanLevels(scanner, update.asks);
+                                      }
+                                      else
+                                      {
+                                          scanner.skipValue();
+                                      } });
+            if (scanner.ok())
+            {
+                update.normalizedNs = nowNanos();
+                emit(static_cast<const MarketUpdate &>(update));
+                count = 1;
+            }
+        }
+        else if (channel.compare(0, 7, "ticker.") == 0)
+        {
+            update.kind = UpdateKind::Ticker;
+            // Level 0 is outside the memset; a field the ticker omits must not
+            // keep the previous book's value
+            update.bids[0] = PriceLevel{};
+            update.asks[0] = PriceLevel{};
+            scanner.forEachMember([&](std::string_view key)
+                                  {
+                                      if (key == "instrument_name")
+                                      {
+                                          std::string_view name;
+                                          scanner.readString(name);
+                                          update.setSymbol(name);
+                                      }
+                                      else if (key == "timestamp")
+                                      {
+                                          update.exchangeMs = static_cast<int64_t>(scanner.readUnsigned());
+                                      }
+                                      else if (key == "best_bid_price")
+                                      {
+                                          update.bids[0].price = scanner.readDouble();
+                                      }
+                                      else if (key == "best_bid_amount")
+                                      {
+                                          update.bids[0].amount = scanner.readDouble();
+                                      }
+                                      else if (key == "best_ask_price")
+                                      {
+                                          update.asks[0].price = scanner.readDouble();
+                                      }
+                                      else if (key == "best_ask_amount")
+                                      {
+                                          update.asks[0].amount = scanner.readDouble();
+                                      }
+                                      else if (key == "mark_price")
+                                      {
+                                          update.markPrice = scanner.readDouble();
+                                      }
+                                      else if (key == "index_price")
+                                      {
+                                          update.indexPrice = scanner.readDouble();
+                                      }
+                                      else if (key == "last_price")
+                                      {
+                                          update.lastPrice = scanner.readDouble();
+                                      }
+                                      else
+                                      {
+                                          scanner.skipValue();
+                                      } });
+            if (scanner.ok())
+            {
+                update.bidCount = update.bids[0].price > 0;
+                update.askCount = update.asks[0].price > 0;
+                update.normalizedNs = nowNanos();
+                emit(static_cast<const MarketUpdate &>(update));
+                count = 1;
+            }
+        }
+        else if (channel.compare(0, 7, "trades.") == 0 && scanner.peek() == '[')
+        {
+            update.kind = UpdateKind::Trade;
+            scanner.forEachElement([&]()
+                                   {
+                                       update.symbol[0] = '\0';
+                                       update.sequence = 0;
+                                       update.exchangeMs = 0;
+                                       update.price = update.amount = 0;
+                                       update.direction = 'b';
+                                       scanner.forEachMember([&](std::string_view key)
+                                                             {
+                                                                 if (key == "instrument_name")
+                                                                 {
+                                                                     std::string_view name;
+                                                                     scanner.readString(name);
+                                                                     update.setSymbol(name);
+                                                                 }
+                                                                 else if (key == "trade_seq")
+                                                                 {
+                                                                     update.sequence = scanner.readUnsigned();
+                                                                 }
+                                                                 else if (key == "timestamp")
+                                                                 {
+                                                                     update.exchangeMs = static_cast<int64_t>(scanner.readUnsigned());
+                                                                 }
+                                                                 else if (key == "price")
+                                                                 {
+                                                                     update.price = scanner.readDouble();
+                                                                 }
+                                                                 else if (key == "amount")
+                                                                 {
+                                                                     update.amount = scanner.readDouble();
+                                                                 }
+                                                                 else if (key == "direction")
+                                                                 {
+                                                                     std::string_view direction;
+                                                                     scanner.readString(direction);
+                                                                     update.direction = direction == "sell" ? 's' : 'b';
+                                                                 }
+                                                                 else
+                                                                 {
+                                                                     scanner.skipValue();
+                                                                 } });
+                                       if (scanner.ok())
+                                       {
+                                           update.normalizedNs = nowNanos();
+                                           emit(static_cast<const MarketUpdate &>(update));
+                                           count++;
+                                       } });
+        }
+        else
+        {
+            scanner.skipValue();
+        }
+    }
+
+    // [[price, amount], ...] or [["new", price, amount], ...]; levels past
+    // kMaxDepth are skipped
+    static uint8_t scanLevels(JsonScanner &scanner, PriceLevel *levels)
+    {
+        uint8_t count = 0;
+        scanner.forEachElement([&]()
+                               {
+                                   if (count == kMaxDepth)
+                                   {
+                                       scanner.skipValue();
+                                       return;
+                                   }
+                                   scanner.consume('[');
+                                   if (scanner.peek() == '"')
+                                   {
+                                       scanner.skipValue();
+                                       scanner.consume(',');
+                                   }
+                                   double price = scanner.readDouble();
+                                   scanner.consume(',');
+                                   double amount = scanner.readDouble();
+                                   scanner.consume(']');
+                                   levels[count++] = {price, amount}; });
+        return count;
+    }
+
+    static double number(const nlohmann::json &object, const char *key)
+    {
+        auto it = object.find(key);
+        return it != object.end() && it->is_number() ? it->get<double>() : 0.0;
+    }
+
+    static std::string text(const nlohmann::json &object, const char *key)
+    {
+        auto it = object.find(key);
+        return it != object.end() && it->is_string() ? it->get<std::string>() : std::string();
+    }
+
+    template <typename Integer>
+    static Integer integer(const nlohmann::json &object, const char *key)
+    {
+        auto it = object.find(key);
+        return it != object.end() && it->is_number_integer() ? it->get<Integer>() : 0;
+    }
+
+    static uint8_t copyLevels(const nlohmann::json &data, const char *key, PriceLevel *levels)
+    {
+        auto it = data.find(key);
+        if (it == data.end() || !it->is_array())
+        {
+            return 0;
+        }
+        uint8_t count = 0;
+        for (const nlohmann::json &level : *it)
+        {
+            if (count == kMaxDepth)
+            {
+                break;
+            }
+            // Grouped books send [price, amount]; raw ones ["new"|"change"|"delete", price, amount]
+            size_t offset = level.is_array() && level.size() == 3 ? 1 : 0;
+            if (!level.is_array() || level.size() < offset + 2 || !level[offset].is_number() || !level[offset + 1].is_number())
+            {
+                continue;
+            }
+            levels[count++] = {level[offset].get<double>(), level[offset + 1].get<double>()};
+        }
+        return count;
+    }
+};
+
+typedef websocketpp::client<websocketpp::config::asio_tls_client> tls_client;
+
+// Live Deribit feed over one TLS WebSocket. Reconnects with backoff and
+// re-subscribes everything on reconnect. Every raw message can be recorded
+// (receive time + payload per line) for ReplayFeed.
+class DeribitFeed : public MarketDataSource
+{
+public:
+    DeribitFeed(std::string url, std::string recordPath = "") : url(std::move(url))
+    {
+        if (!recordPath.empty())
+        {
+            record.open(recordPath, std::ios::app);
+            if (!record)
+            {
+                std::cerr << "Feed: cannot open record file " << recordPath << std::endl;
+            }
+        }
+    }
+
+    ~DeribitFeed() override
+    {
+        stop();
+    }
+
+    void start(Handler handler) override
+    {
+        this->handler = std::move(handler);
+        client.clear_access_channels(websocketpp::log::alevel::all);
+        client.clear_error_channels(websocketpp::log::elevel::all);
+        client.init_asio();
+        client.start_perpetual();
+        client.set_tls_init_handler([](connection_hdl)
+                                    {
+                                        auto context = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12_client);
+                                        context->set_default_verify_paths();
+                                        context->set_verify_mode(boost::asio::ssl::verify_peer);
+                                        return context; });
+        client.set_open_handler([this](connection_hdl hdl)
+                                { onOpen(hdl); });
+        client.set_message_handler([this](connection_hdl, tls_client::message_ptr message)
+                                   { onMessage(message->get_payload()); });
+        client.set_close_handler([this](connection_hdl)
+                                 { reconnect(); });
+        client.set_fail_handler([this](connection_hdl)
+                                { reconnect(); });
+        connect();
+        thread = std::thread([this]()
+                             { client.run(); });
+    }
+
+    void stop() override
+    {
+        if (!thread.joinable())
+        {
+            return;
+        }
+        stopping = true;
+        client.stop_perpetual();
+        client.get_io_service().post([this]()
+                                     {
+                                         websocketpp::lib::error_code ec;
+                                         if (!connection.expired())
+                                         {
+                                             client.close(connection, websocketpp::close::status::going_away, "", ec);
+                                         }
+                                         client.stop(); });
+        thread.join();
+    }
+
+    void subscribe(const std::vector<std::string> &symbols) override
+    {
+        client.get_io_service().post([this, symbols]()
+                                     { change(symbols, true); });
+    }
+
+    void unsubscribe(const std::vector<std::string> &symbols) override
+    {
+        client.get_io_service().post([this, symbols]()
+                                     { change(symbols, false); });
+    }
+
+    const char *name() const override
+    {
+        return "deribit";
+    }
+
+private:
+    using connection_hdl = websocketpp::connection_hdl;
+
+    std::string url;
+    tls_client client;
+    std::thread thread;
+    Handler handler;
+    DeribitNormalizer normalizer;
+    std::ofstream record;
+    std::atomic<bool> stopping{false};
+
+    // Only touched on the io thread
+    connection_hdl connection;
+    bool open = false;
+    std::set<std::string> symbols;
+    uint64_t requestId = 0;
+    long backoffMs = 0;
+
+    void connect()
+    {
+        websocketpp::lib::error_code ec;
+        tls_client::connection_ptr con = client.get_connection(url, ec);
+        if (ec)
+        {
+            std::cerr << "Feed: connection error: " << ec.message() << std::endl;
+            reconnect();
+            return;
+        }
+        connection = con->get_handle();
+        client.connect(con);
+    }
+
+    void reconnect()
+    {
+        open = false;
+        if (stopping)
+        {
+            return;
+        }
+        backoffMs = std::min<long>(backoffMs == 0 ? 100 : backoffMs * 2, 10000);
+        std::cerr << "Feed: disconnected, reconnecting in " << backoffMs << " ms" << std::endl;
+        client.set_timer(backoffMs, [this](const websocketpp::lib::error_code &ec)
+                         {
+                             if (!ec && !stopping)
+                             {
+                                 connect();
+                             } });
+    }
+
+    void send(const std::string &method, const nlohmann::json &params)
+    {
+        nlohmann::json request = {{"jsonrpc", "2.0"}, {"id", ++requestId}, {"method", method}, {"params", params}};
+        websocketpp::lib::error_code ec;
+        client.send(connection, request.dump(), websocketpp::frame::opcode::text, ec);
+        if (ec)
+        {
+            std::cerr << "Feed: send failed: " << ec.message() << std::endl;
+        }
+    }
+
+    void sendChannels(const std::string &method, const std::vector<std::string> &list)
+    {
+        std::vector<std::string> channels;
+        for (const std::string &symbol : list)
+        {
+            for (std::string &channel : DeribitNormalizer::channelsFor(symbol))
+            {
+                channels.push_back(std::move(channel));
+            }
+        }
+        if (!channels.empty())
+        {
+            send(method, {{"channels", channels}});
+        }
+    }
+
+    void onOpen(connection_hdl)
+    {
+        open = true;
+        backoffMs = 0;
+        std::cout << "Feed: connected to " << url << std::endl;
+        // The exchange drops connections that do not answer its heartbeats
+        send("public/set_heartbeat", {{"interval", 10}});
+        sendChannels("public/subscribe", std::vector<std::string>(symbols.begin(), symbols.end()));
+    }
+
+    void change(const std::vector<std::string> &list, bool add)
+    {
+        std::vector<std::string> changed;
+        for (const std::string &symbol : list)
+        {
+            if (add ? symbols.insert(symbol).second : symbols.erase(symbol) > 0)
+            {
+                changed.push_back(symbol);
+            }
+        }
+        if (open)
+        {
+            sendChannels(add ? "public/subscribe" : "public/unsubscribe", changed);
+        }
+    }
+
+    void onMessage(const std::string &payload)
+    {
+        int64_t receiveNs = nowNanos();
+        if (record.is_open())
+        {
+            record << receiveNs << ' ' << payload << '\n';
+        }
+        if (payload.find("\"heartbeat\"") != std::string::npos && payload.find("test_request") != std::string::npos)
+        {
+            send("public/test", nlohmann::json::object());
+            return;
+        }
+        normalizer.normalize(payload, receiveNs, handler);
+    }
+};
+
+// Replays a feed recorded by DeribitFeed, keeping the recorded gaps between
+// messages (scaled by `speed`; 0 replays as fast as possible) and looping at
+// the end. Only subscribed symbols are delivered.
+class ReplayFeed : public MarketDataSource
+{
+public:
+    ReplayFeed(std::string path, double speed = 1.0) : path(std::move(path)), speed(speed) {}
+
+    ~ReplayFeed() override
+    {
+        stop();
+    }
+
+    void start(Handler handler) override
+    {
+        this->handler = std::move(handler);
+        thread = std::thread([this]()
+                             { run(); });
+    }
+
+    void stop() override
+    {
+        running = false;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void subscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        symbols.insert(list.begin(), list.end());
+    }
+
+    void unsubscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : list)
+        {
+            symbols.erase(symbol);
+        }
+    }
+
+    const char *name() const override
+    {
+        return "replay";
+    }
+
+private:
+    std::string path;
+    double speed;
+    Handler handler;
+    std::thread thread;
+    std::atomic<bool> running{true};
+    std::mutex mutex;
+    std::set<std::string, std::less<>> symbols;
+
+    void run()
+    {
+        DeribitNormalizer normalizer;
+        while (running)
+        {
+            std::ifstream input(path);
+            if (!input)
+            {
+                std::cerr << "Replay: cannot open " << path << std::endl;
+                return;
+            }
+            std::string line;
+            int64_t firstRecordedNs = 0;
+            auto startedAt = std::chrono::steady_clock::now();
+            size_t delivered = 0;
+            while (running && std::getline(input, line))
+            {
+                size_t space = line.find(' ');
+                if (space == std::string::npos)
+                {
+                    continue;
+                }
+                int64_t recordedNs = std::stoll(line.substr(0, space));
+                if (firstRecordedNs == 0)
+                {
+                    firstRecordedNs = recordedNs;
+                }
+                if (speed > 0)
+                {
+                    std::this_thread::sleep_until(startedAt + std::chrono::nanoseconds(static_cast<int64_t>((recordedNs - firstRecordedNs) / speed)));
+                }
+                delivered += normalizer.normalize(line.substr(space + 1), nowNanos(), [this](const MarketUpdate &update)
+                                                  {
+                                                      std::lock_guard<std::mutex> lock(mutex);
+                                                      if (symbols.count(update.getSymbol()))
+                                                      {
+                                                          handler(update);
+                                                      } });
+            }
+            if (delivered == 0)
+            {
+                std::cerr << "Replay: no updates in " << path << std::endl;
+                return;
+            }
+        }
+    }
+};
+
+// Synthetic books for running without the exchange: each subscribed symbol's
+// mid follows a random walk, with a 20-level book every tick, a ticker every
+// 10th tick and random trades.
+class MockFeed : public MarketDataSource
+{
+public:
+    explicit MockFeed(std::chrono::microseconds interval = std::chrono::milliseconds(100)) : interval(interval) {}
+
+    ~MockFeed() override
+    {
+        stop();
+    }
+
+    void start(Handler handler) override
+    {
+        this->handler = std::move(handler);
+        thread = std::thread([this]()
+                             { run(); });
+    }
+
+    void stop() override
+    {
+        running = false;
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void subscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : list)
+        {
+            mids.emplace(symbol, symbol.compare(0, 3, "BTC") == 0 ? 60000.0 : 3000.0);
+        }
+    }
+
+    void unsubscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : list)
+        {
+            mids.erase(symbol);
+        }
+    }
+
+    const char *name() const override
+    {
+        return "mock";
+    }
+
+private:
+    std::chrono::microseconds interval;
+    Handler handler;
+    std::thread thread;
+    std::atomic<bool> running{true};
+    std::mutex mutex;
+    std::unordered_map<std::string, double> mids;
+
+    void run()
+    {
+        std::mt19937_64 rng(42);
+        std::normal_distribution<double> step(0, 0.0005);
+        std::uniform_real_distribution<double> unit(0, 1);
+        MarketUpdate update{};
+        uint64_t tick = 0;
+        auto next = std::chrono::steady_clock::now();
+        while (running)
+        {
+            next += interval;
+            std::this_thread::sleep_until(next);
+            ++tick;
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto &[symbol, mid] : mids)
+            {
+                mid *= std::exp(step(rng));
+                double tickSize = mid > 10000 ? 0.5 : 0.05;
+                double bestBid = std::floor(mid / tickSize) * tickSize;
+                int64_t receiveNs = nowNanos();
+
+                std::memset(&update, 0, offsetof(MarketUpdate, bids));
+                update.kind = UpdateKind::Book;
+                update.setSymbol(symbol);
+                update.sequence = tick;
+                update.exchangeMs = receiveNs / 1000000;
+                update.receiveNs = receiveNs;
+                update.bidCount = update.askCount = kMaxDepth;
+                for (int level = 0; level < kMaxDepth; ++level)
+                {
+                    update.bids[level] = {bestBid - level * tickSize, std::round(unit(rng) * 1000) * 10};
+                    update.asks[level] = {bestBid + (level + 1) * tickSize, std::round(unit(rng) * 1000) * 10};
+                }
+                update.normalizedNs = nowNanos();
+                handler(update);
+
+                if (tick % 10 == 0)
+                {
+                    update.kind = UpdateKind::Ticker;
+                    update.bidCount = update.askCount = 1;
+                    update.markPrice = update.indexPrice = update.lastPrice = mid;
+                    update.normalizedNs = nowNanos();
+                    handler(update);
+                }
+                if (unit(rng) < 0.3)
+                {
+                    update.kind = UpdateKind::Trade;
+                    update.bidCount = update.askCount = 0;
+                    update.direction = unit(rng) < 0.5 ? 'b' : 's';
+                    update.price = update.direction == 'b' ? update.asks[0].price : update.bids[0].price;
+                    update.amount = std::round(unit(rng) * 100) * 10;
+                    update.normalizedNs = nowNanos();
+                    handler(update);
+                }
+            }
+        }
+    }
+};
+
+// Builds the source named by FEED_SOURCE: "deribit", "mock" or "replay"
+inline std::unique_ptr<MarketDataSource> makeMarketDataSource(const std::string &kind, const std::string &url, const std::string &recordPath,
+                                                              const std::string &replayPath, double replaySpeed)
+{
+    if (kind == "mock")
+    {
+        return std::make_unique<MockFeed>();
+    }
+    if (kind == "replay")
+    {
+        return std::make_unique<ReplayFeed>(replayPath, replaySpeed);
+    }
+    return std::make_unique<DeribitFeed>(url, recordPath);
+}
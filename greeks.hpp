@@ -0,0 +1,386 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+// The kernels below pass GCC vector types between always_inline helpers,
+// which never exist as real calls, so the vector ABI notes do not apply. GCC
+// reports them when the templates are instantiated at the end of the
+// translation unit, so the suppression cannot be scoped to this header.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// An option chain in structure-of-arrays form, so the pricing kernel can load
+// several options into one SIMD register per field. Arrays are padded to a
+// multiple of kPadding with harmless dummy options; only the first size()
+// entries are meaningful.
+//
+// Prices are in quote currency (USD for Deribit). Deribit quotes option
+// premiums in the coin: multiply them by the underlying price first.
+struct OptionChain
+{
+    static constexpr size_t kPadding = 8;
+
+    // Inputs
+    std::vector<double> forward;     // underlying forward/future price
+    std::vector<double> strike;
+    std::vector<double> expiry;      // time to expiry, in years
+    std::vector<double> rate;        // continuously compounded discount rate
+    std::vector<double> callPut;     // +1 for calls, -1 for puts
+    std::vector<double> marketPrice; // price to solve IV from; <= 0 to price at `volatility` instead
+    std::vector<double> volatility;  // input vol, also the IV solver's starting point
+
+    // Outputs
+    std::vector<double> price;
+    std::vector<double> impliedVol; // NaN where the market price admits no vol
+    std::vector<double> delta;
+    std::vector<double> gamma;
+    std::vector<double> vega;  // per 1.00 of vol
+    std::vector<double> theta; // per year
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    void clear()
+    {
+        count = 0;
+        resize(0);
+    }
+
+    // Returns the option's index
+    size_t add(double forwardPrice, double strikePrice, double years, bool call, double market, double vol = 0.5, double discountRate = 0)
+    {
+        size_t index = count++;
+        resize(count);
+        forward[index] = forwardPrice;
+        strike[index] = strikePrice;
+        expiry[index] = years;
+        rate[index] = discountRate;
+        callPut[index] = call ? 1.0 : -1.0;
+        marketPrice[index] = market;
+        volatility[index] = vol;
+        return index;
+    }
+
+private:
+    size_t count = 0;
+
+    void resize(size_t n)
+    {
+        size_t padded = (n + kPadding - 1) / kPadding * kPadding;
+        for (std::vector<double> *field : {&forward, &strike, &expiry, &volatility})
+        {
+            field->resize(padded, 1.0);
+        }
+        for (std::vector<double> *field : {&rate, &marketPrice})
+        {
+            field->resize(padded, 0.0);
+        }
+        callPut.resize(padded, 1.0);
+        for (std::vector<double> *field : {&price, &impliedVol, &delta, &gamma, &vega, &theta})
+        {
+            field->resize(padded, 0.0);
+        }
+    }
+};
+
+enum class SimdLevel
+{
+    Scalar,
+    Avx2,
+    Avx512
+};
+
+inline const char *simdLevelName(SimdLevel level)
+{
+    static const char *names[] = {"scalar", "avx2", "avx512"};
+    return names[static_cast<int>(level)];
+}
+
+// Widest instruction set this CPU supports
+inline SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = []()
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+        {
+            return SimdLevel::Avx512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        {
+            return SimdLevel::Avx2;
+        }
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+namespace greeks_detail
+{
+    // Black-76 for Width options at a time. Written once with GCC vector
+    // extensions and instantiated at widths 1, 4 and 8; the entry points below
+    // compile the 4- and 8-wide versions for AVX2 and AVX-512. exp/log and the
+    // normal CDF are implemented here branch-free (fdlibm polynomials and
+    // Hart's normal CDF) so every lane runs the same instructions.
+    template <int Width>
+    struct Lanes
+    {
+        typedef double Vec __attribute__((vector_size(Width * sizeof(double))));
+        typedef int64_t Mask __attribute__((vector_size(Width * sizeof(double))));
+    };
+
+#define GREEKS_INLINE __attribute__((always_inline)) inline
+
+    template <typename Vec>
+    GREEKS_INLINE Vec load(const double *p)
+    {
+        Vec v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE void store(double *p, const Vec &v)
+    {
+        std::memcpy(p, &v, sizeof(v));
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec splat(double value)
+    {
+        return Vec{} + value;
+    }
+
+    template <typename Vec, typename Mask>
+    GREEKS_INLINE Vec select(const Mask &mask, const Vec &a, const Vec &b)
+    {
+        return mask ? a : b;
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec vmin(const Vec &a, const Vec &b)
+    {
+        return a < b ? a : b;
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec vmax(const Vec &a, const Vec &b)
+    {
+        return a > b ? a : b;
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec vabs(const Vec &x)
+    {
+        return x < 0 ? -x : x;
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec vexp(const Vec &input)
+    {
+        typedef decltype(input < input) Mask;
+        const double ln2Hi = 6.93147180369123816490e-01, ln2Lo = 1.90821492927058770002e-10;
+        const double roundMagic = 6755399441055744.0; // 1.5 * 2^52
+        Vec x = vmax(vmin(input, splat<Vec>(709.0)), splat<Vec>(-708.0));
+        Vec n = (x * 1.44269504088896338700 + roundMagic) - roundMagic;
+        Vec r = (x - n * ln2Hi) - n * ln2Lo; // |r| <= ln(2)/2
+        // Degree 12 Taylor polynomial: no division, truncation error < 3e-16
+        Vec y = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040 + r * (1.0 / 40320 + r * (1.0 / 362880 + r * (1.0 / 3628800 + r * (1.0 / 39916800 + r * (1.0 / 479001600))))))))))));
+        // Scale by 2^n through the exponent bits
+        Mask bits = (Mask)(n + roundMagic) - (Mask)splat<Vec>(roundMagic);
+        return (Vec)((Mask)y + (bits << 52));
+    }
+
+    template <typename Vec>
+    GREEKS_INLINE Vec vlog(const Vec &x)
+    {
+        typedef decltype(x < x) Mask;
+        const double ln2Hi = 6.93147180369123816490e-01, ln2Lo = 1.90821492927058770002e-10;
+        Mask bits = (Mask)x;
+        Vec m = (Vec)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL); // [1, 2)
+        // Biased exponent to double without a conversion instruction: the
+        // bits of 2^52 + e, minus 2^52 and the bias
+        Vec e = (Vec)(((bits >> 52) & 0x7ff) | 0x4330000000000000LL) - (4503599627370496.0 + 1023.0);
+        Mask high = m > 1.41421356237309504880;
+        m = select(high, m * 0.5, m);
+        e = select(high, e + 1.0, e);
+        Vec f = m - 1.0;
+        Vec s = f / (2.0 + f);
+        Vec z = s * s;
+        Vec w = z * z;
+        Vec t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+        Vec t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 + w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+        Vec R = t2 + t1;
+        Vec hfsq = 0.5 * f * f;
+        return e * ln2Hi - ((hfsq - (s * (hfsq + R) + e * ln2Lo)) - f);
+    }
+
+    template <typename Mask>
+    GREEKS_INLINE bool anyLane(const Mask &mask)
+    {
+        bool any = false;
+        for (size_t k = 0; k < sizeof(mask) / sizeof(mask[0]); ++k)
+        {
+            any |= mask[k] != 0;
+        }
+        return any;
+    }
+
+    // Standard normal CDF, Hart's double precision algorithm (as given by
+    // West, 2005). The far tail uses a continued fraction, which costs four
+    // divisions, so it is only evaluated if some lane needs it. Also returns
+    // exp(-x^2/2), from which the density follows for free.
+    template <typename Vec>
+    GREEKS_INLINE Vec normalCdf(const Vec &x, Vec &gauss)
+    {
+        Vec a = vmin(vabs(x), splat<Vec>(37.0));
+        gauss = vexp(-0.5 * a * a);
+        Vec numerator = ((((((3.52624965998911e-02 * a + 0.700383064443688) * a + 6.37396220353165) * a + 33.912866078383) * a + 112.079291497871) * a + 221.213596169931) * a + 220.206867912376);
+        Vec denominator = (((((((8.83883476483184e-02 * a + 1.75566716318264) * a + 16.064177579207) * a + 86.7807322029461) * a + 296.564248779674) * a + 637.333633378831) * a + 793.826512519948) * a + 440.413735824752);
+        Vec tail = gauss * numerator / denominator; // N(-|x|)
+        auto far = a >= 7.07106781186547;
+        if (anyLane(far))
+        {
+            Vec fraction = a + 1.0 / (a + 2.0 / (a + 3.0 / (a + 4.0 / (a + 0.65))));
+            tail = select(far, gauss / (2.506628274631 * fraction), tail);
+        }
+        return select(x < 0, tail, 1.0 - tail);
+    }
+
+    // Per-lane quantities shared by the price and every Greek
+    template <typename Vec>
+    struct Black
+    {
+        Vec otmPrice, d1, nd1, pdf, sigmaRootT;
+    };
+
+    // Always prices the out-of-the-money side (otm = +1 call, -1 put); an
+    // in-the-money option is that plus its put-call parity term, which keeps
+    // the time value, and so the implied vol, precise deep in the money
+    template <typename Vec>
+    GREEKS_INLINE Black<Vec> black76(const Vec &forward, const Vec &strike, const Vec &logMoneyness, const Vec &rootT, const Vec &discount, const Vec &phi, const Vec &otm, const Vec &sigma)
+    {
+        Black<Vec> b;
+        b.sigmaRootT = sigma * rootT;
+        b.d1 = logMoneyness / b.sigmaRootT + 0.5 * b.sigmaRootT;
+        Vec d2 = b.d1 - b.sigmaRootT;
+        Vec gauss, unused;
+        Vec otmNd1 = normalCdf(otm * b.d1, gauss);
+        b.otmPrice = discount * otm * (forward * otmNd1 - strike * normalCdf(otm * d2, unused));
+        b.nd1 = select(phi == otm, otmNd1, 1.0 - otmNd1); // N(phi * d1)
+        b.pdf = 0.39894228040143267794 * gauss;
+        return b;
+    }
+
+    template <int Width>
+    GREEKS_INLINE void evaluate(OptionChain &chain, size_t begin, size_t end, int maxIterations, double tolerance)
+    {
+        typedef typename Lanes<Width>::Vec Vec;
+        typedef typename Lanes<Width>::Mask Mask;
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        for (size_t i = begin; i < end; i += Width)
+        {
+            Vec forward = load<Vec>(&chain.forward[i]);
+            Vec strike = load<Vec>(&chain.strike[i]);
+            Vec years = vmax(load<Vec>(&chain.expiry[i]), splat<Vec>(1e-8));
+            Vec phi = load<Vec>(&chain.callPut[i]);
+            Vec target = load<Vec>(&chain.marketPrice[i]);
+            Vec rootT = years;
+            for (int k = 0; k < Width; ++k)
+            {
+                rootT[k] = std::sqrt(years[k]);
+            }
+            Vec discount = vexp(-load<Vec>(&chain.rate[i]) * years);
+            Vec logMoneyness = vlog(forward / strike);
+
+            // Implied vol: Newton steps on vega, falling back to bisection
+            // whenever a step would leave the bracket [lo, hi]
+            Vec sigma = load<Vec>(&chain.volatility[i]);
+            Vec otm = select(logMoneyness > 0, splat<Vec>(-1.0), splat<Vec>(1.0));
+            Vec parity = select(phi == otm, splat<Vec>(0.0), discount * phi * (forward - strike));
+            Vec otmTarget = target - parity;
+            Mask solve = target > 0;
+            Vec upper = discount * select(phi > 0, forward, strike);
+            Mask valid = (otmTarget > 0) & (target < upper);
+            Vec lo = splat<Vec>(1e-4), hi = splat<Vec>(10.0);
+            sigma = vmin(vmax(sigma, lo), hi);
+            Mask active = solve & valid;
+            for (int iteration = 0; iteration < maxIterations; ++iteration)
+            {
+                if (!anyLane(active))
+                {
+                    break;
+                }
+                Black<Vec> b = black76(forward, strike, logMoneyness, rootT, discount, phi, otm, sigma);
+                Vec diff = b.otmPrice - otmTarget;
+                Vec vega = discount * forward * b.pdf * rootT;
+                hi = select(active & (diff > 0), sigma, hi);
+                lo = select(active & (diff <= 0), sigma, lo);
+                Vec step = sigma - diff / vega;
+                Mask inside = (step >= lo) & (step <= hi) & (vega > 1e-12);
+                Vec next = select(inside, step, 0.5 * (lo + hi));
+                active &= (vabs(diff) > tolerance * otmTarget) & (vabs(next - sigma) > 1e-12);
+                sigma = select(active, next, sigma);
+            }
+            Vec iv = select(solve, select(valid, sigma, splat<Vec>(nan)), sigma);
+            sigma = select(iv == iv, iv, load<Vec>(&chain.volatility[i]));
+
+            Black<Vec> b = black76(forward, strike, logMoneyness, rootT, discount, phi, otm, sigma);
+            Vec price = b.otmPrice + parity;
+            store(&chain.price[i], price);
+            store(&chain.impliedVol[i], select(solve, iv, splat<Vec>(nan)));
+            store(&chain.delta[i], discount * phi * b.nd1);
+            store(&chain.gamma[i], discount * b.pdf / (forward * b.sigmaRootT));
+            store(&chain.vega[i], discount * forward * b.pdf * rootT);
+            store(&chain.theta[i], -discount * forward * b.pdf * sigma / (2.0 * rootT) + load<Vec>(&chain.rate[i]) * price);
+        }
+    }
+
+#undef GREEKS_INLINE
+
+    inline void evaluateScalar(OptionChain &chain, size_t begin, size_t end, int maxIterations, double tolerance)
+    {
+        evaluate<1>(chain, begin, end, maxIterations, tolerance);
+    }
+
+    __attribute__((target("avx2,fma"))) inline void evaluateAvx2(OptionChain &chain, int maxIterations, double tolerance)
+    {
+        evaluate<4>(chain, 0, chain.forward.size(), maxIterations, tolerance);
+    }
+
+    __attribute__((target("avx512f"))) inline void evaluateAvx512(OptionChain &chain, int maxIterations, double tolerance)
+    {
+        evaluate<8>(chain, 0, chain.forward.size(), maxIterations, tolerance);
+    }
+}
+
+// Solves implied vol from marketPrice (where given) and computes Black-76
+// price, delta, gamma, vega and theta for every option in the chain in one
+// pass. Uses the widest SIMD level the CPU supports unless told otherwise.
+inline void evaluateChain(OptionChain &chain, SimdLevel level = detectSimdLevel(), int maxIterations = 64, double tolerance = 1e-9)
+{
+    switch (level)
+    {
+    case SimdLevel::Avx512:
+        greeks_detail::evaluateAvx512(chain, maxIterations, tolerance);
+        break;
+    case SimdLevel::Avx2:
+        greeks_detail::evaluateAvx2(chain, maxIterations, tolerance);
+        break;
+    default:
+        greeks_detail::evaluateScalar(chain, 0, chain.forward.size(), maxIterations, tolerance);
+        break;
+    }
+}
+
+// Recomputes a single option, e.g. after its own mark or size changed
+inline void evaluateOption(OptionChain &chain, size_t index, int maxIterations = 64, double tolerance = 1e-9)
+{
+    greeks_detail::evaluateScalar(chain, index, index + 1, maxIterations, tolerance);
+}
@@ -0,0 +1,466 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "include/json.hpp"
+#include "latency.hpp"
+#include "risk.hpp"
+
+enum class InstrumentKind : uint8_t
+{
+    Future,
+    Option,
+    Spot,
+    FutureCombo,
+    OptionCombo
+};
+
+// Flags of an InstrumentSpec
+enum : uint8_t
+{
+    kInstrumentInverse = 1, // sized in USD, settled in the coin
+    kInstrumentCall = 2,
+    kInstrumentActive = 4
+};
+
+// Tick size that applies above a price (Deribit's tick_size_steps)
+struct TickStep
+{
+    double abovePrice;
+    double tickSize;
+};
+
+// Fixed-size instrument record, stored as-is in the snapshot file
+struct InstrumentSpec
+{
+    char name[48];
+    char baseCurrency[8];
+    char quoteCurrency[8];
+    char settlementCurrency[8];
+    int64_t expirationMs; // 0 for perpetuals and spot
+    double tickSize;
+    double minTradeAmount;
+    double contractSize;
+    double strike;
+    uint32_t exchangeId; // Deribit's instrument_id
+    InstrumentKind kind;
+    uint8_t flags;
+    uint8_t tickStepCount;
+    uint8_t reserved[9];
+    TickStep tickSteps[4]; // ascending abovePrice
+
+    // Tick size at a price
+    double tickAt(double price) const
+    {
+        double tick = tickSize;
+        for (int i = 0; i < tickStepCount; ++i)
+        {
+            if (price > tickSteps[i].abovePrice)
+            {
+                tick = tickSteps[i].tickSize;
+            }
+        }
+        return tick;
+    }
+
+    bool isInverse() const
+    {
+        return flags & kInstrumentInverse;
+    }
+};
+static_assert(sizeof(InstrumentSpec) == 192, "instrument records must stay 192 bytes");
+
+inline const char *instrumentKindName(InstrumentKind kind)
+{
+    switch (kind)
+    {
+    case InstrumentKind::Future:
+        return "future";
+    case InstrumentKind::Option:
+        return "option";
+    case InstrumentKind::Spot:
+        return "spot";
+    case InstrumentKind::FutureCombo:
+        return "future_combo";
+    case InstrumentKind::OptionCombo:
+        return "option_combo";
+    }
+    return "unknown";
+}
+
+// One immutable version of the instrument table. Records either live in a
+// read-only mapping of a snapshot file or in memory after a download; the
+// name index is built once when the set is created.
+class InstrumentSet
+{
+public:
+    InstrumentSet(std::vector<InstrumentSpec> records, int64_t loadedAtMs)
+        : owned(std::move(records)), records(owned.data()), count(owned.size()), loadedAtMs(loadedAtMs)
+    {
+        buildIndex();
+    }
+
+    InstrumentSet(void *mapping, size_t mapLength, const InstrumentSpec *records, size_t count, int64_t loadedAtMs)
+        : records(records), count(count), loadedAtMs(loadedAtMs), mapping(mapping), mapLength(mapLength)
+    {
+        buildIndex();
+    }
+
+    ~InstrumentSet()
+    {
+        if (mapping != nullptr)
+        {
+            munmap(mapping, mapLength);
+        }
+    }
+
+    InstrumentSet(const InstrumentSet &) = delete;
+    InstrumentSet &operator=(const InstrumentSet &) = delete;
+
+    // Returns the record id of an instrument name, or -1
+    int find(std::string_view name) const
+    {
+        auto it = index.find(name);
+        return it == index.end() ? -1 : it->second;
+    }
+
+    const InstrumentSpec &operator[](int id) const
+    {
+        return records[id];
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    const InstrumentSpec *data() const
+    {
+        return records;
+    }
+
+    // When the data was downloaded from the exchange (ms since epoch)
+    int64_t getLoadedAtMs() const
+    {
+        return loadedAtMs;
+    }
+
+    bool isMapped() const
+    {
+        return mapping != nullptr;
+    }
+
+private:
+    std::vector<InstrumentSpec> owned;
+    const InstrumentSpec *records;
+    size_t count;
+    int64_t loadedAtMs;
+    void *mapping = nullptr;
+    size_t mapLength = 0;
+    std::unordered_map<std::string_view, int> index;
+
+    void buildIndex()
+    {
+        index.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            index.emplace(std::string_view(records[i].name, strnlen(records[i].name, sizeof(records[i].name))), static_cast<int>(i));
+        }
+    }
+};
+
+// Instrument metadata from public/get_instruments: tick and lot sizes, contract
+// size, expiry and strike for every listed instrument.
+//
+// The table is persisted as a binary snapshot of fixed-size records, so a
+// restart maps the file and is ready without waiting for the exchange. A
+// refresh builds a new InstrumentSet and swaps it in atomically: readers on
+// other threads keep the version they hold until they are done with it.
+class InstrumentCache
+{
+public:
+    // Number of records in the current table
+    size_t size() const
+    {
+        return current()->size();
+    }
+
+    std::shared_ptr<const InstrumentSet> current() const
+    {
+        return std::atomic_load(&set);
+    }
+
+    // Copies an instrument's record; returns false if it is not listed
+    bool lookup(std::string_view name, InstrumentSpec &spec) const
+    {
+        std::shared_ptr<const InstrumentSet> instruments = current();
+        int id = instruments->find(name);
+        if (id < 0)
+        {
+            return false;
+        }
+        spec = (*instruments)[id];
+        return true;
+    }
+
+    // Replaces the table with the result of public/get_instruments
+    // (one or several results, e.g. one per currency); returns the count
+    size_t load(const std::vector<nlohmann::json> &results)
+    {
+        std::vector<InstrumentSpec> records;
+        for (const nlohmann::json &result : results)
+        {
+            if (!result.is_array())
+            {
+                continue;
+            }
+            for (const nlohmann::json &instrument : result)
+            {
+                InstrumentSpec spec;
+                if (parse(instrument, spec))
+                {
+                    records.push_back(spec);
+                }
+            }
+        }
+        std::sort(records.begin(), records.end(), [](const InstrumentSpec &a, const InstrumentSpec &b)
+                  { return std::strncmp(a.name, b.name, sizeof(a.name)) < 0; });
+        size_t count = records.size();
+        std::atomic_store(&set, std::shared_ptr<const InstrumentSet>(std::make_shared<InstrumentSet>(std::move(records), nowMillis())));
+        return count;
+    }
+
+    // Writes the current table to `path` (through a temporary file and a
+    // rename, so readers never see a partial snapshot)
+    bool save(const std::string &path) const
+    {
+        std::shared_ptr<const InstrumentSet> instruments = current();
+        SnapshotHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.version = kVersion;
+        header.recordSize = sizeof(InstrumentSpec);
+        header.count = instruments->size();
+        header.loadedAtMs = instruments->getLoadedAtMs();
+        header.checksum = checksum(instruments->data(), instruments->size());
+
+        std::string temporary = path + ".tmp";
+        FILE *file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  (header.count == 0 || std::fwrite(instruments->data(), sizeof(InstrumentSpec), header.count, file) == header.count);
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Maps a snapshot written by save(); returns false (and keeps the current
+    // table) if the file is missing, from another version or corrupt
+    bool loadSnapshot(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader))
+        {
+            ::close(fd);
+            return false;
+        }
+        size_t length = static_cast<size_t>(info.st_size);
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        const SnapshotHeader *header = static_cast<const SnapshotHeader *>(mapping);
+        const InstrumentSpec *records = reinterpret_cast<const InstrumentSpec *>(static_cast<const char *>(mapping) + sizeof(SnapshotHeader));
+        bool valid = std::memcmp(header->magic, kMagic, sizeof(header->magic)) == 0 && header->version == kVersion &&
+                     header->recordSize == sizeof(InstrumentSpec) && length == sizeof(SnapshotHeader) + header->count * sizeof(InstrumentSpec) &&
+                     header->checksum == checksum(records, header->count);
+        if (!valid)
+        {
+            munmap(mapping, length);
+            return false;
+        }
+        std::atomic_store(&set, std::shared_ptr<const InstrumentSet>(
+                                    std::make_shared<InstrumentSet>(mapping, length, records, header->count, header->loadedAtMs)));
+        return true;
+    }
+
+    // Checks an order against the instrument's specs; returns nullptr if it is
+    // valid, else the reason
+    static const char *validate(const InstrumentSpec &spec, double price, double amount, int64_t nowMs = nowMillis())
+    {
+        if (!(spec.flags & kInstrumentActive) || (spec.expirationMs > 0 && spec.expirationMs <= nowMs))
+        {
+            return "instrument is not active";
+        }
+        if (!(amount > 0) || amount < spec.minTradeAmount - 1e-9 * spec.minTradeAmount)
+        {
+            return "amount is below the minimum trade amount";
+        }
+        if (!onGrid(amount, spec.minTradeAmount))
+        {
+            return "amount is not a multiple of the minimum trade amount";
+        }
+        if (!onGrid(price, spec.tickAt(price)))
+        {
+            return "price is not a multiple of the tick size";
+        }
+        return nullptr;
+    }
+
+    // Rounds a price onto the tick grid: down for buys, up for sells, so the
+    // rounded order is never more aggressive than asked
+    static double roundPrice(const InstrumentSpec &spec, double price, Side side)
+    {
+        double tick = spec.tickAt(price);
+        if (!(tick > 0))
+        {
+            return price;
+        }
+        double ticks = price / tick;
+        double rounded = side == Side::Buy ? std::floor(ticks + 1e-9) : std::ceil(ticks - 1e-9);
+        // Drop the binary residue of e.g. 3 * 0.05
+        return std::round(rounded * tick * 1e10) / 1e10;
+    }
+
+    // Rounds an amount down to a multiple of the minimum trade amount
+    static double roundAmount(const InstrumentSpec &spec, double amount)
+    {
+        if (!(spec.minTradeAmount > 0))
+        {
+            return amount;
+        }
+        return std::floor(amount / spec.minTradeAmount + 1e-9) * spec.minTradeAmount;
+    }
+
+private:
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t count;
+        int64_t loadedAtMs;
+        uint64_t checksum;
+        char reserved[24];
+    };
+    static_assert(sizeof(SnapshotHeader) == 64, "snapshot header must stay 64 bytes");
+
+    static constexpr char kMagic[8] = {'D', 'R', 'B', 'I', 'N', 'S', 'T', '1'};
+    static constexpr uint32_t kVersion = 1;
+
+    std::shared_ptr<const InstrumentSet> set = std::make_shared<InstrumentSet>(std::vector<InstrumentSpec>(), 0);
+
+    static int64_t nowMillis()
+    {
+        return nowNanos() / 1000000;
+    }
+
+    static bool onGrid(double value, double step)
+    {
+        if (!(step > 0))
+        {
+            return true;
+        }
+        double steps = value / step;
+        return std::fabs(steps - std::round(steps)) <= 1e-6;
+    }
+
+    // FNV-1a over the records, a 64-bit word at a time
+    static uint64_t checksum(const InstrumentSpec *records, size_t count)
+    {
+        uint64_t hash = 1469598103934665603ULL;
+        const char *bytes = reinterpret_cast<const char *>(records);
+        for (size_t offset = 0; offset < count * sizeof(InstrumentSpec); offset += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + offset, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static void copyField(char *destination, size_t size, const std::string &value)
+    {
+        std::memset(destination, 0, size);
+        std::memcpy(destination, value.data(), std::min(value.size(), size - 1));
+    }
+
+    static bool parse(const nlohmann::json &instrument, InstrumentSpec &spec)
+    {
+        std::memset(&spec, 0, sizeof(spec));
+        std::string name = instrument.value("instrument_name", "");
+        if (name.empty() || name.size() >= sizeof(spec.name))
+        {
+            return false;
+        }
+        copyField(spec.name, sizeof(spec.name), name);
+        copyField(spec.baseCurrency, sizeof(spec.baseCurrency), instrument.value("base_currency", ""));
+        copyField(spec.quoteCurrency, sizeof(spec.quoteCurrency), instrument.value("quote_currency", ""));
+        copyField(spec.settlementCurrency, sizeof(spec.settlementCurrency), instrument.value("settlement_currency", ""));
+
+        auto number = [&instrument](const char *key)
+        {
+            auto it = instrument.find(key);
+            return it != instrument.end() && it->is_number() ? it->get<double>() : 0.0;
+        };
+        std::string kind = instrument.value("kind", "");
+        spec.kind = kind == "option"         ? InstrumentKind::Option
+                    : kind == "spot"         ? InstrumentKind::Spot
+                    : kind == "future_combo" ? InstrumentKind::FutureCombo
+                    : kind == "option_combo" ? InstrumentKind::OptionCombo
+                                             : InstrumentKind::Future;
+        // Perpetuals report a far-future expiration; treat them as never expiring
+        std::string period = instrument.value("settlement_period", "");
+        spec.expirationMs = period == "perpetual" || spec.kind == InstrumentKind::Spot ? 0 : static_cast<int64_t>(number("expiration_timestamp"));
+        spec.tickSize = number("tick_size");
+        spec.minTradeAmount = number("min_trade_amount");
+        spec.contractSize = number("contract_size");
+        spec.strike = number("strike");
+        spec.exchangeId = static_cast<uint32_t>(number("instrument_id"));
+        spec.flags = (instrument.value("instrument_type", "") == "reversed" ? kInstrumentInverse : 0) |
+                     (instrument.value("option_type", "") == "call" ? kInstrumentCall : 0) |
+                     (instrument.value("is_active", true) ? kInstrumentActive : 0);
+
+        auto steps = instrument.find("tick_size_steps");
+        if (steps != instrument.end() && steps->is_array())
+        {
+            for (const nlohmann::json &step : *steps)
+            {
+                if (spec.tickStepCount < 4 && step.contains("above_price") && step.contains("tick_size"))
+                {
+                    spec.tickSteps[spec.tickStepCount++] = {step["above_price"].get<double>(), step["tick_size"].get<double>()};
+                }
+            }
+            std::sort(spec.tickSteps, spec.tickSteps + spec.tickStepCount, [](const TickStep &a, const TickStep &b)
+                      { return a.abovePrice < b.abovePrice; });
+        }
+        return true;
+    }
+};
@@ -0,0 +1,388 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "latency.hpp"
+#include "risk.hpp"
+
+enum class JournalEvent : uint8_t
+{
+    Intent = 1, // about to send a new order (written before the request leaves)
+    Ack,        // exchange accepted the order and assigned order_id
+    Fill,       // amount filled at price (incremental)
+    Modify,     // new total amount / price after an edit
+    Cancel,     // cancel confirmed
+    Reject,     // exchange rejected the intent
+    Closed      // order no longer resting (filled, expired, or gone at reconciliation)
+};
+
+// One fixed-size journal entry: exactly two cache lines, never straddling a page
+struct JournalRecord
+{
+    uint64_t sequence;  // 1-based, 0 marks an unwritten slot
+    uint64_t intentSeq; // sequence of the Intent this record belongs to
+    int64_t timestampNs;
+    double amount;
+    double price;
+    JournalEvent event;
+    Side side;
+    uint16_t reserved;
+    uint32_t checksum;
+    char orderId[32];
+    char instrument[32];
+    char label[16];
+};
+static_assert(sizeof(JournalRecord) == 128, "journal records must stay 128 bytes");
+
+// How appends are made durable
+enum class JournalDurability
+{
+    Async,       // the kernel writes dirty pages back; survives a process crash, not a host crash
+    BatchedSync, // a background thread fdatasyncs pending records every sync interval
+};
+
+// An order reconstructed from the journal
+struct RecoveredOrder
+{
+    uint64_t intentSeq = 0;
+    std::string orderId; // empty if the intent was never acknowledged
+    std::string instrument;
+    std::string label;
+    Side side = Side::Buy;
+    double amount = 0; // total order amount
+    double filled = 0;
+    double price = 0;
+};
+
+// Write-ahead journal of order intents, acks and fills in a preallocated,
+// memory-mapped file.
+//
+// append() claims a slot with one atomic increment and writes the record
+// straight into the mapping, so it costs a memcpy-sized store plus a checksum
+// and never blocks on I/O. The sequence number is stored last (release) and
+// doubles as the commit marker; replay stops at the first uncommitted or
+// corrupt slot. In BatchedSync mode a background thread issues fdatasync
+// whenever records are pending; callers that need an order to be on disk
+// before acting can wait for it with waitDurable().
+class OrderJournal
+{
+public:
+    OrderJournal(const std::string &path, size_t capacity, JournalDurability durability,
+                 std::chrono::microseconds syncInterval = std::chrono::microseconds(1000))
+        : path(path), capacity(capacity), durability(durability), syncInterval(syncInterval)
+    {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open journal " + path);
+        }
+        size_t bytes = sizeof(Header) + capacity * sizeof(JournalRecord);
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || (static_cast<size_t>(st.st_size) < bytes && posix_fallocate(fd, 0, static_cast<off_t>(bytes)) != 0))
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not preallocate journal " + path);
+        }
+        void *mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED)
+        {
+            ::close(fd);
+            throw std::runtime_error("Could not map journal " + path);
+        }
+        mappedBytes = bytes;
+        header = static_cast<Header *>(mapping);
+        records = reinterpret_cast<JournalRecord *>(static_cast<char *>(mapping) + sizeof(Header));
+
+        if (header->magic != kMagic)
+        {
+            header->magic = kMagic;
+            header->version = 1;
+            header->recordSize = sizeof(JournalRecord);
+            header->capacity = capacity;
+        }
+        else if (header->recordSize != sizeof(JournalRecord))
+        {
+            munmap(mapping, bytes);
+            ::close(fd);
+            throw std::runtime_error("Journal " + path + " has an incompatible record layout");
+        }
+
+        // Resume after the last committed record
+        size_t count = 0;
+        while (count < capacity && isValid(records[count], count + 1))
+        {
+            count++;
+        }
+        next.store(count);
+        synced.store(count);
+
+        if (durability == JournalDurability::BatchedSync)
+        {
+            syncer = std::thread([this]()
+                                 { syncLoop(); });
+        }
+    }
+
+    ~OrderJournal()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (syncer.joinable())
+        {
+            syncer.join();
+        }
+        fdatasync(fd);
+        munmap(header, mappedBytes);
+        ::close(fd);
+    }
+
+    OrderJournal(const OrderJournal &) = delete;
+    OrderJournal &operator=(const OrderJournal &) = delete;
+
+    // Returns the record's sequence number, or 0 if the journal is full
+    uint64_t append(JournalEvent event, uint64_t intentSeq, const std::string &orderId, const std::string &instrument,
+                    const std::string &label, Side side, double amount, double price)
+    {
+        uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= capacity)
+        {
+            next.store(capacity, std::memory_order_relaxed);
+            return 0;
+        }
+        uint64_t sequence = index + 1;
+
+        JournalRecord record{};
+        record.intentSeq = intentSeq ? intentSeq : sequence;
+        record.timestampNs = nowNanos();
+        record.amount = amount;
+        record.price = price;
+        record.event = event;
+        record.side = side;
+        copyField(record.orderId, orderId);
+        copyField(record.instrument, instrument);
+        copyField(record.label, label);
+        record.sequence = sequence;
+        record.checksum = checksum(record);
+
+        // Publish the body first and the sequence (commit marker) last
+        JournalRecord &slot = records[index];
+        uint64_t committed = record.sequence;
+        record.sequence = 0;
+        std::memcpy(&slot, &record, sizeof(record));
+        __atomic_store_n(&slot.sequence, committed, __ATOMIC_RELEASE);
+
+        if (durability == JournalDurability::BatchedSync)
+        {
+            pending.store(true, std::memory_order_release);
+        }
+        return sequence;
+    }
+
+    // Blocks until the record with this sequence is on stable storage
+    void waitDurable(uint64_t sequence)
+    {
+        if (durability != JournalDurability::BatchedSync)
+        {
+            fdatasync(fd);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeup.notify_all();
+        durableChanged.wait(lock, [this, sequence]()
+                            { return synced.load() >= sequence || stopping; });
+    }
+
+    // Calls f(const JournalRecord &) for every committed record, in order
+    template <typename F>
+    void replay(F &&f) const
+    {
+        size_t count = std::min<size_t>(next.load(), capacity);
+        for (size_t i = 0; i < count && isValid(records[i], i + 1); ++i)
+        {
+            f(records[i]);
+        }
+    }
+
+    // Rebuilds every order that was still live when the journal was last written
+    std::vector<RecoveredOrder> recover() const
+    {
+        std::unordered_map<uint64_t, RecoveredOrder> orders;
+        replay([&orders](const JournalRecord &record)
+               {
+                   RecoveredOrder &order = orders[record.intentSeq];
+                   switch (record.event)
+                   {
+                   case JournalEvent::Intent:
+                       order.intentSeq = record.intentSeq;
+                       order.instrument = record.instrument;
+                       order.label = record.label;
+                       order.side = record.side;
+                       order.amount = record.amount;
+                       order.price = record.price;
+                       break;
+                   case JournalEvent::Ack:
+                       order.orderId = record.orderId;
+                       break;
+                   case JournalEvent::Fill:
+                       order.filled += record.amount;
+                       break;
+                   case JournalEvent::Modify:
+                       order.amount = record.amount;
+                       order.price = record.price;
+                       break;
+                   case JournalEvent::Cancel:
+                   case JournalEvent::Reject:
+                   case JournalEvent::Closed:
+                       orders.erase(record.intentSeq);
+                       break;
+                   } });
+
+        std::vector<RecoveredOrder> live;
+        for (auto &[intentSeq, order] : orders)
+        {
+            if (order.intentSeq != 0 && order.filled < order.amount)
+            {
+                live.push_back(order);
+            }
+        }
+        return live;
+    }
+
+    // Starts a fresh journal holding only the given live orders, updating
+    // their intentSeq to the rewritten records. Call after recovery so the
+    // file does not grow across restarts. Not safe while other threads append.
+    void compact(std::vector<RecoveredOrder> &live)
+    {
+        std::memset(records, 0, std::min<size_t>(next.load(), capacity) * sizeof(JournalRecord));
+        next.store(0);
+        synced.store(0);
+        for (RecoveredOrder &order : live)
+        {
+            uint64_t intent = order.intentSeq = append(JournalEvent::Intent, 0, "", order.instrument, order.label, order.side, order.amount, order.price);
+            if (!order.orderId.empty())
+            {
+                append(JournalEvent::Ack, intent, order.orderId, order.instrument, order.label, order.side, order.amount, order.price);
+            }
+            if (order.filled > 0)
+            {
+                append(JournalEvent::Fill, intent, order.orderId, order.instrument, order.label, order.side, order.filled, order.price);
+            }
+        }
+        fdatasync(fd);
+        synced.store(next.load());
+    }
+
+    size_t size() const
+    {
+        return std::min<size_t>(next.load(), capacity);
+    }
+
+    const std::string &getPath() const
+    {
+        return path;
+    }
+
+private:
+    static constexpr uint64_t kMagic = 0x4a524e4c4f524431ULL; // "JRNLORD1"
+
+    struct alignas(128) Header
+    {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t capacity;
+    };
+
+    std::string path;
+    size_t capacity;
+    JournalDurability durability;
+    std::chrono::microseconds syncInterval;
+    int fd = -1;
+    size_t mappedBytes = 0;
+    Header *header = nullptr;
+    JournalRecord *records = nullptr;
+
+    alignas(64) std::atomic<uint64_t> next{0};
+    alignas(64) std::atomic<bool> pending{false};
+    std::atomic<uint64_t> synced{0};
+
+    std::thread syncer;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable durableChanged;
+    bool stopping = false;
+
+    template <size_t N>
+    static void copyField(char (&field)[N], const std::string &value)
+    {
+        size_t length = std::min(value.size(), N - 1);
+        std::memcpy(field, value.data(), length);
+        field[length] = '\0';
+    }
+
+    // FNV-1a over the record's 64-bit words, skipping the checksum itself
+    static uint32_t checksum(const JournalRecord &record)
+    {
+        JournalRecord copy = record;
+        copy.checksum = 0;
+        uint64_t words[sizeof(JournalRecord) / 8];
+        std::memcpy(words, &copy, sizeof(words));
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (uint64_t word : words)
+        {
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    static bool isValid(const JournalRecord &record, uint64_t expectedSequence)
+    {
+        return __atomic_load_n(&record.sequence, __ATOMIC_ACQUIRE) == expectedSequence && record.checksum == checksum(record);
+    }
+
+    void syncLoop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            wakeup.wait_for(lock, syncInterval);
+            if (!pending.exchange(false, std::memory_order_acquire))
+            {
+                continue;
+            }
+            // Only the committed prefix counts: a slot may be claimed but not yet written
+            uint64_t target = synced.load();
+            uint64_t claimed = std::min<uint64_t>(next.load(), capacity);
+            while (target < claimed && isValid(records[target], target + 1))
+            {
+                target++;
+            }
+            if (target < claimed)
+            {
+                pending.store(true, std::memory_order_relaxed);
+            }
+            lock.unlock();
+            fdatasync(fd);
+            lock.lock();
+            synced.store(target);
+            durableChanged.notify_all();
+        }
+        durableChanged.notify_all();
+    }
+};
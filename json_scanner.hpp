@@ -0,0 +1,453 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// A JSON number as read from the text: mantissa * 10^exponent
+struct Decimal
+{
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool negative = false;
+    bool null = false; // the value was `null`
+    const char *text = nullptr; // start of the number in the input
+
+    // Correctly rounded, identical to strtod. Mantissas below 2^53 scaled by
+    // at most 10^22 are exact in a double, so one multiply or divide rounds
+    // correctly; anything else goes through strtod on the original text.
+    double toDouble() const
+    {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        if (null)
+        {
+            return 0.0;
+        }
+        double value;
+        if (mantissa < (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+        {
+            value = exponent < 0 ? static_cast<double>(mantissa) / powers[-exponent] : static_cast<double>(mantissa) * powers[exponent];
+        }
+        else
+        {
+            return std::strtod(text, nullptr);
+        }
+        return negative ? -value : value;
+    }
+
+    // Fixed point with `digits` decimals (e.g. 8 -> units of 1e-8), rounded
+    // half away from zero. Returns false if it does not fit in an int64.
+    bool toFixed(int digits, int64_t &out) const
+    {
+        if (null)
+        {
+            out = 0;
+            return true;
+        }
+        uint64_t value = mantissa;
+        int shift = exponent + digits;
+        for (; shift > 0; --shift)
+        {
+            if (value > UINT64_MAX / 10)
+            {
+                return false;
+            }
+            value *= 10;
+        }
+        if (shift < 0)
+        {
+            if (shift < -19)
+            {
+                value = 0;
+            }
+            else
+            {
+                uint64_t divisor = 1;
+                for (; shift < 0; ++shift)
+                {
+                    divisor *= 10;
+                }
+                value = (value + divisor / 2) / divisor;
+            }
+        }
+        if (value > static_cast<uint64_t>(INT64_MAX))
+        {
+            return false;
+        }
+        out = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+        return true;
+    }
+};
+
+// On-demand JSON reader over a contiguous buffer that must stay alive (and
+// be NUL-terminated, as std::string is) while it is read.
+//
+// Nothing is materialized: callers walk objects and arrays in document order,
+// read the fields they need and skip the rest. Strings are returned as views
+// into the input; skipped values are crossed with a 16-byte SIMD scan for
+// structural characters. Any malformed or unsupported input (escaped strings
+// where a view was requested, mantissas over 19 digits) puts the scanner in a
+// failed state, which callers check with ok() to fall back to a full parser.
+class JsonScanner
+{
+public:
+    explicit JsonScanner(std::string_view text) : cursor(text.data()), end(text.data() + text.size()) {}
+
+    bool ok() const
+    {
+        return !failed;
+    }
+
+    bool fail()
+    {
+        failed = true;
+        cursor = end;
+        return false;
+    }
+
+    // Next non-whitespace character without consuming it ('\0' at the end)
+    char peek()
+    {
+        skipWhitespace();
+        return cursor < end ? *cursor : '\0';
+    }
+
+    bool consume(char expected)
+    {
+        skipWhitespace();
+        if (cursor < end && *cursor == expected)
+        {
+            ++cursor;
+            return true;
+        }
+        return fail();
+    }
+
+    // Unescaped string contents; fails on escape sequences
+    bool readString(std::string_view &out)
+    {
+        if (!consume('"'))
+        {
+            return false;
+        }
+        const char *begin = cursor;
+        const char *close = findQuoteOrBackslash(cursor);
+        if (close >= end || *close != '"')
+        {
+            return fail();
+        }
+        out = std::string_view(begin, close - begin);
+        cursor = close + 1;
+        return true;
+    }
+
+    bool readNumber(Decimal &out)
+    {
+        skipWhitespace();
+        out = Decimal();
+        out.text = cursor;
+        if (end - cursor >= 4 && std::memcmp(cursor, "null", 4) == 0)
+        {
+            out.null = true;
+            cursor += 4;
+            return true;
+        }
+        if (cursor < end && *cursor == '-')
+        {
+            out.negative = true;
+            ++cursor;
+        }
+        int digits = 0;
+        const char *start = cursor;
+        while (cursor < end && isDigit(*cursor))
+        {
+            addDigit(out, digits);
+        }
+        if (cursor == start)
+        {
+            return fail();
+        }
+        if (cursor < end && *cursor == '.')
+        {
+            const char *fraction = ++cursor;
+            while (cursor < end && isDigit(*cursor))
+            {
+                addDigit(out, digits);
+                out.exponent--;
+            }
+            if (cursor == fraction)
+            {
+                return fail();
+            }
+        }
+        if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+        {
+            ++cursor;
+            bool negativeExponent = false;
+            if (cursor < end && (*cursor == '+' || *cursor == '-'))
+            {
+                negativeExponent = *cursor++ == '-';
+            }
+            int exponent = 0;
+            const char *exponentStart = cursor;
+            while (cursor < end && isDigit(*cursor))
+            {
+                exponent = std::min(exponent * 10 + (*cursor++ - '0'), 100000);
+            }
+            if (cursor == exponentStart)
+            {
+                return fail();
+            }
+            out.exponent += negativeExponent ? -exponent : exponent;
+        }
+        if (digits > 19)
+        {
+            return fail();
+        }
+        return true;
+    }
+
+    double readDouble()
+    {
+        Decimal value;
+        return readNumber(value) ? value.toDouble() : 0.0;
+    }
+
+    uint64_t readUnsigned()
+    {
+        Decimal value;
+        int64_t fixed = 0;
+        if (!readNumber(value) || !value.toFixed(0, fixed) || fixed < 0)
+        {
+            fail();
+            return 0;
+        }
+        return static_cast<uint64_t>(fixed);
+    }
+
+    // Calls member(key) for every member of the object at the cursor;
+    // member must consume the value (or call skipValue)
+    template <typename Member>
+    bool forEachMember(Member &&member)
+    {
+        if (!consume('{'))
+        {
+            return false;
+        }
+        if (peek() == '}')
+        {
+            ++cursor;
+            return true;
+        }
+        std::string_view key;
+        do
+        {
+            if (!readString(key) || !consume(':'))
+            {
+                return false;
+            }
+            member(key);
+            if (failed)
+            {
+                return false;
+            }
+        } while (peek() == ',' && ++cursor);
+        return consume('}');
+    }
+
+    // Calls element() for every element of the array at the cursor
+    template <typename Element>
+    bool forEachElement(Element &&element)
+    {
+        if (!consume('['))
+        {
+            return false;
+        }
+        if (peek() == ']')
+        {
+            ++cursor;
+            return true;
+        }
+        do
+        {
+            element();
+            if (failed)
+            {
+                return false;
+            }
+        } while (peek() == ',' && ++cursor);
+        return consume(']');
+    }
+
+    // Skips one value of any type
+    bool skipValue()
+    {
+        char first = peek();
+        if (first == '"')
+        {
+            ++cursor;
+            return skipStringBody();
+        }
+        if (first != '{' && first != '[')
+        {
+            // Scalar: runs until the next delimiter
+            while (cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']' && !isSpace(*cursor))
+            {
+                ++cursor;
+            }
+            return true;
+        }
+        ++cursor;
+        int depth = 1;
+        while (depth > 0)
+        {
+            cursor = findStructural(cursor);
+            if (cursor >= end)
+            {
+                return fail();
+            }
+            char c = *cursor++;
+            if (c == '"')
+            {
+                if (!skipStringBody())
+                {
+                    return false;
+                }
+            }
+            else if (c == '{' || c == '[')
+            {
+                ++depth;
+            }
+            else
+            {
+                --depth;
+            }
+        }
+        return true;
+    }
+
+    // Start of the value at the cursor, for resuming a scan there later
+    const char *position()
+    {
+        skipWhitespace();
+        return cursor;
+    }
+
+    void seek(const char *position)
+    {
+        cursor = position;
+    }
+
+private:
+    const char *cursor;
+    const char *end;
+    bool failed = false;
+
+    static bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool isSpace(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+
+    void skipWhitespace()
+    {
+        while (cursor < end && isSpace(*cursor))
+        {
+            ++cursor;
+        }
+    }
+
+    // Digits past the 19th cannot be held exactly; readNumber fails on them
+    void addDigit(Decimal &out, int &digits)
+    {
+        int digit = *cursor++ - '0';
+        if (digits == 0 && digit == 0)
+        {
+            return; // leading zeros (e.g. "0.05") do not count
+        }
+        if (++digits <= 19)
+        {
+            out.mantissa = out.mantissa * 10 + digit;
+        }
+    }
+
+    // Cursor is just past the opening quote
+    bool skipStringBody()
+    {
+        while (true)
+        {
+            cursor = findQuoteOrBackslash(cursor);
+            if (cursor >= end)
+            {
+                return fail();
+            }
+            if (*cursor++ == '"')
+            {
+                return true;
+            }
+            ++cursor; // escaped character
+        }
+    }
+
+    const char *findQuoteOrBackslash(const char *from) const
+    {
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        for (; end - from >= 16; from += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+            if (mask != 0)
+            {
+                return from + __builtin_ctz(mask);
+            }
+        }
+#endif
+        while (from < end && *from != '"' && *from != '\\')
+        {
+            ++from;
+        }
+        return from;
+    }
+
+    // Next '"', '{', '}', '[' or ']'
+    const char *findStructural(const char *from) const
+    {
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i openBrace = _mm_set1_epi8('{');
+        const __m128i closeBrace = _mm_set1_epi8('}');
+        const __m128i openBracket = _mm_set1_epi8('[');
+        const __m128i closeBracket = _mm_set1_epi8(']');
+        for (; end - from >= 16; from += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(from));
+            __m128i braces = _mm_or_si128(_mm_cmpeq_epi8(chunk, openBrace), _mm_cmpeq_epi8(chunk, closeBrace));
+            __m128i brackets = _mm_or_si128(_mm_cmpeq_epi8(chunk, openBracket), _mm_cmpeq_epi8(chunk, closeBracket));
+            __m128i hits = _mm_or_si128(_mm_or_si128(braces, brackets), _mm_cmpeq_epi8(chunk, quote));
+            int mask = _mm_movemask_epi8(hits);
+            if (mask != 0)
+            {
+                return from + __builtin_ctz(mask);
+            }
+        }
+#endif
+        while (from < end && *from != '"' && *from != '{' && *from != '}' && *from != '[' && *from != ']')
+        {
+            ++from;
+        }
+        return from;
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+// Wall-clock nanoseconds since the epoch. Used for timestamps that cross a
+// process boundary (server -> client), so it has to be the realtime clock.
+inline int64_t nowNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Log-linear latency histogram (HdrHistogram layout): every power of two is
+// split into 32 linear sub-buckets, giving ~3% precision from 1ns up to
+// ~18 hours with a fixed 10KB footprint and no allocation on record().
+// Not thread-safe; keep one per thread and merge() them for reporting.
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 6;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kHalfBuckets = kSubBuckets / 2;
+    static constexpr int kMagnitudes = 40;
+    static constexpr size_t kBuckets = kSubBuckets + kMagnitudes * kHalfBuckets;
+
+    void record(int64_t value)
+    {
+        if (value < 0)
+        {
+            value = 0;
+        }
+        counts[indexOf(static_cast<uint64_t>(value))]++;
+        total++;
+        sum += value;
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    void reset()
+    {
+        counts.fill(0);
+        total = 0;
+        sum = 0;
+        minValue = std::numeric_limits<int64_t>::max();
+        maxValue = 0;
+    }
+
+    // Upper bound of the bucket holding the given percentile (0..100).
+    int64_t percentile(double p) const
+    {
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total) + 0.5);
+        rank = std::max<uint64_t>(1, std::min<uint64_t>(rank, total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            seen += counts[i];
+            if (seen >= rank)
+            {
+                return std::min<int64_t>(upperBoundOf(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+
+    uint64_t count() const { return total; }
+    int64_t min() const { return total ? minValue : 0; }
+    int64_t max() const { return maxValue; }
+    double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+
+private:
+    std::array<uint64_t, kBuckets> counts{};
+    uint64_t total = 0;
+    int64_t sum = 0;
+    int64_t minValue = std::numeric_limits<int64_t>::max();
+    int64_t maxValue = 0;
+
+    static size_t indexOf(uint64_t value)
+    {
+        if (value < kSubBuckets)
+        {
+            return static_cast<size_t>(value);
+        }
+        // Keep the top kSubBucketBits bits: value >> shift lands in [32, 63].
+        int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+        if (shift > kMagnitudes)
+        {
+            return kBuckets - 1;
+        }
+        size_t sub = static_cast<size_t>(value >> shift);
+        return kSubBuckets + static_cast<size_t>(shift - 1) * kHalfBuckets + (sub - kHalfBuckets);
+    }
+
+    static int64_t upperBoundOf(size_t index)
+    {
+        if (index < kSubBuckets)
+        {
+            return static_cast<int64_t>(index);
+        }
+        size_t shift = (index - kSubBuckets) / kHalfBuckets + 1;
+        uint64_t sub = (index - kSubBuckets) % kHalfBuckets + kHalfBuckets;
+        return static_cast<int64_t>(((sub + 1) << shift) - 1);
+    }
+};
@@ -0,0 +1,576 @@
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <websocketpp/base64/base64.hpp>
+#include <nlohmann/json.hpp>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.hpp"
+#include "latency.hpp"
+
+using json = nlohmann::json;
+
+// Per-connection user data, so the open handler can find the connect start
+// time without a lookup table.
+struct LoadConnectionData
+{
+    int64_t connectStartNs = 0;
+    int64_t subscribeSentNs = 0; // until the subscription is acknowledged
+};
+
+struct loadgen_config : public websocketpp::config::asio_client
+{
+    typedef LoadConnectionData connection_base;
+};
+
+typedef websocketpp::client<loadgen_config> client;
+
+// Command line options for a load-generation run
+struct LoadOptions
+{
+    std::string url = "ws://localhost:9000";
+    int connections = 1000;
+    int threads = 4;
+    double connectRate = 500.0; // new connections per second across all threads
+    int duration = 30;          // seconds, measured from the first connect attempt
+    std::vector<std::string> symbols{"ETH-PERPETUAL"};
+    std::string distribution = "uniform"; // uniform | zipf:<s> | weights:<w1,w2,...>
+    int symbolsPerConnection = 1;
+    int bookDepth = 0; // 0 = full updates, otherwise depth-limited book streams
+    std::string clientId = envConfig().get("CLIENT_ID");
+    std::string clientSecret = envConfig().get("CLIENT_SECRET");
+    bool handshakeAuth = false; // credentials in the upgrade request instead of a message
+    std::string reportPath = "loadgen_report.json";
+};
+
+std::vector<std::string> split(const std::string &str, char delimiter)
+{
+    std::vector<std::string> parts;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, delimiter))
+    {
+        if (!item.empty())
+        {
+            parts.push_back(item);
+        }
+    }
+    return parts;
+}
+
+void printUsage()
+{
+    std::cout << "Usage: loadgen [options]\n"
+              << "  --url <ws://host:port>        server to load (default ws://localhost:9000)\n"
+              << "  --connections <n>             total connections to open (default 1000)\n"
+              << "  --threads <n>                 client io threads (default 4)\n"
+              << "  --rate <n>                    connection attempts per second (default 500)\n"
+              << "  --duration <s>                run length in seconds (default 30)\n"
+              << "  --symbols <a,b,...>           symbol universe (default ETH-PERPETUAL)\n"
+              << "  --distribution <d>            uniform | zipf:<s> | weights:<w1,w2,...>\n"
+              << "  --per-connection <n>          symbols subscribed per connection, in one request (default 1)\n"
+              << "  --book-depth <n>              subscribe to book streams of this depth instead of full updates\n"
+              << "  --client-id <id> --client-secret <secret>  credentials (default from .env)\n"
+              << "  --auth <message|handshake>    send credentials in a message or in the upgrade request (default message)\n"
+              << "  --report <path>               JSON report output (default loadgen_report.json)\n";
+}
+
+bool parseOptions(int argc, char **argv, LoadOptions &options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h")
+        {
+            return false;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--url")
+            options.url = value;
+        else if (arg == "--connections")
+            options.connections = std::stoi(value);
+        else if (arg == "--threads")
+            options.threads = std::max(1, std::stoi(value));
+        else if (arg == "--rate")
+            options.connectRate = std::max(1.0, std::stod(value));
+        else if (arg == "--duration")
+            options.duration = std::stoi(value);
+        else if (arg == "--symbols")
+            options.symbols = split(value, ',');
+        else if (arg == "--distribution")
+            options.distribution = value;
+        else if (arg == "--per-connection")
+            options.symbolsPerConnection = std::max(1, std::stoi(value));
+        else if (arg == "--book-depth")
+            options.bookDepth = std::max(0, std::stoi(value));
+        else if (arg == "--client-id")
+            options.clientId = value;
+        else if (arg == "--client-secret")
+            options.clientSecret = value;
+        else if (arg == "--auth")
+            options.handshakeAuth = value == "handshake";
+        else if (arg == "--report")
+            options.reportPath = value;
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+    }
+    return !options.symbols.empty();
+}
+
+// Picks symbols according to the configured popularity distribution
+class SymbolPicker
+{
+public:
+    SymbolPicker(const std::vector<std::string> &symbols, const std::string &distribution)
+        : symbols(symbols)
+    {
+        std::vector<double> weights(symbols.size(), 1.0);
+        if (distribution.rfind("zipf:", 0) == 0)
+        {
+            double s = std::stod(distribution.substr(5));
+            for (size_t i = 0; i < weights.size(); ++i)
+            {
+                weights[i] = 1.0 / std::pow(static_cast<double>(i + 1), s);
+            }
+        }
+        else if (distribution.rfind("weights:", 0) == 0)
+        {
+            auto parts = split(distribution.substr(8), ',');
+            for (size_t i = 0; i < weights.size() && i < parts.size(); ++i)
+            {
+                weights[i] = std::stod(parts[i]);
+            }
+        }
+        else if (distribution != "uniform")
+        {
+            throw std::runtime_error("Unknown symbol distribution: " + distribution);
+        }
+        dist = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+    }
+
+    const std::string &pick(std::mt19937_64 &rng)
+    {
+        return symbols[dist(rng)];
+    }
+
+private:
+    std::vector<std::string> symbols;
+    std::discrete_distribution<size_t> dist;
+};
+
+// Cheap extraction of an integer field from a flat JSON message, so that
+// timestamping each received message does not cost a full DOM parse.
+bool extractInt64(const std::string &payload, const char *key, int64_t &out)
+{
+    std::string needle = std::string("\"") + key + "\":";
+    size_t pos = payload.find(needle);
+    if (pos == std::string::npos)
+    {
+        return false;
+    }
+    const char *begin = payload.c_str() + pos + needle.size();
+    char *end = nullptr;
+    long long value = std::strtoll(begin, &end, 10);
+    if (end == begin)
+    {
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+// Per-thread counters; merged into the run report once all workers exit
+struct WorkerStats
+{
+    uint64_t attempted = 0;
+    uint64_t opened = 0;
+    uint64_t failed = 0;
+    uint64_t closed = 0; // before the run ended
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    uint64_t steadyMessages = 0;
+    int64_t firstAttemptNs = 0;
+    int64_t lastOpenNs = 0;
+    LatencyHistogram setupLatency;
+    LatencyHistogram subscribeLatency;
+    LatencyHistogram propagationDelay;
+};
+
+// Shared between workers: steady state starts when the last one finishes its ramp
+struct RampState
+{
+    std::atomic<int> remaining{0};
+    std::atomic<int64_t> doneNs{0};
+};
+
+// One io thread driving a share of the connections
+class LoadWorker
+{
+public:
+    LoadWorker(const LoadOptions &options, int index, int connections, RampState &ramp)
+        : options(options), target(connections), ramp(ramp),
+          picker(options.symbols, options.distribution), rng(0x9e3779b97f4a7c15ULL + index)
+    {
+        endpoint.clear_access_channels(websocketpp::log::alevel::all);
+        endpoint.clear_error_channels(websocketpp::log::elevel::all);
+        endpoint.init_asio();
+        endpoint.set_open_handler([this](websocketpp::connection_hdl hdl)
+                                  { onOpen(hdl); });
+        endpoint.set_fail_handler([this](websocketpp::connection_hdl)
+                                  {
+                                      stats.failed++;
+                                      checkRampDone(nowNanos());
+                                  });
+        // Only closes before the end of the run count; stop() closes the rest
+        endpoint.set_close_handler([this](websocketpp::connection_hdl)
+                                   {
+                                       if (!stopping)
+                                       {
+                                           stats.closed++;
+                                       }
+                                   });
+        endpoint.set_message_handler([this](websocketpp::connection_hdl hdl, client::message_ptr msg)
+                                     { onMessage(hdl, msg); });
+    }
+
+    void run()
+    {
+        endpoint.start_perpetual();
+        startNs = nowNanos();
+        checkRampDone(startNs);
+        scheduleConnects();
+        endpoint.set_timer(static_cast<long>(options.duration) * 1000, [this](const websocketpp::lib::error_code &)
+                           { stop(); });
+        endpoint.run();
+    }
+
+    const WorkerStats &getStats() const { return stats; }
+
+private:
+    static constexpr long kConnectTickMs = 10;
+
+    const LoadOptions &options;
+    int target;
+    RampState &ramp;
+    bool rampReported = false;
+    client endpoint;
+    SymbolPicker picker;
+    std::mt19937_64 rng;
+    WorkerStats stats;
+    std::vector<client::connection_ptr> connections;
+    int64_t startNs = 0;
+    bool stopping = false;
+
+    // Opens connections in small batches so the aggregate attempt rate
+    // across all workers matches --rate.
+    void scheduleConnects()
+    {
+        if (stopping || static_cast<int>(stats.attempted) >= target)
+        {
+            return;
+        }
+        double perThreadRate = options.connectRate / options.threads;
+        int64_t elapsedMs = (nowNanos() - startNs) / 1000000 + kConnectTickMs;
+        int due = std::min<int>(target, static_cast<int>(perThreadRate * elapsedMs / 1000.0) + 1);
+        while (static_cast<int>(stats.attempted) < due)
+        {
+            openConnection();
+        }
+        endpoint.set_timer(kConnectTickMs, [this](const websocketpp::lib::error_code &)
+                           { scheduleConnects(); });
+    }
+
+    void openConnection()
+    {
+        websocketpp::lib::error_code ec;
+        client::connection_ptr con = endpoint.get_connection(options.url, ec);
+        stats.attempted++;
+        if (ec)
+        {
+            stats.failed++;
+            return;
+        }
+        int64_t now = nowNanos();
+        if (stats.firstAttemptNs == 0)
+        {
+            stats.firstAttemptNs = now;
+        }
+        con->connectStartNs = now;
+        if (options.handshakeAuth && !options.clientId.empty())
+        {
+            con->append_header("Authorization", "Basic " + websocketpp::base64_encode(options.clientId + ":" + options.clientSecret));
+        }
+        connections.push_back(con);
+        endpoint.connect(con);
+    }
+
+    void onOpen(websocketpp::connection_hdl hdl)
+    {
+        int64_t now = nowNanos();
+        client::connection_ptr con = endpoint.get_con_from_hdl(hdl);
+        stats.setupLatency.record(now - con->connectStartNs);
+        stats.opened++;
+        stats.lastOpenNs = now;
+
+        if (!options.clientId.empty() && !options.handshakeAuth)
+        {
+            json authMessage = {
+                {"action", "authenticate"},
+                {"client_id", options.clientId},
+                {"client_secret", options.clientSecret}};
+            endpoint.send(hdl, authMessage.dump(), websocketpp::frame::opcode::text);
+        }
+        json subscribeMessage = {
+            {"action", "subscribe"},
+            {"symbols", json::array()}};
+        for (int i = 0; i < options.symbolsPerConnection; ++i)
+        {
+            subscribeMessage["symbols"].push_back(picker.pick(rng));
+        }
+        if (options.bookDepth > 0)
+        {
+            subscribeMessage["channel"] = "book";
+            subscribeMessage["depth"] = options.bookDepth;
+        }
+        con->subscribeSentNs = nowNanos();
+        endpoint.send(hdl, subscribeMessage.dump(), websocketpp::frame::opcode::text);
+
+        checkRampDone(now);
+    }
+
+    void checkRampDone(int64_t now)
+    {
+        if (rampReported || static_cast<int>(stats.opened + stats.failed) < target)
+        {
+            return;
+        }
+        rampReported = true;
+        if (ramp.remaining.fetch_sub(1) == 1)
+        {
+            ramp.doneNs.store(now);
+        }
+    }
+
+    // Sends the stage timestamp object back with our receive time appended
+    void echoTrace(websocketpp::connection_hdl hdl, const std::string &payload, int64_t receivedNs)
+    {
+        size_t begin = payload.find("\"ts\":{");
+        size_t end = payload.find('}', begin);
+        if (begin == std::string::npos || end == std::string::npos)
+        {
+            return;
+        }
+        std::string echo = "{\"action\":\"trace_echo\",";
+        echo.append(payload, begin, end - begin);
+        echo += ",\"rx\":";
+        echo += std::to_string(receivedNs);
+        echo += "}}";
+        websocketpp::lib::error_code ec;
+        endpoint.send(hdl, echo, websocketpp::frame::opcode::text, ec);
+    }
+
+    void onMessage(websocketpp::connection_hdl hdl, client::message_ptr msg)
+    {
+        int64_t now = nowNanos();
+        const std::string &payload = msg->get_payload();
+        stats.messages++;
+        stats.bytes += payload.size();
+
+        // The reply to the subscribe request, with any snapshots
+        client::connection_ptr con = endpoint.get_con_from_hdl(hdl);
+        if (con->subscribeSentNs != 0 && payload.find("\"status\":\"subscribed\"") != std::string::npos)
+        {
+            stats.subscribeLatency.record(now - con->subscribeSentNs);
+            con->subscribeSentNs = 0;
+        }
+
+        // Sampled updates carry the socket write time; the rest are measured
+        // from the enqueue stamp
+        int64_t sendTs = 0;
+        if (extractInt64(payload, "wr", sendTs))
+        {
+            stats.propagationDelay.record(now - sendTs);
+            echoTrace(hdl, payload, now);
+        }
+        else if (extractInt64(payload, "enq", sendTs))
+        {
+            stats.propagationDelay.record(now - sendTs);
+        }
+        int64_t rampDone = ramp.doneNs.load(std::memory_order_relaxed);
+        if (rampDone != 0 && now >= rampDone)
+        {
+            stats.steadyMessages++;
+        }
+    }
+
+    void stop()
+    {
+        stopping = true;
+        for (auto &con : connections)
+        {
+            websocketpp::lib::error_code ec;
+            endpoint.close(con->get_handle(), websocketpp::close::status::going_away, "load test finished", ec);
+        }
+        endpoint.stop_perpetual();
+    }
+};
+
+void raiseFileLimit()
+{
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+json histogramToJson(const LatencyHistogram &histogram)
+{
+    return {
+        {"count", histogram.count()},
+        {"min_us", histogram.min() / 1000.0},
+        {"mean_us", histogram.mean() / 1000.0},
+        {"p50_us", histogram.percentile(50) / 1000.0},
+        {"p90_us", histogram.percentile(90) / 1000.0},
+        {"p99_us", histogram.percentile(99) / 1000.0},
+        {"p999_us", histogram.percentile(99.9) / 1000.0},
+        {"max_us", histogram.max() / 1000.0}};
+}
+
+int main(int argc, char **argv)
+{
+    LoadOptions options;
+    try
+    {
+        if (!parseOptions(argc, argv, options))
+        {
+            printUsage();
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid option value: " << e.what() << std::endl;
+        printUsage();
+        return 1;
+    }
+    raiseFileLimit();
+
+    RampState ramp;
+    ramp.remaining = options.threads;
+    std::vector<std::unique_ptr<LoadWorker>> workers;
+    try
+    {
+        for (int i = 0; i < options.threads; ++i)
+        {
+            int share = options.connections / options.threads + (i < options.connections % options.threads ? 1 : 0);
+            workers.push_back(std::make_unique<LoadWorker>(options, i, share, ramp));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Opening " << options.connections << " connections to " << options.url << " on "
+              << options.threads << " threads at " << options.connectRate << "/s for "
+              << options.duration << "s..." << std::endl;
+
+    int64_t runStartNs = nowNanos();
+    std::vector<std::thread> threads;
+    for (auto &worker : workers)
+    {
+        threads.emplace_back([&worker]()
+                             { worker->run(); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    int64_t runEndNs = nowNanos();
+
+    WorkerStats total;
+    total.firstAttemptNs = runEndNs;
+    for (auto &worker : workers)
+    {
+        const WorkerStats &stats = worker->getStats();
+        total.attempted += stats.attempted;
+        total.opened += stats.opened;
+        total.failed += stats.failed;
+        total.closed += stats.closed;
+        total.messages += stats.messages;
+        total.bytes += stats.bytes;
+        total.steadyMessages += stats.steadyMessages;
+        if (stats.firstAttemptNs != 0)
+        {
+            total.firstAttemptNs = std::min(total.firstAttemptNs, stats.firstAttemptNs);
+        }
+        total.lastOpenNs = std::max(total.lastOpenNs, stats.lastOpenNs);
+        total.setupLatency.merge(stats.setupLatency);
+        total.subscribeLatency.merge(stats.subscribeLatency);
+        total.propagationDelay.merge(stats.propagationDelay);
+    }
+
+    double runSeconds = (runEndNs - runStartNs) / 1e9;
+    double rampSeconds = total.lastOpenNs > total.firstAttemptNs ? (total.lastOpenNs - total.firstAttemptNs) / 1e9 : 0.0;
+    int64_t rampDone = ramp.doneNs.load();
+    double steadySeconds = rampDone != 0 ? (runEndNs - rampDone) / 1e9 : 0.0;
+
+    json report = {
+        {"url", options.url},
+        {"threads", options.threads},
+        {"symbols", options.symbols},
+        {"distribution", options.distribution},
+        {"run_seconds", runSeconds},
+        {"connections",
+         {{"target", options.connections},
+          {"attempted", total.attempted},
+          {"opened", total.opened},
+          {"failed", total.failed},
+          {"closed_early", total.closed},
+          {"ramp_seconds", rampSeconds},
+          {"setup_rate_per_sec", rampSeconds > 0 ? total.opened / rampSeconds : 0.0},
+          {"setup_latency", histogramToJson(total.setupLatency)},
+          {"subscribe_latency", histogramToJson(total.subscribeLatency)}}},
+        {"throughput",
+         {{"messages", total.messages},
+          {"bytes", total.bytes},
+          {"messages_per_sec", runSeconds > 0 ? total.messages / runSeconds : 0.0},
+          {"steady_state_seconds", steadySeconds},
+          {"steady_state_messages_per_sec", steadySeconds > 0 ? total.steadyMessages / steadySeconds : 0.0},
+          {"megabytes_per_sec", runSeconds > 0 ? total.bytes / runSeconds / 1e6 : 0.0}}},
+        {"propagation_delay", histogramToJson(total.propagationDelay)}};
+
+    std::ofstream reportFile(options.reportPath);
+    if (reportFile.is_open())
+    {
+        reportFile << report.dump(4) << std::endl;
+    }
+    else
+    {
+        std::cerr << "Error: Could not write report to " << options.reportPath << std::endl;
+    }
+    std::cout << report.dump(4) << std::endl;
+
+    return total.opened > 0 ? 0 : 1;
+}
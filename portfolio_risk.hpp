@@ -0,0 +1,465 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ctime>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "greeks.hpp"
+#include "positions.hpp"
+
+// Risk of every position on one underlying currency. Delta is in the coin,
+// everything else in USD; gamma is per coin move of 1 USD, vega per vol point
+// and theta per day.
+struct CurrencyExposure
+{
+    double delta = 0;
+    double gamma = 0;
+    double vega = 0;
+    double theta = 0;
+    double notional = 0;
+    double margin = 0;
+    int positions = 0;
+
+    CurrencyExposure &operator+=(const CurrencyExposure &other)
+    {
+        delta += other.delta;
+        gamma += other.gamma;
+        vega += other.vega;
+        theta += other.theta;
+        notional += other.notional;
+        margin += other.margin;
+        positions += other.positions;
+        return *this;
+    }
+
+    CurrencyExposure &operator-=(const CurrencyExposure &other)
+    {
+        delta -= other.delta;
+        gamma -= other.gamma;
+        vega -= other.vega;
+        theta -= other.theta;
+        notional -= other.notional;
+        margin -= other.margin;
+        positions -= other.positions;
+        return *this;
+    }
+};
+
+// Full-revaluation PnL (USD) of every currency over a spot x vol shock grid
+struct ScenarioGrid
+{
+    std::vector<double> spotShocks; // relative, e.g. -0.1 for -10%
+    std::vector<double> volShocks;  // absolute, e.g. 0.05 for +5 vol points
+    std::unordered_map<std::string, std::vector<double>> pnl; // row-major [spot][vol]
+
+    double at(const std::string &currency, size_t spot, size_t vol) const
+    {
+        auto it = pnl.find(currency);
+        return it == pnl.end() ? 0 : it->second[spot * volShocks.size() + vol];
+    }
+
+    // Sum over currencies, assuming every underlying moves by the same shock
+    std::vector<double> total() const
+    {
+        std::vector<double> sum(spotShocks.size() * volShocks.size(), 0.0);
+        for (const auto &[currency, values] : pnl)
+        {
+            for (size_t i = 0; i < sum.size(); ++i)
+            {
+                sum[i] += values[i];
+            }
+        }
+        return sum;
+    }
+};
+
+// Simplified margin model: a flat initial margin rate on futures notional,
+// the premium for long options, and Deribit's short option formula
+// max(base - OTM amount / underlying, minimum) * underlying + mark
+struct MarginModel
+{
+    double futureRate = 0.02;
+    double shortOptionBase = 0.15;
+    double shortOptionMinimum = 0.10;
+};
+
+// Portfolio risk across every instrument held.
+//
+// Positions are grouped by underlying currency. Each group keeps its futures
+// and its options in contiguous arrays (options as an OptionChain), caches
+// each position's contribution and keeps the per-currency totals. Changing one
+// position or one mark therefore only recomputes that position: subtract its
+// old contribution, reprice it, add the new one. A move of the underlying
+// reprices the whole currency in one vectorized evaluateChain pass, at each
+// option's last implied vol (sticky strike).
+//
+// All methods are thread-safe. Queries are a lock and a copy; scenarios()
+// snapshots the books and revalues the grid on several threads.
+class PortfolioRisk
+{
+public:
+    explicit PortfolioRisk(MarginModel margin = MarginModel()) : margin(margin) {}
+
+    // Sets an instrument's position. markPrice is in the exchange's quote
+    // units (the coin for coin-settled options); zero prices keep the last known.
+    void update(const std::string &instrument, double size, double markPrice, double underlyingPrice)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry entry = find(instrument);
+        if (entry.book == nullptr)
+        {
+            return;
+        }
+        Book &book = *entry.book;
+        if (underlyingPrice > 0 && underlyingPrice != book.spot)
+        {
+            book.spot = underlyingPrice;
+            reprice(book);
+        }
+        if (entry.option)
+        {
+            updateOption(book, entry.index, size, markPrice);
+        }
+        else
+        {
+            updateFuture(book, entry.index, size, markPrice);
+        }
+    }
+
+    // Moves the underlying of a currency: reprices every position on it
+    void setUnderlying(const std::string &currency, double price)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = books.find(currency);
+        if (it != books.end() && price > 0)
+        {
+            it->second->spot = price;
+            reprice(*it->second);
+        }
+    }
+
+    CurrencyExposure exposure(const std::string &currency) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = books.find(currency);
+        return it == books.end() ? CurrencyExposure() : it->second->total;
+    }
+
+    std::vector<std::string> currencies() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<std::string> names;
+        for (const auto &[currency, book] : books)
+        {
+            names.push_back(currency);
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    // Revalues every position under each spot x vol shock. Scenarios are
+    // spread over `threads` workers; each worker reprices whole option chains
+    // with the SIMD kernel.
+    ScenarioGrid scenarios(const std::vector<double> &spotShocks, const std::vector<double> &volShocks,
+                           unsigned threads = std::max(1u, std::thread::hardware_concurrency())) const
+    {
+        std::vector<std::pair<std::string, Book>> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto &[currency, book] : books)
+            {
+                snapshot.emplace_back(currency, *book);
+            }
+        }
+
+        ScenarioGrid grid;
+        grid.spotShocks = spotShocks;
+        grid.volShocks = volShocks;
+        size_t count = spotShocks.size() * volShocks.size();
+        // Resolved before the workers start: they only index these vectors,
+        // never the map, so they write disjoint elements without a lock
+        std::vector<std::vector<double> *> results;
+        for (const auto &[currency, book] : snapshot)
+        {
+            std::vector<double> &pnl = grid.pnl[currency];
+            pnl.assign(count, 0.0);
+            results.push_back(&pnl);
+        }
+
+        std::atomic<size_t> next{0};
+        std::mutex errorMutex;
+        std::exception_ptr error;
+        auto worker = [&]()
+        {
+            try
+            {
+                std::vector<OptionChain> scratch;
+                for (const auto &[currency, book] : snapshot)
+                {
+                    scratch.push_back(book.options);
+                }
+                SimdLevel level = detectSimdLevel();
+                for (size_t scenario = next++; scenario < count; scenario = next++)
+                {
+                    double spotShock = spotShocks[scenario / volShocks.size()];
+                    double volShock = volShocks[scenario % volShocks.size()];
+                    for (size_t b = 0; b < snapshot.size(); ++b)
+                    {
+                        (*results[b])[scenario] = revalue(snapshot[b].second, scratch[b], spotShock, volShock, level);
+                    }
+                }
+            }
+            catch (...)
+            {
+                // Stops the others at their next scenario; rethrown after the joins
+                next = count;
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        };
+
+        threads = static_cast<unsigned>(std::min<size_t>(std::max(1u, threads), std::max<size_t>(count, 1)));
+        std::vector<std::thread> workers;
+        try
+        {
+            for (unsigned i = 1; i < threads; ++i)
+            {
+                workers.emplace_back(worker);
+            }
+        }
+        catch (const std::system_error &)
+        {
+            // Out of threads: the ones already started share the work
+        }
+        worker();
+        for (std::thread &thread : workers)
+        {
+            thread.join();
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        return grid;
+    }
+
+private:
+    struct Book
+    {
+        double spot = 0;
+
+        std::vector<double> futureSize;
+        std::vector<double> futurePrice;
+        std::vector<char> futureInverse;
+        std::vector<CurrencyExposure> futureContribution;
+
+        OptionChain options; // marketPrice stays 0: options are priced at their last IV
+        std::vector<double> optionSize;
+        std::vector<std::time_t> optionExpiry;
+        std::vector<char> optionCoinSettled;
+        std::vector<CurrencyExposure> optionContribution;
+
+        CurrencyExposure total;
+    };
+
+    struct Entry
+    {
+        Book *book = nullptr;
+        bool option = false;
+        size_t index = 0;
+    };
+
+    MarginModel margin;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Book>> books;
+    std::unordered_map<std::string, Entry> entries;
+
+    static std::string underlyingOf(const std::string &instrument)
+    {
+        return instrument.substr(0, instrument.find_first_of("-_"));
+    }
+
+    static double yearsUntil(std::time_t expiry, std::time_t now)
+    {
+        return std::max(0.0, static_cast<double>(expiry - now)) / (365.0 * 86400);
+    }
+
+    // Finds or adds an instrument; names that are neither options nor futures are ignored
+    Entry find(const std::string &instrument)
+    {
+        auto it = entries.find(instrument);
+        if (it != entries.end())
+        {
+            return it->second;
+        }
+        std::unique_ptr<Book> &slot = books[underlyingOf(instrument)];
+        if (!slot)
+        {
+            slot = std::make_unique<Book>();
+        }
+        Book &book = *slot;
+        Entry entry;
+        entry.book = &book;
+
+        std::time_t expiry;
+        double strike;
+        bool call;
+        if (parseOptionName(instrument, expiry, strike, call))
+        {
+            entry.option = true;
+            entry.index = book.options.add(book.spot > 0 ? book.spot : strike, strike, yearsUntil(expiry, std::time(nullptr)), call, 0, 0.5);
+            book.optionSize.push_back(0);
+            book.optionExpiry.push_back(expiry);
+            book.optionCoinSettled.push_back(instrument.find('_') == std::string::npos);
+            book.optionContribution.emplace_back();
+        }
+        else
+        {
+            entry.index = book.futureSize.size();
+            book.futureSize.push_back(0);
+            book.futurePrice.push_back(0);
+            book.futureInverse.push_back(isInverseInstrument(instrument));
+            book.futureContribution.emplace_back();
+        }
+        entries.emplace(instrument, entry);
+        return entry;
+    }
+
+    void updateFuture(Book &book, size_t i, double size, double markPrice)
+    {
+        book.futureSize[i] = size;
+        if (markPrice > 0)
+        {
+            book.futurePrice[i] = markPrice;
+        }
+        book.total -= book.futureContribution[i];
+        book.futureContribution[i] = futureExposure(book, i);
+        book.total += book.futureContribution[i];
+    }
+
+    void updateOption(Book &book, size_t i, double size, double markPrice)
+    {
+        OptionChain &chain = book.options;
+        book.optionSize[i] = size;
+        if (markPrice > 0 && book.spot > 0)
+        {
+            // Solve the option's IV from its mark, then keep pricing at that vol
+            chain.marketPrice[i] = book.optionCoinSettled[i] ? markPrice * book.spot : markPrice;
+            evaluateOption(chain, i);
+            if (std::isfinite(chain.impliedVol[i]))
+            {
+                chain.volatility[i] = chain.impliedVol[i];
+            }
+            chain.marketPrice[i] = 0;
+        }
+        evaluateOption(chain, i);
+        book.total -= book.optionContribution[i];
+        book.optionContribution[i] = optionExposure(book, i);
+        book.total += book.optionContribution[i];
+    }
+
+    // Full recompute of one currency after its underlying moved
+    void reprice(Book &book)
+    {
+        std::time_t now = std::time(nullptr);
+        OptionChain &chain = book.options;
+        for (size_t i = 0; i < chain.size(); ++i)
+        {
+            chain.forward[i] = book.spot;
+            chain.expiry[i] = yearsUntil(book.optionExpiry[i], now);
+        }
+        evaluateChain(chain);
+
+        book.total = CurrencyExposure();
+        for (size_t i = 0; i < book.futureSize.size(); ++i)
+        {
+            book.futureContribution[i] = futureExposure(book, i);
+            book.total += book.futureContribution[i];
+        }
+        for (size_t i = 0; i < chain.size(); ++i)
+        {
+            book.optionContribution[i] = optionExposure(book, i);
+            book.total += book.optionContribution[i];
+        }
+    }
+
+    CurrencyExposure futureExposure(const Book &book, size_t i) const
+    {
+        CurrencyExposure exposure;
+        double size = book.futureSize[i];
+        double price = book.futurePrice[i] > 0 ? book.futurePrice[i] : book.spot;
+        if (size == 0 || !(price > 0))
+        {
+            return exposure;
+        }
+        // Inverse contracts are sized in USD, linear ones in the coin
+        exposure.delta = book.futureInverse[i] ? size / price : size;
+        exposure.notional = book.futureInverse[i] ? std::fabs(size) : std::fabs(size) * price;
+        exposure.margin = exposure.notional * margin.futureRate;
+        exposure.positions = 1;
+        return exposure;
+    }
+
+    CurrencyExposure optionExposure(const Book &book, size_t i) const
+    {
+        CurrencyExposure exposure;
+        const OptionChain &chain = book.options;
+        double size = book.optionSize[i];
+        if (size == 0 || !(book.spot > 0))
+        {
+            return exposure;
+        }
+        double forward = chain.forward[i];
+        double price = chain.price[i];
+        // A coin-settled premium is itself a coin exposure, which offsets the delta
+        double premiumDelta = book.optionCoinSettled[i] ? price / forward : 0;
+        exposure.delta = size * (chain.delta[i] - premiumDelta);
+        exposure.gamma = size * chain.gamma[i];
+        exposure.vega = size * chain.vega[i] / 100;
+        exposure.theta = size * chain.theta[i] / 365;
+        exposure.notional = std::fabs(size) * forward;
+        double outOfMoney = std::max(0.0, chain.callPut[i] * (chain.strike[i] - forward));
+        exposure.margin = size > 0 ? size * price
+                                   : -size * (std::max(margin.shortOptionBase - outOfMoney / forward, margin.shortOptionMinimum) * forward + price);
+        exposure.positions = 1;
+        return exposure;
+    }
+
+    // PnL of one currency under a shock; scratch is a worker-owned copy of the option chain
+    static double revalue(const Book &book, OptionChain &scratch, double spotShock, double volShock, SimdLevel level)
+    {
+        double pnl = 0;
+        for (size_t i = 0; i < book.futureSize.size(); ++i)
+        {
+            double price = book.futurePrice[i] > 0 ? book.futurePrice[i] : book.spot;
+            pnl += book.futureInverse[i] ? book.futureSize[i] * spotShock : book.futureSize[i] * price * spotShock;
+        }
+        const OptionChain &base = book.options;
+        if (base.size() == 0)
+        {
+            return pnl;
+        }
+        for (size_t i = 0; i < base.forward.size(); ++i)
+        {
+            scratch.forward[i] = base.forward[i] * (1 + spotShock);
+            scratch.volatility[i] = std::max(0.01, base.volatility[i] + volShock);
+        }
+        evaluateChain(scratch, level);
+        for (size_t i = 0; i < base.size(); ++i)
+        {
+            pnl += book.optionSize[i] * (scratch.price[i] - base.price[i]);
+        }
+        return pnl;
+    }
+};
@@ -0,0 +1,467 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "include/json.hpp"
+#include "latency.hpp"
+
+// Inverse futures/perpetuals (BTC-PERPETUAL) are sized in USD and settle PnL
+// in the coin; options and linear instruments (ETH_USDC-PERPETUAL) are sized
+// in the base coin and settle in the quote
+inline bool isInverseInstrument(const std::string &instrument)
+{
+    bool option = instrument.size() > 2 && (instrument.compare(instrument.size() - 2, 2, "-C") == 0 ||
+                                             instrument.compare(instrument.size() - 2, 2, "-P") == 0);
+    return !option && instrument.find('_') == std::string::npos;
+}
+
+// Splits a Deribit option name (BTC-27DEC24-60000-C) into expiry, strike and type
+inline bool parseOptionName(const std::string &name, std::time_t &expiry, double &strike, bool &call)
+{
+    size_t first = name.find('-');
+    size_t second = name.find('-', first + 1);
+    size_t third = name.find('-', second + 1);
+    if (first == std::string::npos || second == std::string::npos || third == std::string::npos || third + 2 != name.size())
+    {
+        return false;
+    }
+    std::tm date{};
+    std::string expiryText = name.substr(first + 1, second - first - 1);
+    std::string strikeText = name.substr(second + 1, third - second - 1);
+    char *strikeEnd = nullptr;
+    strike = std::strtod(strikeText.c_str(), &strikeEnd);
+    if (!strptime(expiryText.c_str(), "%d%b%y", &date) || strikeEnd == strikeText.c_str() || *strikeEnd != '\0')
+    {
+        return false;
+    }
+    date.tm_hour = 8; // Deribit options expire at 08:00 UTC
+    expiry = timegm(&date);
+    call = name[third + 1] == 'C';
+    return true;
+}
+
+// A consistent view of one instrument's position
+struct PositionSnapshot
+{
+    double size = 0; // signed: positive is long
+    double averagePrice = 0;
+    double realizedPnl = 0;
+    double floatingPnl = 0;
+    double fees = 0;
+    double markPrice = 0;
+    double indexPrice = 0;
+    int64_t updatedNs = 0;
+};
+
+// Account summary for one currency, as last fetched by the reconciler
+struct PortfolioSnapshot
+{
+    double equity = 0;
+    double balance = 0;
+    double availableFunds = 0;
+    double initialMargin = 0;
+    double maintenanceMargin = 0;
+    double totalPnl = 0;
+    double deltaTotal = 0;
+    int64_t updatedNs = 0;
+};
+
+// In-process position keeper.
+//
+// Positions, average entry price and realized PnL are updated incrementally
+// from fills (the trades array of an order response), and marks from order
+// book and ticker requests, so exposure is known without a REST round-trip.
+// The exchange's own numbers (private/get_positions and
+// private/get_account_summary) are only used to reconcile periodically.
+//
+// Updates are serialised by a mutex; readers never lock. Each instrument slot
+// is a seqlock: a query copies the fields and retries if a writer was active,
+// so position(id) costs a few loads.
+class PositionKeeper
+{
+public:
+    static constexpr size_t kMaxInstruments = 8192;
+    static constexpr size_t kMaxCurrencies = 64;
+
+    PositionKeeper() : slots(new Slot[kMaxInstruments]), accounts(new Account[kMaxCurrencies]) {}
+
+    // Returns the instrument's slot id, registering it on first use
+    int instrumentId(const std::string &instrument)
+    {
+        {
+            std::shared_lock<std::shared_mutex> lock(namesMutex);
+            auto it = instrumentIds.find(instrument);
+            if (it != instrumentIds.end())
+            {
+                return it->second;
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(namesMutex);
+        auto it = instrumentIds.find(instrument);
+        if (it != instrumentIds.end())
+        {
+            return it->second;
+        }
+        if (instrumentCount == kMaxInstruments)
+        {
+            return -1;
+        }
+        int id = static_cast<int>(instrumentCount++);
+        slots[id].inverse = isInverseInstrument(instrument);
+        instrumentIds.emplace(instrument, id);
+        return id;
+    }
+
+    // Returns -1 if the instrument has never been seen
+    int findInstrument(const std::string &instrument) const
+    {
+        std::shared_lock<std::shared_mutex> lock(namesMutex);
+        auto it = instrumentIds.find(instrument);
+        return it == instrumentIds.end() ? -1 : it->second;
+    }
+
+    // Applies an array of fills. The same trade can be reported by more than
+    // one order response and by the trade poll, so trades are de-duplicated
+    // by trade_id.
+    void onTrades(const nlohmann::json &trades)
+    {
+        if (!trades.is_array())
+        {
+            return;
+        }
+        for (const nlohmann::json &trade : trades)
+        {
+            onTrade(trade);
+        }
+    }
+
+    // Returns false if the trade was malformed, untracked or already applied
+    bool onTrade(const nlohmann::json &trade)
+    {
+        std::string tradeId = trade.value("trade_id", "");
+        double amount = trade.value("amount", 0.0);
+        double price = trade.value("price", 0.0);
+        if (!(amount > 0) || !(price > 0))
+        {
+            return false;
+        }
+        int id = instrumentId(trade.value("instrument_name", ""));
+        if (id < 0)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (!tradeId.empty() && !rememberTrade(tradeId))
+        {
+            return false;
+        }
+        Slot &slot = slots[id];
+        beginWrite(slot);
+        applyFill(slot, trade.value("direction", "") == "sell" ? -amount : amount, price);
+        if (trade.contains("fee") && trade["fee"].is_number())
+        {
+            store(slot.fees, load(slot.fees) + trade["fee"].get<double>());
+        }
+        if (trade.contains("mark_price") && trade["mark_price"].is_number())
+        {
+            store(slot.markPrice, trade["mark_price"].get<double>());
+        }
+        store(slot.updatedNs, nowNanos());
+        endWrite(slot);
+        return true;
+    }
+
+    void updateMark(const std::string &instrument, double markPrice, double indexPrice = 0)
+    {
+        if (!(markPrice > 0))
+        {
+            return;
+        }
+        int id = instrumentId(instrument);
+        if (id < 0)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(writeMutex);
+        Slot &slot = slots[id];
+        beginWrite(slot);
+        store(slot.markPrice, markPrice);
+        if (indexPrice > 0)
+        {
+            store(slot.indexPrice, indexPrice);
+        }
+        endWrite(slot);
+    }
+
+    // Stores a private/get_account_summary result for its currency
+    void onAccountSummary(const nlohmann::json &portfolio)
+    {
+        int id = currencyId(portfolio.value("currency", ""));
+        if (id < 0)
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(writeMutex);
+        Account &account = accounts[id];
+        account.seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        store(account.equity, portfolio.value("equity", 0.0));
+        store(account.balance, portfolio.value("balance", 0.0));
+        store(account.availableFunds, portfolio.value("available_funds", 0.0));
+        store(account.initialMargin, portfolio.value("initial_margin", 0.0));
+        store(account.maintenanceMargin, portfolio.value("maintenance_margin", 0.0));
+        store(account.totalPnl, portfolio.value("total_pl", 0.0));
+        store(account.deltaTotal, portfolio.value("delta_total", 0.0));
+        store(account.updatedNs, nowNanos());
+        account.seq.fetch_add(1, std::memory_order_release);
+    }
+
+    // Overwrites the local position with the exchange's (a private/get_position
+    // result) and returns how far the local size had drifted from it
+    double reconcile(const nlohmann::json &position)
+    {
+        int id = instrumentId(position.value("instrument_name", ""));
+        if (id < 0)
+        {
+            return 0;
+        }
+        std::lock_guard<std::mutex> lock(writeMutex);
+        Slot &slot = slots[id];
+        double drift = load(slot.size) - position.value("size", 0.0);
+        beginWrite(slot);
+        store(slot.size, position.value("size", 0.0));
+        store(slot.averagePrice, position.value("average_price", 0.0));
+        store(slot.realizedPnl, position.value("realized_profit_loss", load(slot.realizedPnl)));
+        double markPrice = position.value("mark_price", 0.0);
+        if (markPrice > 0)
+        {
+            store(slot.markPrice, markPrice);
+        }
+        double indexPrice = position.value("index_price", 0.0);
+        if (indexPrice > 0)
+        {
+            store(slot.indexPrice, indexPrice);
+        }
+        store(slot.updatedNs, nowNanos());
+        endWrite(slot);
+        return drift;
+    }
+
+    // Lock-free read of one position, with floating PnL at the latest mark
+    PositionSnapshot position(int id) const
+    {
+        PositionSnapshot snapshot;
+        if (id < 0 || static_cast<size_t>(id) >= kMaxInstruments)
+        {
+            return snapshot;
+        }
+        const Slot &slot = slots[id];
+        uint32_t before;
+        do
+        {
+            before = slot.seq.load(std::memory_order_acquire);
+            snapshot.size = load(slot.size);
+            snapshot.averagePrice = load(slot.averagePrice);
+            snapshot.realizedPnl = load(slot.realizedPnl);
+            snapshot.fees = load(slot.fees);
+            snapshot.markPrice = load(slot.markPrice);
+            snapshot.indexPrice = load(slot.indexPrice);
+            snapshot.updatedNs = slot.updatedNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((before & 1) || before != slot.seq.load(std::memory_order_relaxed));
+        snapshot.floatingPnl = pnl(slot.inverse, snapshot.size, snapshot.averagePrice, snapshot.markPrice);
+        return snapshot;
+    }
+
+    PositionSnapshot position(const std::string &instrument) const
+    {
+        return position(findInstrument(instrument));
+    }
+
+    PortfolioSnapshot portfolio(const std::string &currency) const
+    {
+        PortfolioSnapshot snapshot;
+        int id;
+        {
+            std::shared_lock<std::shared_mutex> lock(namesMutex);
+            auto it = currencyIds.find(currency);
+            if (it == currencyIds.end())
+            {
+                return snapshot;
+            }
+            id = it->second;
+        }
+        const Account &account = accounts[id];
+        uint32_t before;
+        do
+        {
+            before = account.seq.load(std::memory_order_acquire);
+            snapshot.equity = load(account.equity);
+            snapshot.balance = load(account.balance);
+            snapshot.availableFunds = load(account.availableFunds);
+            snapshot.initialMargin = load(account.initialMargin);
+            snapshot.maintenanceMargin = load(account.maintenanceMargin);
+            snapshot.totalPnl = load(account.totalPnl);
+            snapshot.deltaTotal = load(account.deltaTotal);
+            snapshot.updatedNs = account.updatedNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((before & 1) || before != account.seq.load(std::memory_order_relaxed));
+        return snapshot;
+    }
+
+    // PnL of a position of `size` entered at averagePrice and valued at price:
+    // in the coin for inverse instruments, in the quote for everything else
+    static double pnl(bool inverse, double size, double averagePrice, double price)
+    {
+        if (size == 0 || !(averagePrice > 0) || !(price > 0))
+        {
+            return 0;
+        }
+        return inverse ? size * (1 / averagePrice - 1 / price) : size * (price - averagePrice);
+    }
+
+private:
+    static constexpr size_t kRememberedTrades = 4096;
+
+    // Fields are relaxed atomics so concurrent reads are well-defined; the
+    // sequence counter is what makes a snapshot consistent
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> seq{0};
+        bool inverse = true;
+        std::atomic<double> size{0};
+        std::atomic<double> averagePrice{0};
+        std::atomic<double> realizedPnl{0};
+        std::atomic<double> fees{0};
+        std::atomic<double> markPrice{0};
+        std::atomic<double> indexPrice{0};
+        std::atomic<int64_t> updatedNs{0};
+    };
+
+    struct alignas(64) Account
+    {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<double> equity{0};
+        std::atomic<double> balance{0};
+        std::atomic<double> availableFunds{0};
+        std::atomic<double> initialMargin{0};
+        std::atomic<double> maintenanceMargin{0};
+        std::atomic<double> totalPnl{0};
+        std::atomic<double> deltaTotal{0};
+        std::atomic<int64_t> updatedNs{0};
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::unique_ptr<Account[]> accounts;
+    size_t instrumentCount = 0;
+    size_t currencyCount = 0;
+    mutable std::shared_mutex namesMutex;
+    std::unordered_map<std::string, int> instrumentIds;
+    std::unordered_map<std::string, int> currencyIds;
+
+    std::mutex writeMutex;
+    std::unordered_set<std::string> seenTrades;
+    std::deque<std::string> tradeOrder;
+
+    template <typename T>
+    static T load(const std::atomic<T> &field)
+    {
+        return field.load(std::memory_order_relaxed);
+    }
+
+    template <typename T>
+    static void store(std::atomic<T> &field, T value)
+    {
+        field.store(value, std::memory_order_relaxed);
+    }
+
+    static void beginWrite(Slot &slot)
+    {
+        slot.seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void endWrite(Slot &slot)
+    {
+        slot.seq.fetch_add(1, std::memory_order_release);
+    }
+
+    int currencyId(const std::string &currency)
+    {
+        if (currency.empty())
+        {
+            return -1;
+        }
+        std::unique_lock<std::shared_mutex> lock(namesMutex);
+        auto it = currencyIds.find(currency);
+        if (it != currencyIds.end())
+        {
+            return it->second;
+        }
+        if (currencyCount == kMaxCurrencies)
+        {
+            return -1;
+        }
+        int id = static_cast<int>(currencyCount++);
+        currencyIds.emplace(currency, id);
+        return id;
+    }
+
+    // Returns false if the trade was already applied
+    bool rememberTrade(const std::string &tradeId)
+    {
+        if (!seenTrades.insert(tradeId).second)
+        {
+            return false;
+        }
+        tradeOrder.push_back(tradeId);
+        if (tradeOrder.size() > kRememberedTrades)
+        {
+            seenTrades.erase(tradeOrder.front());
+            tradeOrder.pop_front();
+        }
+        return true;
+    }
+
+    // Adds a signed fill to the position. The part that reduces the position
+    // realizes PnL against the average price; the part that extends (or flips)
+    // it moves the average, which for inverse instruments is the harmonic mean.
+    static void applyFill(Slot &slot, double quantity, double price)
+    {
+        double size = load(slot.size);
+        double averagePrice = load(slot.averagePrice);
+        double closing = 0;
+        if (size * quantity < 0)
+        {
+            closing = std::copysign(std::min(std::fabs(size), std::fabs(quantity)), quantity);
+            store(slot.realizedPnl, load(slot.realizedPnl) + pnl(slot.inverse, -closing, averagePrice, price));
+        }
+        double opening = quantity - closing;
+        double newSize = size + quantity;
+        if (std::fabs(newSize) < 1e-12)
+        {
+            newSize = 0;
+            averagePrice = 0;
+        }
+        else if (opening != 0)
+        {
+            double held = std::fabs(size + closing);
+            double added = std::fabs(opening);
+            averagePrice = slot.inverse ? (held + added) / (held / (held > 0 ? averagePrice : 1) + added / price)
+                                        : (held * averagePrice + added * price) / (held + added);
+        }
+        store(slot.size, newSize);
+        store(slot.averagePrice, averagePrice);
+    }
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "risk.hpp"
+
+// One price level of a quote ladder: the size that should rest at a price
+struct QuoteLevel
+{
+    double price;
+    double amount;
+};
+
+// The quotes wanted on one instrument, best price first on each side
+struct QuoteLadder
+{
+    std::vector<QuoteLevel> bids;
+    std::vector<QuoteLevel> asks;
+};
+
+// A quote resting on the exchange; amount is what is left to fill
+struct LiveQuote
+{
+    std::string orderId;
+    std::string instrument;
+    Side side;
+    double price;
+    double amount;
+};
+
+enum class QuoteActionType : uint8_t
+{
+    New,
+    Edit,
+    Cancel
+};
+
+// One request needed to turn the live quotes into the target ladder.
+// Edits and cancels refer to orderId; news and edits carry the new price and
+// the size that should rest after the request.
+struct QuoteAction
+{
+    QuoteActionType type;
+    std::string instrument;
+    Side side;
+    std::string orderId;
+    double price;
+    double amount;
+};
+
+struct QuoteDiffOptions
+{
+    double priceTolerance = 0;  // a live quote this close to a target price is left alone
+    double amountTolerance = 0; // same for size
+};
+
+// Computes the fewest requests that move `live` (quotes on `instrument`) to
+// `target`. Per side:
+//   1. live quotes that already match a target level (within tolerance) are kept;
+//   2. a target level with a live quote at the same price becomes a size-only edit;
+//   3. other unmatched levels and quotes are paired best price first into edits;
+//   4. levels left over are new orders and quotes left over are cancelled.
+// Edits are preferred to cancel + new: they take one request instead of two.
+// Cancels come first in the result, so they can free risk headroom.
+inline std::vector<QuoteAction> diffQuotes(const std::string &instrument, const QuoteLadder &target, const std::vector<LiveQuote> &live,
+                                           const QuoteDiffOptions &options = QuoteDiffOptions())
+{
+    auto near = [](double a, double b, double tolerance)
+    { return std::fabs(a - b) <= tolerance + 1e-9 * std::max(1.0, std::fabs(b)); };
+
+    std::vector<QuoteAction> cancels, edits, news;
+    for (Side side : {Side::Buy, Side::Sell})
+    {
+        const std::vector<QuoteLevel> &levels = side == Side::Buy ? target.bids : target.asks;
+        std::vector<const LiveQuote *> resting;
+        for (const LiveQuote &quote : live)
+        {
+            if (quote.side == side && quote.instrument == instrument)
+            {
+                resting.push_back(&quote);
+            }
+        }
+        std::vector<char> levelDone(levels.size(), 0);
+        std::vector<char> restingDone(resting.size(), 0);
+
+        // 1. Already where they should be
+        for (size_t t = 0; t < levels.size(); ++t)
+        {
+            for (size_t r = 0; r < resting.size(); ++r)
+            {
+                if (!restingDone[r] && near(resting[r]->price, levels[t].price, options.priceTolerance) &&
+                    near(resting[r]->amount, levels[t].amount, options.amountTolerance))
+                {
+                    levelDone[t] = restingDone[r] = 1;
+                    break;
+                }
+            }
+        }
+
+        // 2. Right price, wrong size
+        for (size_t t = 0; t < levels.size(); ++t)
+        {
+            for (size_t r = 0; !levelDone[t] && r < resting.size(); ++r)
+            {
+                if (!restingDone[r] && near(resting[r]->price, levels[t].price, options.priceTolerance))
+                {
+                    edits.push_back({QuoteActionType::Edit, instrument, side, resting[r]->orderId, resting[r]->price, levels[t].amount});
+                    levelDone[t] = restingDone[r] = 1;
+                }
+            }
+        }
+
+        // 3. Move the remaining quotes onto the remaining levels, best price first
+        std::vector<size_t> openLevels, openResting;
+        for (size_t t = 0; t < levels.size(); ++t)
+        {
+            if (!levelDone[t])
+            {
+                openLevels.push_back(t);
+            }
+        }
+        for (size_t r = 0; r < resting.size(); ++r)
+        {
+            if (!restingDone[r])
+            {
+                openResting.push_back(r);
+            }
+        }
+        double sign = side == Side::Buy ? -1 : 1;
+        std::sort(openLevels.begin(), openLevels.end(), [&](size_t a, size_t b)
+                  { return sign * levels[a].price < sign * levels[b].price; });
+        std::sort(openResting.begin(), openResting.end(), [&](size_t a, size_t b)
+                  { return sign * resting[a]->price < sign * resting[b]->price; });
+        size_t paired = std::min(openLevels.size(), openResting.size());
+        for (size_t i = 0; i < paired; ++i)
+        {
+            const QuoteLevel &level = levels[openLevels[i]];
+            edits.push_back({QuoteActionType::Edit, instrument, side, resting[openResting[i]]->orderId, level.price, level.amount});
+        }
+
+        // 4. Leftovers
+        for (size_t i = paired; i < openLevels.size(); ++i)
+        {
+            const QuoteLevel &level = levels[openLevels[i]];
+            news.push_back({QuoteActionType::New, instrument, side, "", level.price, level.amount});
+        }
+        for (size_t i = paired; i < openResting.size(); ++i)
+        {
+            const LiveQuote &quote = *resting[openResting[i]];
+            cancels.push_back({QuoteActionType::Cancel, instrument, side, quote.orderId, quote.price, quote.amount});
+        }
+    }
+
+    std::vector<QuoteAction> actions = std::move(cancels);
+    actions.insert(actions.end(), edits.begin(), edits.end());
+    actions.insert(actions.end(), news.begin(), news.end());
+    return actions;
+}
+
+// Returns the ladder to quote on an instrument; returning false pulls every
+// quote on it (no price, stale data, risk off)
+using QuotePricer = std::function<bool(const std::string &instrument, QuoteLadder &ladder)>;
+
+// Running totals of what the engine sent, against a naive cancel-and-replace
+// of every quote on every tick
+struct QuoteEngineStats
+{
+    uint64_t ticks = 0;
+    uint64_t kept = 0;
+    uint64_t edits = 0;
+    uint64_t news = 0;
+    uint64_t cancels = 0;
+    uint64_t naiveRequests = 0;
+
+    uint64_t requests() const
+    {
+        return edits + news + cancels;
+    }
+};
+
+// Automated quoting: on every tick asks the pricer for each instrument's
+// ladder and diffs it against the quotes resting there. The engine only
+// plans; the caller sends the actions and reports the resulting live quotes
+// on the next tick.
+class QuoteEngine
+{
+public:
+    QuoteEngine(std::vector<std::string> instruments, QuotePricer pricer, QuoteDiffOptions options = QuoteDiffOptions())
+        : instruments(std::move(instruments)), pricer(std::move(pricer)), options(options)
+    {
+    }
+
+    // Plans one tick. `live` holds every quote the engine owns, on any instrument.
+    std::vector<QuoteAction> tick(const std::vector<LiveQuote> &live)
+    {
+        std::unordered_map<std::string, std::vector<LiveQuote>> byInstrument;
+        for (const LiveQuote &quote : live)
+        {
+            byInstrument[quote.instrument].push_back(quote);
+        }
+
+        std::vector<QuoteAction> actions;
+        for (const std::string &instrument : instruments)
+        {
+            const std::vector<LiveQuote> &resting = byInstrument[instrument];
+            QuoteLadder ladder;
+            if (!pricer(instrument, ladder))
+            {
+                ladder = QuoteLadder();
+            }
+            std::vector<QuoteAction> planned = diffQuotes(instrument, ladder, resting, options);
+            size_t targets = ladder.bids.size() + ladder.asks.size();
+            stats.naiveRequests += resting.size() + targets;
+            size_t changed = 0;
+            for (const QuoteAction &action : planned)
+            {
+                stats.edits += action.type == QuoteActionType::Edit;
+                stats.news += action.type == QuoteActionType::New;
+                stats.cancels += action.type == QuoteActionType::Cancel;
+                changed += action.type != QuoteActionType::Cancel;
+            }
+            stats.kept += targets - changed;
+            actions.insert(actions.end(), planned.begin(), planned.end());
+        }
+        // Quotes on instruments the engine no longer trades are pulled
+        for (const auto &[instrument, resting] : byInstrument)
+        {
+            if (std::find(instruments.begin(), instruments.end(), instrument) == instruments.end())
+            {
+                for (const LiveQuote &quote : resting)
+                {
+                    actions.push_back({QuoteActionType::Cancel, instrument, quote.side, quote.orderId, quote.price, quote.amount});
+                    ++stats.cancels;
+                    ++stats.naiveRequests;
+                }
+            }
+        }
+        ++stats.ticks;
+        return actions;
+    }
+
+    const QuoteEngineStats &getStats() const
+    {
+        return stats;
+    }
+
+private:
+    std::vector<std::string> instruments;
+    QuotePricer pricer;
+    QuoteDiffOptions options;
+    QuoteEngineStats stats;
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Deribit charges every request credits from a per-account pool that refills
+// continuously. Matching-engine requests (buy/sell/edit/cancel...) and all
+// other requests are metered separately.
+enum class RequestClass : uint8_t
+{
+    MatchingEngine,
+    NonMatching,
+    Count
+};
+
+// Cancels are served ahead of new orders and modifications
+enum class RequestPriority : uint8_t
+{
+    Cancel,
+    Normal,
+    Count
+};
+
+struct CreditRule
+{
+    double maxCredits;      // bucket size (burst)
+    double refillPerSecond; // credits added per second
+    double cost;            // credits charged per request
+    double cancelReserve;   // credits normal requests must leave for cancels
+};
+
+// Token-bucket model of the exchange's credit throttling, so we queue or
+// reject locally with predictable timing instead of sending a request that
+// the exchange will bounce with "too_many_requests" a full round-trip later.
+//
+// Each request class has one bucket and two FIFO lanes. A normal request may
+// only take credits when no cancel is waiting and when it leaves
+// cancelReserve credits behind, so a cancel can always go out immediately.
+class CreditRateLimiter
+{
+public:
+    // Defaults follow Deribit's documented non-matching pool (50k credits,
+    // 10k/s refill, 500 per request) and a conservative matching-engine tier
+    // (burst 20, 5 requests/s).
+    CreditRateLimiter()
+        : CreditRateLimiter({CreditRule{20 * 500.0, 5 * 500.0, 500.0, 500.0},
+                             CreditRule{50000.0, 10000.0, 500.0, 0.0}}) {}
+
+    // Throws std::invalid_argument if a rule fails validate()
+    explicit CreditRateLimiter(const std::array<CreditRule, static_cast<size_t>(RequestClass::Count)> &rules)
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < buckets.size(); ++i)
+        {
+            std::string error = validate(rules[i]);
+            if (!error.empty())
+            {
+                throw std::invalid_argument(std::string(i == 0 ? "matching-engine" : "non-matching") + " rate limit: " + error);
+            }
+            buckets[i].rule = rules[i];
+            buckets[i].credits = rules[i].maxCredits;
+            buckets[i].updated = now;
+        }
+    }
+
+    // Empty if the rule can admit requests. The wait times divide by the
+    // refill rate, and a bucket smaller than one request plus the cancel
+    // reserve would never admit a normal request.
+    static std::string validate(const CreditRule &rule)
+    {
+        if (!(rule.refillPerSecond > 0) || !std::isfinite(rule.refillPerSecond))
+        {
+            return "refill rate must be positive";
+        }
+        if (!(rule.cost > 0) || !(rule.cancelReserve >= 0))
+        {
+            return "request cost must be positive and the cancel reserve not negative";
+        }
+        if (!(rule.maxCredits >= rule.cost + rule.cancelReserve))
+        {
+            std::ostringstream error;
+            error << "burst of " << rule.maxCredits << " credits is below one request (" << rule.cost << ") plus the cancel reserve ("
+                  << rule.cancelReserve << ")";
+            return error.str();
+        }
+        return "";
+    }
+
+    // Takes credits for one request, waiting at most maxWait for them.
+    // Returns false (without consuming anything) if the request could not be
+    // admitted in time; maxWait of zero makes this a pure non-blocking check.
+    bool acquire(RequestClass requestClass, RequestPriority priority,
+                 std::chrono::nanoseconds maxWait = std::chrono::nanoseconds::zero())
+    {
+        auto deadline = std::chrono::steady_clock::now() + maxWait;
+        Bucket &bucket = buckets[static_cast<size_t>(requestClass)];
+        auto &lane = bucket.lanes[static_cast<size_t>(priority)];
+
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t ticket = nextTicket++;
+        lane.push_back(ticket);
+
+        while (true)
+        {
+            auto now = std::chrono::steady_clock::now();
+            refill(bucket, now);
+            double needed = requiredCredits(bucket, priority);
+            if (isTurn(bucket, priority, ticket) && bucket.credits >= needed)
+            {
+                bucket.credits -= bucket.rule.cost;
+                lane.pop_front();
+                changed.notify_all();
+                return true;
+            }
+
+            // Waiters behind another request sleep until something changes; the
+            // head of the lane sleeps until its credits will have refilled.
+            auto wakeAt = deadline;
+            if (isTurn(bucket, priority, ticket))
+            {
+                wakeAt = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                   std::chrono::duration<double>((needed - bucket.credits) / bucket.rule.refillPerSecond));
+            }
+            if (wakeAt > deadline || now >= deadline)
+            {
+                lane.erase(std::find(lane.begin(), lane.end(), ticket));
+                changed.notify_all();
+                return false;
+            }
+            changed.wait_until(lock, wakeAt);
+        }
+    }
+
+    // Time until a request of this class and priority could be admitted if
+    // it were the only one waiting
+    std::chrono::nanoseconds estimatedWait(RequestClass requestClass, RequestPriority priority)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Bucket &bucket = buckets[static_cast<size_t>(requestClass)];
+        refill(bucket, std::chrono::steady_clock::now());
+        double missing = std::max(0.0, requiredCredits(bucket, priority) - bucket.credits);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(missing / bucket.rule.refillPerSecond));
+    }
+
+    // Resynchronises with the exchange after a too_many_requests rejection
+    void drain(RequestClass requestClass)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        buckets[static_cast<size_t>(requestClass)].credits = 0;
+    }
+
+private:
+    struct Bucket
+    {
+        CreditRule rule;
+        double credits = 0;
+        std::chrono::steady_clock::time_point updated;
+        std::array<std::deque<uint64_t>, static_cast<size_t>(RequestPriority::Count)> lanes;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::array<Bucket, static_cast<size_t>(RequestClass::Count)> buckets;
+    uint64_t nextTicket = 0;
+
+    static void refill(Bucket &bucket, std::chrono::steady_clock::time_point now)
+    {
+        double elapsed = std::chrono::duration<double>(now - bucket.updated).count();
+        bucket.credits = std::min(bucket.rule.maxCredits, bucket.credits + elapsed * bucket.rule.refillPerSecond);
+        bucket.updated = now;
+    }
+
+    static double requiredCredits(const Bucket &bucket, RequestPriority priority)
+    {
+        return priority == RequestPriority::Cancel ? bucket.rule.cost : bucket.rule.cost + bucket.rule.cancelReserve;
+    }
+
+    static bool isTurn(const Bucket &bucket, RequestPriority priority, uint64_t ticket)
+    {
+        const auto &lane = bucket.lanes[static_cast<size_t>(priority)];
+        if (lane.front() != ticket)
+        {
+            return false;
+        }
+        return priority == RequestPriority::Cancel || bucket.lanes[static_cast<size_t>(RequestPriority::Cancel)].empty();
+    }
+};
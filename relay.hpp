@@ -0,0 +1,665 @@
+#pragma once
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "feed_handler.hpp"
+#include "ring_buffer.hpp"
+
+// Relay tier. A root server holds the upstream feed and streams normalized
+// updates to edge servers over TCP or a Unix socket; every edge runs its own
+// WebSocketServer and treats the root as its market data source, so clients
+// are spread over several processes and the upstream connection stays single.
+//
+// Edges send the root the symbols they want (their SubscriptionManager's
+// upstream set) and get only those. With RELAY_SHARD each edge also serves
+// a fixed share of the symbols, chosen by relayShardOf.
+//
+// Stream: frames of uint32 payload length | uint8 type | payload, in host
+// byte order (root and edges run the same build). An update payload is the
+// MarketUpdate up to its level arrays followed by the bidCount and askCount
+// levels actually used, so a ticker or trade costs a fraction of the struct.
+// Subscribe and unsubscribe payloads are newline-separated symbols.
+
+constexpr uint8_t kRelayUpdate = 1;
+constexpr uint8_t kRelaySubscribe = 2;
+constexpr uint8_t kRelayUnsubscribe = 3;
+constexpr size_t kRelayFrameHeader = 5;
+constexpr size_t kRelayUpdatePrefix = offsetof(MarketUpdate, bids);
+constexpr uint32_t kRelayMaxPayload = 1 << 20;
+
+// Stable across processes and builds (unlike std::hash), so every edge and
+// every client agrees on which shard serves a symbol
+inline int relayShardOf(std::string_view symbol, int shards)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (char c : symbol)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return shards > 1 ? static_cast<int>(hash % static_cast<uint32_t>(shards)) : 0;
+}
+
+inline void appendRelayFrame(std::string &out, uint8_t type, const char *data, size_t size)
+{
+    uint32_t length = static_cast<uint32_t>(size);
+    out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    out.push_back(static_cast<char>(type));
+    out.append(data, size);
+}
+
+inline void encodeRelayUpdate(const MarketUpdate &update, std::string &out)
+{
+    size_t bidBytes = update.bidCount * sizeof(PriceLevel);
+    size_t askBytes = update.askCount * sizeof(PriceLevel);
+    uint32_t length = static_cast<uint32_t>(kRelayUpdatePrefix + bidBytes + askBytes);
+    size_t begin = out.size();
+    out.resize(begin + kRelayFrameHeader + length);
+    char *p = &out[begin];
+    std::memcpy(p, &length, sizeof(length));
+    p[4] = static_cast<char>(kRelayUpdate);
+    p += kRelayFrameHeader;
+    std::memcpy(p, &update, kRelayUpdatePrefix);
+    std::memcpy(p + kRelayUpdatePrefix, update.bids, bidBytes);
+    std::memcpy(p + kRelayUpdatePrefix + bidBytes, update.asks, askBytes);
+}
+
+// False if the payload is not a well-formed update
+inline bool decodeRelayUpdate(const char *data, size_t size, MarketUpdate &update)
+{
+    if (size < kRelayUpdatePrefix)
+    {
+        return false;
+    }
+    std::memcpy(&update, data, kRelayUpdatePrefix);
+    size_t bidBytes = update.bidCount * sizeof(PriceLevel);
+    size_t askBytes = update.askCount * sizeof(PriceLevel);
+    if (update.kind > UpdateKind::Trade || update.bidCount > kMaxDepth || update.askCount > kMaxDepth ||
+        size != kRelayUpdatePrefix + bidBytes + askBytes)
+    {
+        return false;
+    }
+    std::memcpy(update.bids, data + kRelayUpdatePrefix, bidBytes);
+    std::memcpy(update.asks, data + kRelayUpdatePrefix + bidBytes, askBytes);
+    update.symbol[sizeof(update.symbol) - 1] = '\0';
+    return true;
+}
+
+inline std::string joinRelaySymbols(const std::vector<std::string> &symbols)
+{
+    std::string payload;
+    for (const std::string &symbol : symbols)
+    {
+        payload += symbol;
+        payload += '\n';
+    }
+    return payload;
+}
+
+inline std::vector<std::string> splitRelaySymbols(const char *data, size_t size)
+{
+    std::vector<std::string> symbols;
+    std::string_view rest(data, size);
+    while (!rest.empty())
+    {
+        size_t end = std::min(rest.find('\n'), rest.size());
+        if (end != 0)
+        {
+            symbols.emplace_back(rest.substr(0, end));
+        }
+        rest.remove_prefix(std::min(end + 1, rest.size()));
+    }
+    return symbols;
+}
+
+// Calls `frame(type, payload, size)` for every complete frame at the start of
+// `buffer` and removes them. False on a malformed length.
+template <typename OnFrame>
+bool consumeRelayFrames(std::string &buffer, OnFrame &&frame)
+{
+    size_t offset = 0;
+    while (buffer.size() - offset >= kRelayFrameHeader)
+    {
+        uint32_t length;
+        std::memcpy(&length, buffer.data() + offset, sizeof(length));
+        if (length > kRelayMaxPayload)
+        {
+            return false;
+        }
+        if (buffer.size() - offset < kRelayFrameHeader + length)
+        {
+            break;
+        }
+        if (!frame(static_cast<uint8_t>(buffer[offset + 4]), buffer.data() + offset + kRelayFrameHeader, length))
+        {
+            return false;
+        }
+        offset += kRelayFrameHeader + length;
+    }
+    buffer.erase(0, offset);
+    return true;
+}
+
+// Addresses are "unix:/path/to/socket" or "[tcp:]host:port"
+struct RelayAddress
+{
+    bool local = false;
+    std::string path;
+    std::string host;
+    std::string port;
+
+    static RelayAddress parse(const std::string &spec)
+    {
+        RelayAddress address;
+        if (spec.compare(0, 5, "unix:") == 0)
+        {
+            address.local = true;
+            address.path = spec.substr(5);
+            if (address.path.empty() || address.path.size() >= sizeof(sockaddr_un::sun_path))
+            {
+                throw std::runtime_error("Invalid relay socket path: " + spec);
+            }
+            return address;
+        }
+        std::string rest = spec.compare(0, 4, "tcp:") == 0 ? spec.substr(4) : spec;
+        size_t colon = rest.rfind(':');
+        if (colon == std::string::npos || colon + 1 == rest.size())
+        {
+            throw std::runtime_error("Invalid relay address: " + spec);
+        }
+        address.host = rest.substr(0, colon);
+        address.port = rest.substr(colon + 1);
+        return address;
+    }
+
+    // Connected (or bound) socket, or -1 with errno set
+    int open(bool listening) const
+    {
+        if (local)
+        {
+            int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            if (listening)
+            {
+                ::unlink(path.c_str());
+            }
+            int result = listening ? ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))
+                                   : ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+            if (fd < 0 || result != 0 || (listening && ::listen(fd, 64) != 0))
+            {
+                int error = errno;
+                ::close(fd);
+                errno = error;
+                return -1;
+            }
+            return fd;
+        }
+        addrinfo hints{}, *results = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        if (::getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &results) != 0)
+        {
+            errno = EINVAL;
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo *ai = results; ai && fd < 0; ai = ai->ai_next)
+        {
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0)
+            {
+                continue;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (listening)
+            {
+                ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            }
+            if (listening ? ::bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || ::listen(fd, 64) != 0
+                          : ::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        ::freeaddrinfo(results);
+        return fd;
+    }
+};
+
+// Root side: accepts edges and streams them the updates of the symbols they
+// subscribed to. One thread reads the feed ring, appends each update to the
+// output buffer of every interested edge and writes the buffers without
+// blocking, so a batch of updates costs one send per edge. An edge whose
+// unsent output exceeds `maxBuffered` is disconnected; it reconnects and
+// subscribes again. While the ring is empty the thread sleeps in ppoll, so
+// the feed must call feedAvailable() after each publish.
+class RelayPublisher
+{
+public:
+    // Same contract as WebSocketServer::InterestHandler: called from the
+    // relay thread when an edge adds or removes symbols, or disconnects
+    using InterestHandler = std::function<void(const std::vector<std::string> &, bool)>;
+
+    RelayPublisher(const std::string &address, MulticastRing<MarketUpdate> &ring, InterestHandler interest, size_t maxBuffered)
+        : reader(ring), interest(std::move(interest)), maxBuffered(maxBuffered)
+    {
+        listener = RelayAddress::parse(address).open(true);
+        if (listener < 0)
+        {
+            throw std::runtime_error("Cannot listen for relay edges on " + address + ": " + std::strerror(errno));
+        }
+        ::fcntl(listener, F_SETFL, O_NONBLOCK);
+    }
+
+    ~RelayPublisher()
+    {
+        stop();
+        for (Edge &edge : edges)
+        {
+            ::close(edge.fd);
+        }
+        ::close(listener);
+    }
+
+    RelayPublisher(const RelayPublisher &) = delete;
+    RelayPublisher &operator=(const RelayPublisher &) = delete;
+
+    void start()
+    {
+        thread = std::thread([this]()
+                             { run(); });
+    }
+
+    void stop()
+    {
+        running = false;
+        wakeup.wake();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    // Feed thread, after publishing to the ring
+    void feedAvailable()
+    {
+        wakeup.notify();
+    }
+
+private:
+    struct Edge
+    {
+        int fd;
+        std::unordered_set<std::string> symbols;
+        std::string input;
+        std::string output;
+        size_t written = 0; // bytes of output already sent
+        bool closing = false;
+    };
+
+    static constexpr size_t kDrainBatch = 1024;
+
+    RingConsumer<MarketUpdate> reader;
+    RingWakeup wakeup;
+    InterestHandler interest;
+    size_t maxBuffered;
+    int listener = -1;
+    std::vector<Edge> edges;
+    std::vector<pollfd> pollfds;
+    std::string symbol; // reused between updates
+    std::thread thread;
+    std::atomic<bool> running{true};
+
+    void run()
+    {
+        while (running)
+        {
+            size_t count = reader.poll([this](const MarketUpdate &update, int64_t)
+                                       { route(update); },
+                                       kDrainBatch);
+            for (Edge &edge : edges)
+            {
+                flush(edge);
+            }
+            waitForSockets(count == 0);
+            removeClosed();
+        }
+    }
+
+    void route(const MarketUpdate &update)
+    {
+        symbol.assign(update.getSymbol());
+        for (Edge &edge : edges)
+        {
+            if (!edge.closing && edge.symbols.count(symbol))
+            {
+                encodeRelayUpdate(update, edge.output);
+                if (edge.output.size() - edge.written > maxBuffered)
+                {
+                    std::cerr << "Relay: edge fell " << maxBuffered << " bytes behind, disconnecting" << std::endl;
+                    edge.closing = true;
+                }
+            }
+        }
+    }
+
+    void flush(Edge &edge)
+    {
+        while (!edge.closing && edge.written < edge.output.size())
+        {
+            ssize_t sent = ::send(edge.fd, edge.output.data() + edge.written, edge.output.size() - edge.written, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent > 0)
+            {
+                edge.written += static_cast<size_t>(sent);
+            }
+            else if (sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                edge.closing = sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK;
+                break;
+            }
+        }
+        if (edge.written == edge.output.size())
+        {
+            edge.output.clear();
+            edge.written = 0;
+        }
+        else if (edge.written > edge.output.size() / 2)
+        {
+            edge.output.erase(0, edge.written);
+            edge.written = 0;
+        }
+    }
+
+    // Handles socket events. With `idle` (the ring was empty) sleeps until
+    // an edge or the feed wakes the thread; otherwise only checks.
+    void waitForSockets(bool idle)
+    {
+        pollfds.assign({pollfd{listener, POLLIN, 0}, pollfd{wakeup.getFd(), POLLIN, 0}});
+        for (const Edge &edge : edges)
+        {
+            pollfds.push_back({edge.fd, static_cast<short>(POLLIN | (edge.written < edge.output.size() ? POLLOUT : 0)), 0});
+        }
+        bool sleeping = idle && wakeup.prepareWait(reader);
+        timespec immediate{0, 0};
+        int ready = ::ppoll(pollfds.data(), pollfds.size(), sleeping ? nullptr : &immediate, nullptr);
+        if (sleeping)
+        {
+            wakeup.clear();
+        }
+        if (ready <= 0)
+        {
+            return;
+        }
+        for (size_t i = 0; i < edges.size(); ++i)
+        {
+            if (pollfds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))
+            {
+                read(edges[i]);
+            }
+        }
+        if (pollfds[0].revents & POLLIN)
+        {
+            accept();
+        }
+    }
+
+    void accept()
+    {
+        int fd;
+        while ((fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        {
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+            edges.push_back(Edge{fd, {}, {}, {}, 0, false});
+            std::cout << "Relay: edge connected (" << edges.size() << " total)" << std::endl;
+        }
+    }
+
+    void read(Edge &edge)
+    {
+        char buffer[16384];
+        ssize_t received;
+        while ((received = ::recv(edge.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+        {
+            edge.input.append(buffer, static_cast<size_t>(received));
+        }
+        if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            edge.closing = true;
+        }
+        bool valid = consumeRelayFrames(edge.input, [this, &edge](uint8_t type, const char *payload, size_t size)
+                                        {
+                                            if (type != kRelaySubscribe && type != kRelayUnsubscribe)
+                                            {
+                                                return false;
+                                            }
+                                            std::vector<std::string> changed;
+                                            for (std::string &symbol : splitRelaySymbols(payload, size))
+                                            {
+                                                if (type == kRelaySubscribe ? edge.symbols.insert(symbol).second : edge.symbols.erase(symbol) != 0)
+                                                {
+                                                    changed.push_back(std::move(symbol));
+                                                }
+                                            }
+                                            if (!changed.empty())
+                                            {
+                                                interest(changed, type == kRelaySubscribe);
+                                            }
+                                            return true; });
+        if (!valid)
+        {
+            std::cerr << "Relay: malformed frame from edge, disconnecting" << std::endl;
+            edge.closing = true;
+        }
+    }
+
+    // Disconnected edges give their symbols back
+    void removeClosed()
+    {
+        for (auto it = edges.begin(); it != edges.end();)
+        {
+            if (!it->closing)
+            {
+                ++it;
+                continue;
+            }
+            ::close(it->fd);
+            if (!it->symbols.empty())
+            {
+                interest(std::vector<std::string>(it->symbols.begin(), it->symbols.end()), false);
+            }
+            it = edges.erase(it);
+            std::cout << "Relay: edge disconnected (" << edges.size() << " left)" << std::endl;
+        }
+    }
+};
+
+// Edge side: the root as a MarketDataSource. Reconnects with exponential
+// backoff and re-subscribes everything on reconnect, like DeribitFeed.
+class RelayFeed : public MarketDataSource
+{
+public:
+    explicit RelayFeed(const std::string &address) : address(RelayAddress::parse(address)), description(address) {}
+
+    ~RelayFeed() override
+    {
+        stop();
+    }
+
+    void start(Handler handler) override
+    {
+        this->handler = std::move(handler);
+        thread = std::thread([this]()
+                             { run(); });
+    }
+
+    void stop() override
+    {
+        running = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd >= 0)
+            {
+                ::shutdown(fd, SHUT_RDWR); // wakes the reader
+            }
+        }
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void subscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        symbols.insert(list.begin(), list.end());
+        sendLocked(kRelaySubscribe, list);
+    }
+
+    void unsubscribe(const std::vector<std::string> &list) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : list)
+        {
+            symbols.erase(symbol);
+        }
+        sendLocked(kRelayUnsubscribe, list);
+    }
+
+    const char *name() const override
+    {
+        return "relay";
+    }
+
+private:
+    RelayAddress address;
+    std::string description;
+    Handler handler;
+    std::thread thread;
+    std::atomic<bool> running{true};
+    std::mutex mutex; // guards fd for writers and symbols
+    int fd = -1;
+    std::unordered_set<std::string> symbols;
+
+    // Control frames are small and rare; a blocking send is fine
+    void sendLocked(uint8_t type, const std::vector<std::string> &list)
+    {
+        if (fd < 0 || list.empty())
+        {
+            return;
+        }
+        std::string frame;
+        std::string payload = joinRelaySymbols(list);
+        appendRelayFrame(frame, type, payload.data(), payload.size());
+        size_t written = 0;
+        while (written < frame.size())
+        {
+            ssize_t sent = ::send(fd, frame.data() + written, frame.size() - written, MSG_NOSIGNAL);
+            if (sent <= 0 && errno != EINTR)
+            {
+                ::shutdown(fd, SHUT_RDWR); // the reader reconnects
+                return;
+            }
+            written += sent > 0 ? static_cast<size_t>(sent) : 0;
+        }
+    }
+
+    void run()
+    {
+        auto backoff = std::chrono::milliseconds(100);
+        while (running)
+        {
+            int connected = address.open(false);
+            if (connected < 0)
+            {
+                std::cerr << "Relay: cannot connect to " << description << ": " << std::strerror(errno) << ", retrying in " << backoff.count() << " ms" << std::endl;
+                for (auto waited = std::chrono::milliseconds(0); running && waited < backoff; waited += std::chrono::milliseconds(100))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                backoff = std::min(backoff * 2, std::chrono::milliseconds(5000));
+                continue;
+            }
+            backoff = std::chrono::milliseconds(100);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                fd = connected;
+                sendLocked(kRelaySubscribe, std::vector<std::string>(symbols.begin(), symbols.end()));
+            }
+            std::cout << "Relay: connected to " << description << std::endl;
+            receive(connected);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ::close(fd);
+                fd = -1;
+            }
+            if (running)
+            {
+                std::cerr << "Relay: disconnected from " << description << std::endl;
+            }
+        }
+    }
+
+    void receive(int socket)
+    {
+        std::string buffer;
+        MarketUpdate update{};
+        char chunk[65536];
+        while (running)
+        {
+            ssize_t received = ::recv(socket, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (received <= 0)
+            {
+                return;
+            }
+            buffer.append(chunk, static_cast<size_t>(received));
+            bool valid = consumeRelayFrames(buffer, [this, &update](uint8_t type, const char *payload, size_t size)
+                                            {
+                                                if (type != kRelayUpdate || !decodeRelayUpdate(payload, size, update))
+                                                {
+                                                    return false;
+                                                }
+                                                handler(update);
+                                                return true; });
+            if (!valid)
+            {
+                std::cerr << "Relay: malformed frame from root" << std::endl;
+                return;
+            }
+        }
+    }
+};
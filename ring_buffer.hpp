@@ -0,0 +1,451 @@
+#pragma once
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Destructive interference size; fixed at 64 so the layout does not depend on
+// the compiler's tuning flags
+constexpr size_t kCacheLine = 64;
+
+template <typename V>
+struct alignas(kCacheLine) Padded
+{
+    V value{};
+};
+
+// Capacity rounded up to a power of two so positions map to slots with a mask
+inline size_t ringCapacity(size_t value)
+{
+    if (value < 2)
+    {
+        throw std::invalid_argument("ring capacity must be at least 2");
+    }
+    size_t power = 1;
+    while (power < value)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+// Bounded single-producer/single-consumer queue of fixed-size messages.
+//
+// The producer owns `tail` and the consumer owns `head`; each also keeps a
+// cached copy of the other's index, so the shared cache lines are only read
+// when the queue looks full (producer) or empty (consumer). Slots are
+// preallocated and messages are copied in and out, so pushing and popping
+// never allocate or lock.
+template <typename T>
+class SpscRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring messages are copied as plain bytes");
+
+public:
+    // capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : mask(ringCapacity(capacity) - 1), slots(mask + 1)
+    {
+    }
+
+    // Producer: returns false if the queue is full
+    bool tryPush(const T &value)
+    {
+        uint64_t position = tail.value.load(std::memory_order_relaxed);
+        if (position - cachedHead.value == slots.size())
+        {
+            cachedHead.value = head.value.load(std::memory_order_acquire);
+            if (position - cachedHead.value == slots.size())
+            {
+                return false;
+            }
+        }
+        slots[position & mask] = value;
+        tail.value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: returns false if the queue is empty
+    bool tryPop(T &value)
+    {
+        uint64_t position = head.value.load(std::memory_order_relaxed);
+        if (position == cachedTail.value)
+        {
+            cachedTail.value = tail.value.load(std::memory_order_acquire);
+            if (position == cachedTail.value)
+            {
+                return false;
+            }
+        }
+        value = slots[position & mask];
+        head.value.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate, for monitoring
+    size_t size() const
+    {
+        return static_cast<size_t>(tail.value.load(std::memory_order_acquire) - head.value.load(std::memory_order_acquire));
+    }
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+private:
+    const size_t mask;
+    std::vector<T> slots;
+    Padded<std::atomic<uint64_t>> head;  // next slot to read, written by the consumer
+    Padded<uint64_t> cachedTail;         // consumer's copy of tail
+    Padded<std::atomic<uint64_t>> tail;  // next slot to write, written by the producer
+    Padded<uint64_t> cachedHead;         // producer's copy of head
+};
+
+// Bounded multi-producer/single-consumer queue.
+//
+// Every slot carries a sequence number that says whose turn it is: a
+// producer claims a position by advancing `tail` with a CAS once the slot's
+// sequence shows it is free, writes the message and then bumps the sequence
+// to hand the slot to the consumer. Producers only contend on `tail`; a slow
+// producer holding a claimed slot delays the consumer but no other producer.
+template <typename T>
+class MpscRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring messages are copied as plain bytes");
+
+public:
+    explicit MpscRing(size_t capacity) : mask(ringCapacity(capacity) - 1), slots(new Slot[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread: returns false if the queue is full
+    bool tryPush(const T &value)
+    {
+        uint64_t position = tail.value.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true)
+        {
+            slot = &slots[position & mask];
+            uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            int64_t difference = static_cast<int64_t>(sequence - position);
+            if (difference == 0)
+            {
+                if (tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = tail.value.load(std::memory_order_relaxed);
+            }
+        }
+        slot->value = value;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: returns false if the queue is empty
+    bool tryPop(T &value)
+    {
+        uint64_t position = head.value;
+        Slot &slot = slots[position & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+        {
+            return false;
+        }
+        value = slot.value;
+        slot.sequence.store(position + mask + 1, std::memory_order_release);
+        head.value = position + 1;
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    Padded<uint64_t> head;              // consumer only
+    Padded<std::atomic<uint64_t>> tail; // next position to claim
+};
+
+// Position of a producer or consumer in a MulticastRing; -1 before the first
+// message. Padded so that each lives on its own cache line.
+struct alignas(kCacheLine) RingSequence
+{
+    std::atomic<int64_t> value{-1};
+
+    int64_t get() const
+    {
+        return value.load(std::memory_order_acquire);
+    }
+};
+
+// Disruptor-style single-producer ring read by any number of consumers.
+//
+// Every consumer sees every message, read in place from the ring; the
+// producer never overwrites a slot until the slowest gating consumer has
+// moved past it (publishing fails instead). Consumers can be chained with
+// sequence barriers: a consumer created with dependencies only sees a
+// message after all of them have processed it.
+template <typename T>
+class MulticastRing
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring messages are copied as plain bytes");
+
+public:
+    explicit MulticastRing(size_t capacity) : mask(ringCapacity(capacity) - 1), slots(mask + 1) {}
+
+    // Producer: returns false if the slowest consumer is a full ring behind
+    bool tryPublish(const T &value)
+    {
+        int64_t next = published + 1;
+        int64_t wrapPoint = next - static_cast<int64_t>(slots.size());
+        if (wrapPoint > cachedGating)
+        {
+            cachedGating = minimumGating();
+            if (wrapPoint > cachedGating)
+            {
+                return false;
+            }
+        }
+        slots[next & mask] = value;
+        cursor.value.store(next, std::memory_order_release);
+        published = next;
+        return true;
+    }
+
+    // Last published sequence
+    const RingSequence &getCursor() const
+    {
+        return cursor;
+    }
+
+    const T &at(int64_t sequence) const
+    {
+        return slots[sequence & mask];
+    }
+
+    size_t capacity() const
+    {
+        return slots.size();
+    }
+
+    // Registers a consumer position the producer must not overtake. All
+    // consumers must be registered before the first publish.
+    void addGating(const RingSequence &sequence)
+    {
+        gating.push_back(&sequence);
+    }
+
+private:
+    const size_t mask;
+    std::vector<T> slots;
+    RingSequence cursor;
+    std::vector<const RingSequence *> gating;
+    int64_t published = -1;    // producer's copy of cursor
+    int64_t cachedGating = -1; // producer's copy of the slowest consumer
+
+    int64_t minimumGating() const
+    {
+        int64_t minimum = published;
+        for (const RingSequence *sequence : gating)
+        {
+            minimum = std::min(minimum, sequence->get());
+        }
+        return minimum;
+    }
+};
+
+// Highest sequence a consumer may read: the producer's cursor, capped by the
+// consumers it depends on
+class SequenceBarrier
+{
+public:
+    SequenceBarrier(const RingSequence &cursor, std::vector<const RingSequence *> dependencies = {})
+        : cursor(cursor), dependencies(std::move(dependencies)) {}
+
+    int64_t available() const
+    {
+        int64_t available = cursor.get();
+        for (const RingSequence *dependency : dependencies)
+        {
+            available = std::min(available, dependency->get());
+        }
+        return available;
+    }
+
+private:
+    const RingSequence &cursor;
+    std::vector<const RingSequence *> dependencies;
+};
+
+// One consumer of a MulticastRing; construct every consumer before the
+// producer starts. poll() is called from a single thread.
+template <typename T>
+class RingConsumer
+{
+public:
+    explicit RingConsumer(MulticastRing<T> &ring, std::vector<const RingSequence *> dependencies = {})
+        : ring(ring), barrier(ring.getCursor(), std::move(dependencies))
+    {
+        ring.addGating(sequence);
+    }
+
+    // Calls handler(message, sequence) for up to `limit` available messages;
+    // returns how many
+    template <typename Handler>
+    size_t poll(Handler &&handler, size_t limit = std::numeric_limits<size_t>::max())
+    {
+        int64_t next = sequence.value.load(std::memory_order_relaxed) + 1;
+        int64_t available = barrier.available();
+        if (available < next)
+        {
+            return 0;
+        }
+        if (static_cast<uint64_t>(available - next) >= limit)
+        {
+            available = next + static_cast<int64_t>(limit) - 1;
+        }
+        for (int64_t position = next; position <= available; ++position)
+        {
+            handler(ring.at(position), position);
+        }
+        // Releases the slots back to the producer
+        sequence.value.store(available, std::memory_order_release);
+        return static_cast<size_t>(available - next + 1);
+    }
+
+    bool pending() const
+    {
+        return barrier.available() > sequence.value.load(std::memory_order_relaxed);
+    }
+
+    // For consumers that depend on this one
+    const RingSequence &getSequence() const
+    {
+        return sequence;
+    }
+
+private:
+    MulticastRing<T> &ring;
+    SequenceBarrier barrier;
+    RingSequence sequence;
+};
+
+// Lets a ring consumer's thread sleep while the ring is empty instead of
+// polling it. The consumer calls prepareWait() and, if it returns true,
+// blocks on fd() (alone through wait(), or in its own poll set) and then
+// calls clear(). The producer calls notify() after publishing, which costs
+// an atomic exchange and writes the eventfd only if the consumer is asleep.
+class RingWakeup
+{
+public:
+    RingWakeup() : fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (fd < 0)
+        {
+            throw std::runtime_error(std::string("Cannot create eventfd: ") + std::strerror(errno));
+        }
+    }
+
+    ~RingWakeup()
+    {
+        ::close(fd);
+    }
+
+    RingWakeup(const RingWakeup &) = delete;
+    RingWakeup &operator=(const RingWakeup &) = delete;
+
+    int getFd() const
+    {
+        return fd;
+    }
+
+    // Producer, after publishing
+    void notify()
+    {
+        // Orders the publish before reading `waiting`; pairs with prepareWait
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false))
+        {
+            wake();
+        }
+    }
+
+    // Any thread; wakes the consumer whether or not it is waiting (shutdown)
+    void wake()
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(fd, &one, sizeof(one));
+    }
+
+    // Consumer: false if messages arrived meanwhile and it should poll again
+    template <typename T>
+    bool prepareWait(const RingConsumer<T> &reader)
+    {
+        waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (reader.pending())
+        {
+            waiting.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    // Consumer, after waking
+    void clear()
+    {
+        waiting.store(false, std::memory_order_relaxed);
+        uint64_t count;
+        [[maybe_unused]] ssize_t drained = ::read(fd, &count, sizeof(count));
+    }
+
+    // Consumer: sleeps until the producer publishes, wake() is called or
+    // `timeoutMs` passes (-1 waits indefinitely)
+    template <typename T>
+    void wait(const RingConsumer<T> &reader, int timeoutMs)
+    {
+        if (prepareWait(reader))
+        {
+            pollfd event{fd, POLLIN, 0};
+            ::poll(&event, 1, timeoutMs);
+            clear();
+        }
+    }
+
+private:
+    int fd;
+    std::atomic<bool> waiting{false};
+};
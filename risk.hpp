@@ -0,0 +1,377 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class Side : uint8_t
+{
+    Buy,
+    Sell
+};
+
+enum class RiskResult : uint8_t
+{
+    Accepted,
+    InvalidOrder,
+    UnknownInstrument,
+    OrderTooLarge,
+    NoReferencePrice,
+    PriceOutsideBand,
+    PositionLimit,
+    InstrumentNotionalLimit,
+    CurrencyNotionalLimit,
+    OpenOrderLimit
+};
+
+inline const char *riskResultName(RiskResult result)
+{
+    static const char *names[] = {
+        "accepted", "invalid order", "unknown instrument", "order too large", "no reference price",
+        "price outside band", "position limit", "instrument notional limit", "currency notional limit",
+        "open order limit"};
+    return names[static_cast<int>(result)];
+}
+
+// Static per-instrument limits, precomputed when the instrument is registered
+struct InstrumentLimits
+{
+    double maxOrderAmount = 1e6;
+    double priceBand = 0.05;      // max distance from local mid, as a fraction of mid
+    double maxPosition = 1e7;     // absolute, in order amount units, including resting orders
+    double maxNotional = 1e7;     // gross open-order + position notional, quote currency
+    bool amountIsNotional = true; // inverse contracts: amount is already quoted in USD
+    int maxOpenOrders = 50;
+};
+
+// Pre-trade risk checks that run inline on the order path.
+//
+// Instruments are registered up front into fixed-capacity tables indexed by a
+// dense id, so a check is a few array reads plus lock-free counter updates
+// with no allocation or locking. All amounts are kept as fixed-point int64
+// (kScale units) so that counters can be updated with fetch_add.
+//
+// checkAndReserve() both validates an order and reserves its exposure; every
+// accepted order must later be balanced by release() (cancel/reject/expiry)
+// and/or onFill(). Reservations make concurrent checks safe: two threads
+// cannot both pass against the same remaining headroom.
+class PreTradeRisk
+{
+public:
+    static constexpr double kScale = 1e6;
+    static constexpr size_t kMaxInstruments = 8192;
+    static constexpr size_t kMaxCurrencies = 64;
+
+    explicit PreTradeRisk(int maxOpenOrders = 200, bool requireReferencePrice = false)
+        : maxOpenOrders(maxOpenOrders), requireReferencePrice(requireReferencePrice),
+          instruments(new InstrumentState[kMaxInstruments]), currencies(new CurrencyState[kMaxCurrencies]) {}
+
+    // Registration is not thread-safe: do it at startup or from the single
+    // thread that also owns the name lookups.
+    int registerInstrument(const std::string &name, const std::string &currency, const InstrumentLimits &limits)
+    {
+        auto existing = instrumentIds.find(name);
+        if (existing != instrumentIds.end())
+        {
+            instruments[existing->second].limits = toFixed(limits);
+            return existing->second;
+        }
+        if (instrumentCount == kMaxInstruments)
+        {
+            return -1;
+        }
+        int currencyId = registerCurrency(currency);
+        if (currencyId < 0)
+        {
+            return -1;
+        }
+        int id = static_cast<int>(instrumentCount++);
+        instruments[id].limits = toFixed(limits);
+        instruments[id].currency = currencyId;
+        instrumentIds.emplace(name, id);
+        return id;
+    }
+
+    void setCurrencyLimit(const std::string &currency, double maxNotional)
+    {
+        int id = registerCurrency(currency);
+        if (id >= 0)
+        {
+            currencies[id].maxNotional = fixed(maxNotional);
+        }
+    }
+
+    int findInstrument(const std::string &name) const
+    {
+        auto it = instrumentIds.find(name);
+        return it == instrumentIds.end() ? -1 : it->second;
+    }
+
+    // False for -1 (registration failed) or any id never registered. The
+    // calls below that take an id ignore unknown ones.
+    bool knownInstrument(int id) const
+    {
+        return id >= 0 && static_cast<size_t>(id) < instrumentCount;
+    }
+
+    void updateMid(int id, double bid, double ask)
+    {
+        if (knownInstrument(id) && bid > 0 && ask > 0)
+        {
+            instruments[id].mid.store((bid + ask) / 2, std::memory_order_relaxed);
+        }
+    }
+
+    RiskResult checkAndReserve(int id, Side side, double amount, double price)
+    {
+        if (!knownInstrument(id))
+        {
+            return RiskResult::UnknownInstrument;
+        }
+        if (!(amount > 0) || !(price > 0) || !std::isfinite(amount) || !std::isfinite(price))
+        {
+            return RiskResult::InvalidOrder;
+        }
+        InstrumentState &inst = instruments[id];
+        const FixedLimits &limits = inst.limits;
+        int64_t qty = fixed(amount);
+        if (qty > limits.maxOrderAmount)
+        {
+            return RiskResult::OrderTooLarge;
+        }
+
+        double mid = inst.mid.load(std::memory_order_relaxed);
+        if (mid > 0)
+        {
+            if (std::fabs(price - mid) > limits.priceBand * mid)
+            {
+                return RiskResult::PriceOutsideBand;
+            }
+        }
+        else if (requireReferencePrice)
+        {
+            return RiskResult::NoReferencePrice;
+        }
+
+        int64_t notional = orderNotional(limits, amount, price);
+        std::atomic<int64_t> &sideOpen = side == Side::Buy ? inst.openBuy : inst.openSell;
+        CurrencyState &ccy = currencies[inst.currency];
+
+        // Reserve first, then verify; roll back everything taken so far on breach
+        if (openOrders.fetch_add(1, std::memory_order_relaxed) >= maxOpenOrders)
+        {
+            openOrders.fetch_sub(1, std::memory_order_relaxed);
+            return RiskResult::OpenOrderLimit;
+        }
+        if (inst.openOrders.fetch_add(1, std::memory_order_relaxed) >= limits.maxOpenOrders)
+        {
+            rollback(inst, ccy, sideOpen, 0, 0, true);
+            return RiskResult::OpenOrderLimit;
+        }
+        int64_t open = sideOpen.fetch_add(qty, std::memory_order_relaxed) + qty;
+        int64_t position = inst.position.load(std::memory_order_relaxed);
+        int64_t worstCase = side == Side::Buy ? position + open : open - position;
+        if (worstCase > limits.maxPosition)
+        {
+            rollback(inst, ccy, sideOpen, qty, 0, true);
+            return RiskResult::PositionLimit;
+        }
+        if (inst.exposure.fetch_add(notional, std::memory_order_relaxed) + notional > limits.maxNotional)
+        {
+            inst.exposure.fetch_sub(notional, std::memory_order_relaxed);
+            rollback(inst, ccy, sideOpen, qty, 0, true);
+            return RiskResult::InstrumentNotionalLimit;
+        }
+        if (ccy.exposure.fetch_add(notional, std::memory_order_relaxed) + notional > ccy.maxNotional)
+        {
+            rollback(inst, ccy, sideOpen, qty, notional, true);
+            return RiskResult::CurrencyNotionalLimit;
+        }
+        return RiskResult::Accepted;
+    }
+
+    // Reserves an order without checking it, e.g. to restore a reservation
+    // or to account for orders found resting at the exchange.
+    void reserve(int id, Side side, double amount, double price)
+    {
+        if (!knownInstrument(id))
+        {
+            return;
+        }
+        InstrumentState &inst = instruments[id];
+        int64_t notional = orderNotional(inst.limits, amount, price);
+        (side == Side::Buy ? inst.openBuy : inst.openSell).fetch_add(fixed(amount), std::memory_order_relaxed);
+        inst.exposure.fetch_add(notional, std::memory_order_relaxed);
+        currencies[inst.currency].exposure.fetch_add(notional, std::memory_order_relaxed);
+        inst.openOrders.fetch_add(1, std::memory_order_relaxed);
+        openOrders.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Releases the unfilled remainder of an accepted order. Pass closed=true
+    // when the order is no longer resting (cancelled, rejected or fully filled).
+    void release(int id, Side side, double amount, double price, bool closed)
+    {
+        if (!knownInstrument(id))
+        {
+            return;
+        }
+        InstrumentState &inst = instruments[id];
+        int64_t qty = fixed(amount);
+        int64_t notional = orderNotional(inst.limits, amount, price);
+        std::atomic<int64_t> &sideOpen = side == Side::Buy ? inst.openBuy : inst.openSell;
+        rollback(inst, currencies[inst.currency], sideOpen, qty, notional, closed);
+    }
+
+    // Moves a filled quantity from the resting reservation into the position.
+    // Exposure swaps the filled part of the order's notional for the change
+    // in the position's gross notional, valued at the fill price. Pass
+    // reserved=false for fills of orders that hold no reservation (placed
+    // elsewhere, or already released): only the position moves.
+    void onFill(int id, Side side, double amount, double price, bool reserved = true)
+    {
+        if (!knownInstrument(id))
+        {
+            return;
+        }
+        InstrumentState &inst = instruments[id];
+        int64_t qty = fixed(amount);
+        if (reserved)
+        {
+            (side == Side::Buy ? inst.openBuy : inst.openSell).fetch_sub(qty, std::memory_order_relaxed);
+        }
+        int64_t position = inst.position.fetch_add(side == Side::Buy ? qty : -qty, std::memory_order_relaxed) +
+                           (side == Side::Buy ? qty : -qty);
+        revalue(inst, position, price, reserved ? orderNotional(inst.limits, amount, price) : 0);
+    }
+
+    // Overwrites the position with the exchange's (reconciliation) and
+    // revalues its notional at `price`. Resting reservations are untouched.
+    void setPosition(int id, double size, double price)
+    {
+        if (!knownInstrument(id) || !std::isfinite(size))
+        {
+            return;
+        }
+        InstrumentState &inst = instruments[id];
+        int64_t position = fixed(size);
+        inst.position.store(position, std::memory_order_relaxed);
+        revalue(inst, position, price, 0);
+    }
+
+    double position(int id) const
+    {
+        return knownInstrument(id) ? instruments[id].position.load(std::memory_order_relaxed) / kScale : 0.0;
+    }
+
+    int openOrderCount() const
+    {
+        return openOrders.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct FixedLimits
+    {
+        int64_t maxOrderAmount = 0;
+        double priceBand = 0;
+        int64_t maxPosition = 0;
+        int64_t maxNotional = 0;
+        bool amountIsNotional = true;
+        int maxOpenOrders = 0;
+    };
+
+    // One cache line per instrument's hot counters to avoid false sharing
+    struct alignas(64) InstrumentState
+    {
+        FixedLimits limits;
+        int currency = 0;
+        std::atomic<double> mid{0};
+        std::atomic<int64_t> position{0};
+        std::atomic<int64_t> openBuy{0};
+        std::atomic<int64_t> openSell{0};
+        std::atomic<int64_t> positionNotional{0};
+        std::atomic<int64_t> exposure{0};
+        std::atomic<int> openOrders{0};
+    };
+
+    struct alignas(64) CurrencyState
+    {
+        int64_t maxNotional = INT64_MAX;
+        std::atomic<int64_t> exposure{0};
+    };
+
+    const int maxOpenOrders;
+    const bool requireReferencePrice;
+    std::atomic<int> openOrders{0};
+    std::unique_ptr<InstrumentState[]> instruments;
+    std::unique_ptr<CurrencyState[]> currencies;
+    size_t instrumentCount = 0;
+    size_t currencyCount = 0;
+    std::unordered_map<std::string, int> instrumentIds;
+    std::unordered_map<std::string, int> currencyIds;
+
+    static int64_t fixed(double value)
+    {
+        return static_cast<int64_t>(std::llround(value * kScale));
+    }
+
+    static FixedLimits toFixed(const InstrumentLimits &limits)
+    {
+        return {fixed(limits.maxOrderAmount), limits.priceBand, fixed(limits.maxPosition),
+                fixed(limits.maxNotional), limits.amountIsNotional, limits.maxOpenOrders};
+    }
+
+    static int64_t orderNotional(const FixedLimits &limits, double amount, double price)
+    {
+        return fixed(limits.amountIsNotional ? amount : amount * price);
+    }
+
+    int registerCurrency(const std::string &currency)
+    {
+        auto it = currencyIds.find(currency);
+        if (it != currencyIds.end())
+        {
+            return it->second;
+        }
+        if (currencyCount == kMaxCurrencies)
+        {
+            return -1;
+        }
+        int id = static_cast<int>(currencyCount++);
+        currencyIds.emplace(currency, id);
+        return id;
+    }
+
+    // Replaces the position's gross notional in the exposure totals, net of
+    // `released` order notional that the position change consumed
+    void revalue(InstrumentState &inst, int64_t position, double price, int64_t released)
+    {
+        int64_t positionNotional = orderNotional(inst.limits, std::llabs(position) / kScale, price);
+        int64_t previous = inst.positionNotional.exchange(positionNotional, std::memory_order_relaxed);
+        int64_t delta = positionNotional - previous - released;
+        inst.exposure.fetch_add(delta, std::memory_order_relaxed);
+        currencies[inst.currency].exposure.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    void rollback(InstrumentState &inst, CurrencyState &ccy, std::atomic<int64_t> &sideOpen,
+                  int64_t qty, int64_t notional, bool closed)
+    {
+        if (qty)
+        {
+            sideOpen.fetch_sub(qty, std::memory_order_relaxed);
+        }
+        if (notional)
+        {
+            inst.exposure.fetch_sub(notional, std::memory_order_relaxed);
+            ccy.exposure.fetch_sub(notional, std::memory_order_relaxed);
+        }
+        if (closed)
+        {
+            inst.openOrders.fetch_sub(1, std::memory_order_relaxed);
+            openOrders.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+};
@@ -1,144 +1,872 @@
 #include <websocketpp/config/asio_no_tls.hpp>
 #include <websocketpp/server.hpp>
+#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+#include <websocketpp/base64/base64.hpp>
 #include <nlohmann/json.hpp>
+#include <array>
+#include <atomic>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
 #include <set>
 #include <string>
-#include <mutex>
 #include <iostream>
 #include <thread>
 #include <chrono>
-#include <fstream>
-#include <chrono>
+#include <functional>
+#include <map>
+#include "arena.hpp"
+#include "book_stream.hpp"
+#include "config.hpp"
+#include "feed_handler.hpp"
+#include "latency.hpp"
+#include "relay.hpp"
+#include "ring_buffer.hpp"
+#include "session.hpp"
+#include "shm_bus.hpp"
+#include "subscription_manager.hpp"
+#include "tracing.hpp"
+#include "wire_format.hpp"
 
 using json = nlohmann::json;
+using websocketpp::connection_hdl;
 
-std::string trim(const std::string &str)
+// asio transport with SessionState stored inside every connection object.
+// The deflate extension is enabled so websocketpp negotiates it and inflates
+// client messages; outgoing frames are compressed by the server (deflate.hpp).
+struct asio_with_session : public websocketpp::config::asio
 {
-    size_t first = str.find_first_not_of(" \t\r\n");
-    size_t last = str.find_last_not_of(" \t\r\n");
-    return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
-}
+    typedef SessionState connection_base;
 
-std::string getEnvVariable(const std::string &key)
-{
-    std::ifstream envFile(".env");
-    if (!envFile.is_open())
+    struct permessage_deflate_config
     {
-        std::cerr << "Error: Could not open .env file.\n";
-        return "";
-    }
-
-    std::string line;
-    while (std::getline(envFile, line))
-    {
-        size_t pos = line.find('=');
-        if (pos != std::string::npos)
-        {
-            std::string currentKey = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            currentKey = trim(currentKey);
-            value = trim(value); // Trim whitespace and carriage return
-            if (currentKey == key)
-            {
-                return value;
-            }
-        }
-    }
-    return "";
-}
+    };
+    typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+};
 
-using json = nlohmann::json;
-using websocketpp::connection_hdl;
+typedef websocketpp::server<asio_with_session> server_type;
 
 class WebSocketServer
 {
 public:
-    WebSocketServer()
+    // Called with (symbols, true) for the symbols a client request added and
+    // (symbols, false) for those it removed, including on disconnect; a
+    // symbol appears once per subscription
+    using InterestHandler = std::function<void(const std::vector<std::string> &, bool)>;
+    using ClientSet = std::set<connection_hdl, std::owner_less<connection_hdl>>;
+
+    explicit WebSocketServer(std::shared_ptr<const ServerConfig> config)
+        : config(std::move(config)), tracer(this->config->traceSampleEvery),
+          admissionBudget(this->config->admitRate, static_cast<double>(kAdmitBatch))
     {
         server.init_asio();
 
+        server.set_validate_handler([this](connection_hdl hdl)
+                                    { return onValidate(hdl); });
         server.set_open_handler([this](connection_hdl hdl)
                                 { onOpen(hdl); });
         server.set_close_handler([this](connection_hdl hdl)
                                  { onClose(hdl); });
-        server.set_message_handler([this](connection_hdl hdl, websocketpp::server<websocketpp::config::asio>::message_ptr msg)
+        server.set_fail_handler([this](connection_hdl hdl)
+                                { releaseSlot(hdl); });
+        server.set_message_handler([this](connection_hdl hdl, server_type::message_ptr msg)
                                    { onMessage(hdl, msg); });
+    }
+
+    void run(uint16_t port)
+    {
+        // Connections beyond the backlog are refused by the kernel instead of
+        // queueing unboundedly during a reconnect storm
+        server.set_reuse_addr(true);
+        server.set_listen_backlog(config->acceptBacklog);
+        server.listen(port);
+        server.start_accept();
+        server.run();
+    }
 
-        // Load .env file
+    // Reads market data from `ring` on the io thread; call before run() and
+    // before the feed starts publishing
+    void attachFeed(MulticastRing<MarketUpdate> &ring)
+    {
+        feedReader = std::make_unique<RingConsumer<MarketUpdate>>(ring);
+    }
 
-        env_client_id = getEnvVariable("CLIENT_ID");
-        env_client_secret = getEnvVariable("CLIENT_SECRET");
+    // Feed thread, after publishing: schedules a drain on the io thread
+    // unless one is already pending
+    void feedAvailable()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!drainScheduled.exchange(true))
+        {
+            server.get_io_service().post([this]()
+                                         { drainFeed(); });
+        }
+    }
 
-        if (env_client_id.empty() || env_client_secret.empty())
+    // io thread only. `message` must end with the stage timestamp object
+    // (`..."ts":{...}}`); see sendToAll for traced messages.
+    void broadcast(const std::string &symbol, const std::string &message, bool traced = false)
+    {
+        auto it = subscriptions.find(symbol);
+        if (it != subscriptions.end())
         {
-            throw std::runtime_error("CLIENT_ID or CLIENT_SECRET missing in .env file");
+            sendToAll(it->second, message, traced);
         }
     }
 
-    void run(uint16_t port)
+    // Pinned symbols keep their entry with or without clients
+    void addSymbol(const std::string &symbol)
     {
-        server.listen(port);
-        server.start_accept();
-        server.run();
+        subscriptions[symbol] = ClientSet();
+        pinned.insert(symbol);
+    }
+
+    // Relay edges serve only their shard of the symbols
+    bool ownsSymbol(const std::string &symbol) const
+    {
+        return relayShardOf(symbol, config->relayShards) == config->relayShard;
+    }
+
+    // Must be set before run()
+    void setInterestHandler(InterestHandler handler)
+    {
+        interestHandler = std::move(handler);
+    }
+
+    const TraceRecorder &getTracer() const
+    {
+        return tracer;
     }
 
-    void broadcast(const std::string &symbol, const std::string &message)
+private:
+    // Depth-limited book streams of one symbol. The latest full book is kept
+    // so a stream for a new depth can start with a snapshot right away.
+    struct BookStream
+    {
+        DepthBook book;
+        ClientSet clients;
+    };
+    struct BookChannel
+    {
+        MarketUpdate latest;
+        uint64_t latestSeq = 0; // seq it was published with
+        bool hasBook = false;
+        std::map<int, BookStream> streams; // by depth
+    };
+
+    server_type server;
+    std::unordered_map<std::string, ClientSet> subscriptions;
+    std::unordered_set<std::string> pinned;
+    std::unordered_map<std::string, BookChannel> books;
+    InterestHandler interestHandler;
+
+    // Market data path; everything except drainScheduled is io-thread only
+    std::unique_ptr<RingConsumer<MarketUpdate>> feedReader;
+    std::atomic<bool> drainScheduled{false};
+    std::unordered_map<std::string, uint64_t> sequences;
+    uint64_t published = 0;
+    std::string updateSymbol; // reused between updates
+    std::string updateMessage; // reused between updates
+    std::string bookMessage; // reused between book snapshots and deltas
+
+    // Outgoing framing. Clients without context takeover share a stateless
+    // compressor per window size, and the frames of the message being
+    // broadcast are cached by window size (0 = uncompressed).
+    std::array<std::unique_ptr<MessageDeflater>, kMaxDeflateWindowBits + 1> sharedDeflaters;
+    std::array<server_type::message_ptr, kMaxDeflateWindowBits + 1> sharedFrames;
+
+    std::shared_ptr<const ServerConfig> config;
+    TraceRecorder tracer;
+
+    // Admission control, io thread only. Opened connections do not have
+    // their requests read until they leave the admission queue; sessions
+    // authenticated in the upgrade request are released first.
+    struct AddressBudget
+    {
+        TokenBucket handshakes;
+        std::chrono::steady_clock::time_point lastSeen;
+    };
+    static constexpr size_t kAdmitBatch = 64; // sessions released per io-loop turn
+    static constexpr size_t kTrackedAddresses = 4096; // prune idle address budgets beyond this
+    std::unordered_map<std::string, AddressBudget> addressBudgets;
+    size_t pruneAddressesAt = kTrackedAddresses;
+    size_t connectionCount = 0;
+    std::deque<connection_hdl> priorityAdmissions;
+    std::deque<connection_hdl> admissions;
+    TokenBucket admissionBudget;
+    bool admissionScheduled = false;
+    uint64_t rejectedHandshakes = 0;
+    std::chrono::steady_clock::time_point lastRejectLog;
+
+    // `message` is framed (and compressed) once per compression group;
+    // clients with their own compression context, and every client of a
+    // traced message, get their own frame. For traced messages each client's
+    // copy has the socket write time added to the stamp object.
+    void sendToAll(const ClientSet &clients, const std::string &message, bool traced)
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        if (subscriptions.find(symbol) != subscriptions.end())
+        sharedFrames.fill(nullptr);
+        for (auto &hdl : clients)
         {
-            for (auto &hdl : subscriptions[symbol])
+            try
             {
-                try
+                server_type::connection_ptr con = server.get_con_from_hdl(hdl);
+                SessionState &session = *con;
+                if (traced)
+                {
+                    std::string stamped = message.substr(0, message.size() - 2);
+                    stamped += ",\"wr\":";
+                    stamped += std::to_string(nowNanos());
+                    stamped += "}}";
+                    con->send(makeFrame(session, stamped));
+                }
+                else if (session.deflater)
                 {
-                    server.send(hdl, message, websocketpp::frame::opcode::text);
+                    con->send(makeFrame(session, message));
                 }
-                catch (const std::exception &e)
+                else
                 {
-                    std::cerr << "Broadcast error: " << e.what() << std::endl;
+                    server_type::message_ptr &frame = sharedFrames[session.deflateWindowBits];
+                    if (!frame)
+                    {
+                        frame = makeFrame(session, message);
+                    }
+                    con->send(frame);
                 }
             }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Broadcast error: " << e.what() << std::endl;
+            }
         }
     }
 
-    void addSymbol(const std::string &symbol)
+    bool onValidate(connection_hdl hdl)
     {
-        std::lock_guard<std::mutex> lock(mutex);
-        subscriptions[symbol] = std::set<connection_hdl, std::owner_less<connection_hdl>>();
+        server_type::connection_ptr con = server.get_con_from_hdl(hdl);
+        if (!admitHandshake(con))
+        {
+            return false;
+        }
+        negotiateDeflate(con);
+        return true;
     }
 
-private:
-    websocketpp::server<websocketpp::config::asio> server;
-    std::unordered_map<std::string, std::set<connection_hdl, std::owner_less<connection_hdl>>> subscriptions;
-    std::mutex mutex;
+    // Cheap checks before the upgrade is accepted: the connection limit, the
+    // handshake rate of the remote address and, if the client sent them,
+    // credentials in an `Authorization: Basic` header
+    bool admitHandshake(const server_type::connection_ptr &con)
+    {
+        if (config->maxConnections != 0 && connectionCount >= config->maxConnections)
+        {
+            return rejectHandshake(con, websocketpp::http::status_code::service_unavailable, "connection limit");
+        }
+        if (config->handshakesPerIp > 0 && !addressBudget(remoteAddress(con)).tryConsume())
+        {
+            return rejectHandshake(con, websocketpp::http::status_code::too_many_requests, "handshake rate");
+        }
+        std::string authorization = con->get_request_header("Authorization");
+        if (!authorization.empty())
+        {
+            if (!authenticateBasic(authorization))
+            {
+                return rejectHandshake(con, websocketpp::http::status_code::forbidden, "invalid credentials");
+            }
+            con->authenticated = true;
+            con->entitlements = config->entitlements;
+        }
+        con->counted = true;
+        ++connectionCount;
+        return true;
+    }
+
+    // Logged as a count at most every few seconds: a storm must not turn
+    // into a stream of log lines on the io thread
+    bool rejectHandshake(const server_type::connection_ptr &con, websocketpp::http::status_code::value status, const char *reason)
+    {
+        con->set_status(status);
+        if (status != websocketpp::http::status_code::forbidden)
+        {
+            con->append_header("Retry-After", "1");
+        }
+        ++rejectedHandshakes;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRejectLog >= std::chrono::seconds(5))
+        {
+            std::cerr << "Rejected " << rejectedHandshakes << " handshakes so far (last: " << reason << ")" << std::endl;
+            lastRejectLog = now;
+        }
+        return false;
+    }
+
+    std::string remoteAddress(const server_type::connection_ptr &con)
+    {
+        boost::system::error_code ec;
+        auto endpoint = con->get_raw_socket().remote_endpoint(ec);
+        return ec ? std::string() : endpoint.address().to_string();
+    }
+
+    TokenBucket &addressBudget(const std::string &address)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (addressBudgets.size() >= pruneAddressesAt)
+        {
+            // An idle budget has refilled, so forgetting it changes nothing
+            for (auto it = addressBudgets.begin(); it != addressBudgets.end();)
+            {
+                it = now - it->second.lastSeen > std::chrono::seconds(60) ? addressBudgets.erase(it) : std::next(it);
+            }
+            pruneAddressesAt = std::max(kTrackedAddresses, addressBudgets.size() * 2);
+        }
+        auto [it, inserted] = addressBudgets.try_emplace(address);
+        if (inserted)
+        {
+            it->second.handshakes = TokenBucket(config->handshakesPerIp, config->handshakeBurst);
+        }
+        it->second.lastSeen = now;
+        return it->second.handshakes;
+    }
+
+    bool authenticateBasic(const std::string &authorization)
+    {
+        if (authorization.compare(0, 6, "Basic ") != 0)
+        {
+            return false;
+        }
+        std::string credentials = websocketpp::base64_decode(trim(authorization.substr(6)));
+        size_t colon = credentials.find(':');
+        return colon != std::string::npos && authenticate(credentials.substr(0, colon), credentials.substr(colon + 1));
+    }
+
+    // Connections that were counted give their slot back on close or on a
+    // failed handshake
+    void releaseSlot(connection_hdl hdl)
+    {
+        websocketpp::lib::error_code ec;
+        server_type::connection_ptr con = server.get_con_from_hdl(hdl, ec);
+        if (!ec && con->counted)
+        {
+            con->counted = false;
+            --connectionCount;
+        }
+    }
+
+    void scheduleAdmissions()
+    {
+        if (!admissionScheduled)
+        {
+            admissionScheduled = true;
+            server.get_io_service().post([this]()
+                                         { admitSessions(); });
+        }
+    }
+
+    // Releases up to kAdmitBatch queued sessions within the admission rate,
+    // then yields so feed drains queued behind it run before the next batch
+    void admitSessions()
+    {
+        admissionScheduled = false;
+        for (size_t admitted = 0; admitted < kAdmitBatch;)
+        {
+            std::deque<connection_hdl> &queue = priorityAdmissions.empty() ? admissions : priorityAdmissions;
+            if (queue.empty())
+            {
+                return;
+            }
+            websocketpp::lib::error_code ec;
+            server_type::connection_ptr con = server.get_con_from_hdl(queue.front(), ec);
+            if (ec || con->get_state() != websocketpp::session::state::open)
+            {
+                queue.pop_front(); // closed while waiting
+                continue;
+            }
+            if (!admissionBudget.tryConsume())
+            {
+                admissionScheduled = true;
+                server.set_timer(std::max(1L, static_cast<long>(1000 / config->admitRate)), [this](const websocketpp::lib::error_code &)
+                                 {
+                                     admissionScheduled = false;
+                                     admitSessions(); });
+                return;
+            }
+            queue.pop_front();
+            con->resume_reading();
+            ++admitted;
+        }
+        scheduleAdmissions();
+    }
+
+    // Runs after websocketpp has accepted any permessage-deflate offer (it
+    // then inflates what the client sends). The response is rewritten to the
+    // parameters of the compressor this server uses for the client, or the
+    // extension is declined.
+    void negotiateDeflate(const server_type::connection_ptr &con)
+    {
+        if (con->get_response_header("Sec-WebSocket-Extensions").empty())
+        {
+            return;
+        }
+        DeflateOffer offer = parseDeflateOffer(con->get_request_header("Sec-WebSocket-Extensions"));
+        if (!config->deflate || !offer.offered || offer.serverMaxWindowBits < kMinDeflateWindowBits)
+        {
+            con->remove_header("Sec-WebSocket-Extensions");
+            return;
+        }
+        bool contextTakeover = config->deflateContextTakeover && !offer.serverNoContextTakeover;
+        con->replace_header("Sec-WebSocket-Extensions", deflateResponse(offer, contextTakeover));
+        SessionState &session = *con;
+        session.deflateWindowBits = offer.serverMaxWindowBits;
+        if (contextTakeover)
+        {
+            session.deflater = std::make_unique<MessageDeflater>(config->deflateLevel, offer.serverMaxWindowBits, true);
+        }
+    }
+
+    // A ready-to-write text frame for this client. Everything the server
+    // sends goes through here: websocketpp's own compressor is never used, so
+    // it cannot disturb a client's inflate context.
+    server_type::message_ptr makeFrame(SessionState &session, const std::string &payload)
+    {
+        MessageDeflater *deflater = session.deflater.get();
+        if (!deflater && session.deflateWindowBits != 0)
+        {
+            std::unique_ptr<MessageDeflater> &shared = sharedDeflaters[session.deflateWindowBits];
+            if (!shared)
+            {
+                shared = std::make_unique<MessageDeflater>(config->deflateLevel, session.deflateWindowBits, false);
+            }
+            deflater = shared.get();
+        }
+        auto frame = std::make_shared<asio_with_session::message_type>(nullptr, websocketpp::frame::opcode::text, payload.size());
+        if (deflater)
+        {
+            deflater->compress(payload.data(), payload.size(), frame->get_raw_payload());
+        }
+        else
+        {
+            frame->set_payload(payload);
+        }
+        size_t size = frame->get_payload().size();
+        websocketpp::frame::basic_header header(websocketpp::frame::opcode::text, size, true, false, deflater != nullptr);
+        frame->set_header(websocketpp::frame::prepare_header(header, websocketpp::frame::extended_header(size)));
+        frame->set_prepared(true);
+        return frame;
+    }
 
-    std::string env_client_id;
-    std::string env_client_secret;
+    void send(connection_hdl hdl, const std::string &payload)
+    {
+        server_type::connection_ptr con = server.get_con_from_hdl(hdl);
+        con->send(makeFrame(*con, payload));
+    }
 
     void onOpen(connection_hdl hdl)
     {
-        std::cout << "Client connected." << std::endl;
+        server_type::connection_ptr con = server.get_con_from_hdl(hdl);
+        con->requestBudget = TokenBucket(config->messagesPerSecond, config->messageBurst);
+        if (config->admitRate <= 0)
+        {
+            return;
+        }
+        con->pause_reading();
+        (con->authenticated ? priorityAdmissions : admissions).push_back(hdl);
+        scheduleAdmissions();
+    }
+
+    void sendError(connection_hdl hdl, const std::string &error)
+    {
+        json reply = {{"status", "error"}, {"error", error}};
+        send(hdl, reply.dump());
     }
 
     void onClose(connection_hdl hdl)
     {
-        std::cout << "Client disconnected." << std::endl;
+        releaseSlot(hdl);
 
         // Remove the connection from all subscriptions
-        std::lock_guard<std::mutex> lock(mutex);
-        for (auto &[symbol, clients] : subscriptions)
+        std::vector<std::string> released;
+        for (auto it = subscriptions.begin(); it != subscriptions.end();)
+        {
+            if (it->second.erase(hdl))
+            {
+                released.push_back(it->first);
+            }
+            if (it->second.empty() && !pinned.count(it->first))
+            {
+                it = subscriptions.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        for (auto &[symbol, channel] : books)
+        {
+            for (size_t i = unsubscribeBook(hdl, symbol); i > 0; --i)
+            {
+                released.push_back(symbol);
+            }
+        }
+        notifyInterest(released, false);
+    }
+
+    // Bounded so a burst of market data cannot starve client requests
+    static constexpr size_t kDrainBatch = 256;
+
+    void drainFeed()
+    {
+        feedReader->poll([this](const MarketUpdate &update, int64_t)
+                         { publish(update); },
+                         kDrainBatch);
+        drainScheduled.store(false);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        // Covers both a full batch and updates published while the flag was set
+        if (feedReader->pending())
+        {
+            feedAvailable();
+        }
+    }
+
+    void publish(const MarketUpdate &update)
+    {
+        StageTimestamps ts;
+        ts.stamp(TraceStage::SourceReceive, update.receiveNs);
+        ts.stamp(TraceStage::BookUpdate, update.normalizedNs);
+        updateSymbol.assign(update.getSymbol());
+        if (update.kind == UpdateKind::Book)
+        {
+            publishBook(update, ts);
+        }
+        serializeUpdate(update, sequences[updateSymbol]++, updateMessage);
+        ts.stamp(TraceStage::Serialize);
+
+        // Stage stamps are appended to the serialized object rather than
+        // going through json so the serialize/enqueue times are exact.
+        bool traced = tracer.shouldSample(published++);
+        updateMessage.pop_back();
+        updateMessage += traced ? ",\"trace\":true," : ",";
+        ts.stamp(TraceStage::Enqueue);
+        ts.appendJson(updateMessage);
+        updateMessage += '}';
+
+        broadcast(updateSymbol, updateMessage, traced);
+    }
+
+    // Sends each depth stream of the symbol the levels that changed, or a
+    // first snapshot if the stream was waiting for a book. Each message gets
+    // the update's stage stamps like a full update, so clients can measure
+    // the delay of the stream.
+    void publishBook(const MarketUpdate &update, StageTimestamps ts)
+    {
+        BookChannel &channel = books[updateSymbol];
+        channel.latest = update;
+        channel.latestSeq = sequences[updateSymbol];
+        channel.hasBook = true;
+        for (auto &[depth, stream] : channel.streams)
+        {
+            bool first = !stream.book.ready();
+            if (!stream.book.apply(update, bookMessage) && !first)
+            {
+                continue;
+            }
+            if (first)
+            {
+                stream.book.snapshot(bookMessage);
+            }
+            ts.stamp(TraceStage::Serialize);
+            bookMessage.back() = ',';
+            ts.stamp(TraceStage::Enqueue);
+            ts.appendJson(bookMessage);
+            bookMessage += '}';
+            sendToAll(stream.clients, bookMessage, false);
+        }
+    }
+
+    bool hasBookSubscription(connection_hdl hdl, const std::string &symbol, int depth) const
+    {
+        auto channel = books.find(symbol);
+        if (channel == books.end())
+        {
+            return false;
+        }
+        auto stream = channel->second.streams.find(depth);
+        return stream != channel->second.streams.end() && stream->second.clients.count(hdl) != 0;
+    }
+
+    // Adds the client to the symbol's stream for `depth` and, if a book has
+    // been seen, appends its snapshot to `snapshots` (comma-separated); false
+    // if it was already subscribed.
+    bool subscribeBook(connection_hdl hdl, const std::string &symbol, int depth, std::string &snapshots)
+    {
+        BookChannel &channel = books[symbol];
+        BookStream &stream = channel.streams.try_emplace(depth, BookStream{DepthBook(depth), ClientSet()}).first->second;
+        if (!stream.clients.insert(hdl).second)
+        {
+            return false;
+        }
+        if (channel.hasBook)
+        {
+            if (!stream.book.ready())
+            {
+                stream.book.apply(channel.latest, bookMessage);
+            }
+            stream.book.snapshot(bookMessage);
+            if (!snapshots.empty())
+            {
+                snapshots += ',';
+            }
+            snapshots += bookMessage;
+        }
+        return true;
+    }
+
+    // Removes the client from every depth stream of the symbol; returns how
+    // many it was in. Streams without clients are dropped with their state.
+    size_t unsubscribeBook(connection_hdl hdl, const std::string &symbol)
+    {
+        auto channel = books.find(symbol);
+        if (channel == books.end())
+        {
+            return 0;
+        }
+        size_t removed = 0;
+        for (auto it = channel->second.streams.begin(); it != channel->second.streams.end();)
+        {
+            removed += it->second.clients.erase(hdl);
+            if (it->second.clients.empty())
+            {
+                it = channel->second.streams.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return removed;
+    }
+
+    void notifyInterest(const std::vector<std::string> &symbols, bool interested)
+    {
+        if (interestHandler && !symbols.empty())
+        {
+            interestHandler(symbols, interested);
+        }
+    }
+
+    // Symbols named by a subscribe/unsubscribe request: "symbol" (a string)
+    // and/or "symbols" (an array). Entries ending in '*' are patterns over the
+    // symbols this server carries (pinned, subscribed or seen in the feed),
+    // limited to the client's entitlements. An exact symbol the client is
+    // not entitled to fails the whole request.
+    bool resolveSymbols(const arena_json &request, const SessionState &session, std::vector<std::string> &symbols, std::string &error)
+    {
+        std::vector<std::string> entries;
+        if (request.contains("symbol"))
+        {
+            if (!request["symbol"].is_string())
+            {
+                error = "symbol must be a string";
+                return false;
+            }
+            entries.push_back(request["symbol"].get<std::string>());
+        }
+        if (request.contains("symbols"))
+        {
+            if (!request["symbols"].is_array())
+            {
+                error = "symbols must be an array";
+                return false;
+            }
+            for (const arena_json &entry : request["symbols"])
+            {
+                if (!entry.is_string())
+                {
+                    error = "symbols must be an array of strings";
+                    return false;
+                }
+                entries.push_back(entry.get<std::string>());
+            }
+        }
+        std::string patterns;
+        for (const std::string &entry : entries)
+        {
+            if (!entry.empty() && entry.back() == '*')
+            {
+                patterns += entry + ",";
+            }
+            else if (!session.entitlements->allows(entry))
+            {
+                error = "Not entitled to " + entry;
+                return false;
+            }
+            else if (!ownsSymbol(entry))
+            {
+                error = entry + " is served by relay shard " + std::to_string(relayShardOf(entry, config->relayShards));
+                return false;
+            }
+            else
+            {
+                symbols.push_back(entry);
+            }
+        }
+        if (!patterns.empty())
+        {
+            Entitlements matcher(patterns);
+            auto match = [&](const std::string &symbol)
+            {
+                if (matcher.allows(symbol) && session.entitlements->allows(symbol) && ownsSymbol(symbol))
+                {
+                    symbols.push_back(symbol);
+                }
+            };
+            for (const auto &[symbol, clients] : subscriptions)
+            {
+                match(symbol);
+            }
+            for (const auto &[symbol, sequence] : sequences)
+            {
+                match(symbol);
+            }
+        }
+        std::sort(symbols.begin(), symbols.end());
+        symbols.erase(std::unique(symbols.begin(), symbols.end()), symbols.end());
+        if (symbols.empty())
+        {
+            error = "No matching symbols";
+            return false;
+        }
+        return true;
+    }
+
+    // Applies a whole subscribe request at once: either every symbol is added
+    // or, if that would exceed the client's limit, none is. The client gets
+    // one reply frame listing the symbols, with a snapshot of every newly
+    // added symbol that has a book: the stream's snapshot for book streams,
+    // or the last full book update for `depth` 0 (full updates).
+    void subscribe(connection_hdl hdl, SessionState &session, const std::vector<std::string> &symbols, int depth)
+    {
+        size_t fresh = 0;
+        for (const std::string &symbol : symbols)
+        {
+            if (depth == 0)
+            {
+                auto it = subscriptions.find(symbol);
+                fresh += it == subscriptions.end() || it->second.count(hdl) == 0;
+            }
+            else
+            {
+                fresh += !hasBookSubscription(hdl, symbol, depth);
+            }
+        }
+        if (config->maxSubscriptions != 0 && session.subscriptionCount + fresh > config->maxSubscriptions)
+        {
+            sendError(hdl, "Subscription limit reached");
+            return;
+        }
+
+        std::vector<std::string> added;
+        std::string snapshots;
+        for (const std::string &symbol : symbols)
+        {
+            bool inserted = depth == 0 ? subscriptions[symbol].insert(hdl).second : subscribeBook(hdl, symbol, depth, snapshots);
+            if (inserted)
+            {
+                added.push_back(symbol);
+                if (depth == 0)
+                {
+                    appendLatestBook(symbol, snapshots);
+                }
+            }
+        }
+        session.subscriptionCount += added.size();
+        notifyInterest(added, true);
+
+        arena_json reply = {{"status", "subscribed"}, {"symbols", arena_json::array()}};
+        for (const std::string &symbol : symbols)
+        {
+            reply["symbols"].push_back(symbol);
+        }
+        if (depth != 0)
+        {
+            reply["channel"] = "book";
+            reply["depth"] = depth;
+        }
+        arena_string text = reply.dump();
+        std::string frame(text.data(), text.size());
+        frame.pop_back();
+        frame += ",\"snapshots\":[";
+        frame += snapshots;
+        frame += "]}";
+        send(hdl, frame);
+    }
+
+    // Appends the last book update of the symbol, as it was broadcast but
+    // without stage stamps, to `snapshots` (comma-separated)
+    void appendLatestBook(const std::string &symbol, std::string &snapshots)
+    {
+        auto channel = books.find(symbol);
+        if (channel == books.end() || !channel->second.hasBook)
+        {
+            return;
+        }
+        serializeUpdate(channel->second.latest, channel->second.latestSeq, bookMessage);
+        if (!snapshots.empty())
+        {
+            snapshots += ',';
+        }
+        snapshots += bookMessage;
+    }
+
+    // Removes the symbols from the client's full-update subscriptions, or
+    // from all its book streams of those symbols when `book` is set
+    void unsubscribe(connection_hdl hdl, SessionState &session, const std::vector<std::string> &symbols, bool book)
+    {
+        std::vector<std::string> removed;
+        for (const std::string &symbol : symbols)
+        {
+            if (book)
+            {
+                for (size_t i = unsubscribeBook(hdl, symbol); i > 0; --i)
+                {
+                    removed.push_back(symbol);
+                }
+                continue;
+            }
+            auto it = subscriptions.find(symbol);
+            if (it != subscriptions.end() && it->second.erase(hdl))
+            {
+                if (it->second.empty() && !pinned.count(symbol))
+                {
+                    subscriptions.erase(it);
+                }
+                removed.push_back(symbol);
+            }
+        }
+        session.subscriptionCount -= removed.size();
+        notifyInterest(removed, false);
+
+        arena_json reply = {{"status", "unsubscribed"}, {"symbols", arena_json::array()}};
+        for (const std::string &symbol : symbols)
         {
-            clients.erase(hdl);
+            reply["symbols"].push_back(symbol);
         }
+        arena_string text = reply.dump();
+        send(hdl, std::string(text.data(), text.size()));
     }
 
-    void onMessage(connection_hdl hdl, websocketpp::server<websocketpp::config::asio>::message_ptr msg)
+    void onMessage(connection_hdl hdl, server_type::message_ptr msg)
     {
         try
         {
-            auto payload = msg->get_payload();
-            auto parsed = json::parse(payload);
+            server_type::connection_ptr con = server.get_con_from_hdl(hdl);
+            SessionState &session = *con;
+            if (!session.requestBudget.tryConsume())
+            {
+                sendError(hdl, "Rate limit exceeded");
+                return;
+            }
+
+            // Parsed in the io thread's arena, released when the message is done
+            ArenaScope scope;
+            auto parsed = arena_json::parse(msg->get_payload());
 
             if (parsed["action"] == "authenticate")
             {
@@ -147,27 +875,69 @@ private:
 
                 if (authenticate(client_id, client_secret))
                 {
-                    server.send(hdl, R"({"status":"authenticated"})", websocketpp::frame::opcode::text);
+                    session.authenticated = true;
+                    session.entitlements = config->entitlements;
+                    send(hdl, R"({"status":"authenticated"})");
                 }
                 else
                 {
-                    server.send(hdl, R"({"status":"error","error":"Invalid credentials"})", websocketpp::frame::opcode::text);
+                    send(hdl, R"({"status":"error","error":"Invalid credentials"})");
                     server.close(hdl, websocketpp::close::status::policy_violation, "Authentication failed");
                 }
             }
-            else if (parsed["action"] == "subscribe")
+            else if (!session.authenticated)
+            {
+                sendError(hdl, "Not authenticated");
+            }
+            else if (parsed["action"] == "subscribe" || parsed["action"] == "unsubscribe")
+            {
+                bool subscribing = parsed["action"] == "subscribe";
+                bool book = parsed.contains("channel") && parsed["channel"] == "book";
+                if (parsed.contains("channel") && !book)
+                {
+                    sendError(hdl, "Unknown channel");
+                    return;
+                }
+                int depth = book ? parsed.value("depth", kMaxDepth) : 0;
+                if (book && (depth < 1 || depth > kMaxDepth))
+                {
+                    sendError(hdl, "Book depth must be between 1 and " + std::to_string(kMaxDepth));
+                    return;
+                }
+                std::vector<std::string> symbols;
+                std::string error;
+                if (!resolveSymbols(parsed, session, symbols, error))
+                {
+                    sendError(hdl, error);
+                }
+                else if (subscribing)
+                {
+                    subscribe(hdl, session, symbols, depth);
+                }
+                else
+                {
+                    unsubscribe(hdl, session, symbols, book);
+                }
+            }
+            else if (parsed["action"] == "trace_echo")
             {
-                std::string symbol = parsed["symbol"];
-                std::lock_guard<std::mutex> lock(mutex);
-                subscriptions[symbol].insert(hdl);
-                std::cout << "Client subscribed to " << symbol << std::endl;
+                // Client echoed a sampled update's stage timestamps plus its receive time
+                StageTimestamps ts;
+                for (int stage = 0; stage < static_cast<int>(TraceStage::Count); ++stage)
+                {
+                    const char *key = traceStageKey(static_cast<TraceStage>(stage));
+                    if (parsed["ts"].contains(key))
+                    {
+                        ts.stamp(static_cast<TraceStage>(stage), parsed["ts"][key].get<int64_t>());
+                    }
+                }
+                ts.stamp(TraceStage::EchoReceive);
+                tracer.record(ts);
             }
-            else if (parsed["action"] == "unsubscribe")
+            else if (parsed["action"] == "trace_stats")
             {
-                std::string symbol = parsed["symbol"];
-                std::lock_guard<std::mutex> lock(mutex);
-                subscriptions[symbol].erase(hdl);
-                std::cout << "Client unsubscribed from " << symbol << std::endl;
+                json stats = {{"trace_stats", tracer.summary<json>()}};
+                send(hdl, stats.dump());
             }
         }
         catch (const std::exception &e)
@@ -178,22 +948,47 @@ private:
 
     bool authenticate(const std::string &client_id, const std::string &client_secret)
     {
-        return client_id == env_client_id && client_secret == env_client_secret;
+        return client_id == config->clientId && client_secret == config->clientSecret;
     }
 };
 
-void streamMarketData(WebSocketServer &server, const std::string &symbol)
+// Copies every update from the feed ring into the shared-memory bus, sleeping
+// on `wakeup` while the ring is empty
+void publishToSharedMemory(RingConsumer<MarketUpdate> &reader, ShmBusWriter &bus, RingWakeup &wakeup, const std::atomic<bool> &running)
 {
-    while (true)
+    while (running)
     {
-        json update = {
-            {"symbol", symbol},
-            {"best_bid", rand() % 100 + 1},
-            {"best_ask", rand() % 100 + 50},
-            {"timestamp", time(nullptr)}};
+        if (reader.poll([&bus](const MarketUpdate &update, int64_t)
+                        { bus.publish(update); }) == 0)
+        {
+            wakeup.wait(reader, -1);
+        }
+    }
+}
+
+// Runs `stop` when the scope exits, including during stack unwinding, so a
+// thread that uses objects of the scope is stopped before they are destroyed
+template <typename Stop>
+class ScopeStop
+{
+public:
+    explicit ScopeStop(Stop stop) : stop(std::move(stop)) {}
+    ~ScopeStop() { stop(); }
+
+    ScopeStop(const ScopeStop &) = delete;
+    ScopeStop &operator=(const ScopeStop &) = delete;
+
+private:
+    Stop stop;
+};
 
-        server.broadcast(symbol, update.dump());
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+// Periodically logs the per-hop latency histograms while tracing is enabled
+void reportTraceStats(const WebSocketServer &server)
+{
+    while (true)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+        std::cout << "Trace stats: " << server.getTracer().summary<json>().dump() << std::endl;
     }
 }
 
@@ -201,17 +996,117 @@ int main()
 {
     try
     {
-        WebSocketServer server;
-        server.addSymbol("ETH-PERPETUAL");
+        auto config = ServerConfig::fromEnv(envConfig());
+        WebSocketServer server(config);
+        // A relay edge takes its market data from the root at FEED_URL
+        std::unique_ptr<MarketDataSource> feed;
+        if (config->feedSource == "relay")
+        {
+            feed = std::make_unique<RelayFeed>(config->feedUrl);
+        }
+        else
+        {
+            feed = makeMarketDataSource(config->feedSource, config->feedUrl, config->feedRecordPath, config->replayPath, config->replaySpeed);
+        }
+        MulticastRing<MarketUpdate> ring(config->feedQueueCapacity);
+        server.attachFeed(ring);
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> running{true};
+
+        // Local processes can read the same updates from shared memory
+        std::unique_ptr<ShmBusWriter> shmBus;
+        std::unique_ptr<RingConsumer<MarketUpdate>> shmReader;
+        RingWakeup shmWakeup;
+        std::thread shmThread;
+        ScopeStop shmStop([&running, &shmWakeup, &shmThread]()
+                          {
+                              running = false;
+                              if (shmThread.joinable())
+                              {
+                                  shmWakeup.wake();
+                                  shmThread.join();
+                              } });
+        if (!config->shmName.empty())
+        {
+            shmBus = std::make_unique<ShmBusWriter>(config->shmName, config->shmSymbols, config->shmLogSize);
+            shmReader = std::make_unique<RingConsumer<MarketUpdate>>(ring);
+            shmThread = std::thread(publishToSharedMemory, std::ref(*shmReader), std::ref(*shmBus), std::ref(shmWakeup), std::cref(running));
+            std::cout << "Shared-memory bus: " << config->shmName << std::endl;
+        }
+
+        // Upstream subscriptions follow downstream interest: every client
+        // subscription holds a reference, the manager batches the changes
+        SubscriptionManager subscriptionManager(*feed, config->feedBatchWindow, config->feedTeardownDelay);
+        std::vector<std::string> pinnedSymbols;
+        for (const std::string &symbol : config->feedSymbols)
+        {
+            if (server.ownsSymbol(symbol))
+            {
+                server.addSymbol(symbol);
+                pinnedSymbols.push_back(symbol);
+            }
+        }
+        subscriptionManager.pin(pinnedSymbols);
+        auto interest = [&subscriptionManager](const std::vector<std::string> &symbols, bool interested)
+        {
+            if (interested)
+            {
+                subscriptionManager.acquire(symbols);
+            }
+            else
+            {
+                subscriptionManager.release(symbols);
+            }
+        };
+        server.setInterestHandler(interest);
 
-        std::thread serverThread([&server]()
-                                 { server.run(9000); });
+        // Root of a relay tier: edges hold references like clients do
+        std::unique_ptr<RelayPublisher> relay;
+        if (!config->relayListen.empty())
+        {
+            relay = std::make_unique<RelayPublisher>(config->relayListen, ring, interest, config->relayMaxBuffered);
+            relay->start();
+            std::cout << "Relay: listening for edges on " << config->relayListen << std::endl;
+        }
+        // The feed thread publishes into the ring, the wakeups and the relay,
+        // which are destroyed before `feed` is: stop it first on every exit
+        ScopeStop feedStop([&feed]()
+                           { feed->stop(); });
+        feed->start([&ring, &server, &shmWakeup, &relay, &dropped](const MarketUpdate &update)
+                    {
+                        if (ring.tryPublish(update))
+                        {
+                            server.feedAvailable();
+                            shmWakeup.notify();
+                            if (relay)
+                            {
+                                relay->feedAvailable();
+                            }
+                        }
+                        else if (dropped.fetch_add(1, std::memory_order_relaxed) % 10000 == 0)
+                        {
+                            std::cerr << "Feed queue full, dropping updates" << std::endl;
+                        } });
+        // Only once the source is started: its subscribe() may need the
+        // io_service that start() creates
+        subscriptionManager.start();
+        std::cout << "Market data source: " << feed->name() << std::endl;
 
-        std::thread dataThread([&server]()
-                               { streamMarketData(server, "ETH-PERPETUAL"); });
+        std::thread serverThread([&server, &config]()
+                                 { server.run(config->port); });
+
+        if (server.getTracer().enabled())
+        {
+            std::thread(reportTraceStats, std::cref(server)).detach();
+        }
 
         serverThread.join();
-        dataThread.join();
+        if (relay)
+        {
+            relay->stop();
+        }
+        subscriptionManager.stop();
+        feed->stop();
     }
     catch (const std::exception &e)
     {
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "config.hpp"
+#include "deflate.hpp"
+
+// Symbols a client may subscribe to. Entries are exact symbols or prefix
+// patterns ending in '*' (e.g. "BTC-*"); a lone "*" allows everything.
+class Entitlements
+{
+public:
+    explicit Entitlements(const std::string &spec)
+    {
+        std::stringstream ss(spec);
+        std::string entry;
+        while (std::getline(ss, entry, ','))
+        {
+            entry = trim(entry);
+            if (entry == "*")
+            {
+                allowAll = true;
+            }
+            else if (!entry.empty() && entry.back() == '*')
+            {
+                prefixes.push_back(entry.substr(0, entry.size() - 1));
+            }
+            else if (!entry.empty())
+            {
+                symbols.insert(entry);
+            }
+        }
+    }
+
+    bool allows(const std::string &symbol) const
+    {
+        if (allowAll || symbols.count(symbol))
+        {
+            return true;
+        }
+        return std::any_of(prefixes.begin(), prefixes.end(), [&symbol](const std::string &prefix)
+                           { return symbol.compare(0, prefix.size(), prefix) == 0; });
+    }
+
+private:
+    bool allowAll = false;
+    std::unordered_set<std::string> symbols;
+    std::vector<std::string> prefixes;
+};
+
+// Classic token bucket used to rate-limit a client's inbound requests
+class TokenBucket
+{
+public:
+    TokenBucket() = default;
+    TokenBucket(double ratePerSecond, double burst)
+        : rate(ratePerSecond), capacity(burst), tokens(burst), last(std::chrono::steady_clock::now()) {}
+
+    bool tryConsume(double amount = 1.0)
+    {
+        if (rate <= 0)
+        {
+            return true; // unlimited
+        }
+        auto now = std::chrono::steady_clock::now();
+        tokens = std::min(capacity, tokens + std::chrono::duration<double>(now - last).count() * rate);
+        last = now;
+        if (tokens < amount)
+        {
+            return false;
+        }
+        tokens -= amount;
+        return true;
+    }
+
+private:
+    double rate = 0;
+    double capacity = 0;
+    double tokens = 0;
+    std::chrono::steady_clock::time_point last;
+};
+
+// Immutable server settings, built once from the .env file at startup
+struct ServerConfig
+{
+    std::string clientId;
+    std::string clientSecret;
+    std::shared_ptr<const Entitlements> entitlements;
+    double messagesPerSecond = 0; // inbound requests per connection, 0 = unlimited
+    double messageBurst = 0;
+    size_t maxSubscriptions = 0; // per connection, 0 = unlimited
+    uint64_t traceSampleEvery = 0;
+    std::string feedSource; // "deribit", "mock" or "replay"
+    std::string feedUrl;
+    std::vector<std::string> feedSymbols; // always subscribed upstream
+    std::string feedRecordPath; // raw upstream capture, empty = off
+    std::string replayPath;
+    double replaySpeed = 1.0; // 0 = as fast as possible
+    size_t feedQueueCapacity = 0;
+    std::chrono::milliseconds feedBatchWindow{10}; // upstream (un)subscribes are batched per window
+    std::chrono::milliseconds feedTeardownDelay{5000}; // unused symbols stay subscribed this long
+    std::string shmName; // shared-memory bus segment, empty = off
+    uint32_t shmSymbols = 0;
+    uint64_t shmLogSize = 0;
+    bool deflate = false; // permessage-deflate for clients that offer it
+    int deflateLevel = 1;
+    bool deflateContextTakeover = false; // one compressor per client instead of per group
+    size_t maxConnections = 0; // 0 = unlimited
+    double handshakesPerIp = 0; // per remote address per second, 0 = unlimited
+    double handshakeBurst = 0;
+    double admitRate = 0; // new sessions released to the io thread per second, 0 = unlimited
+    int acceptBacklog = 0;
+    uint16_t port = 9000;
+    std::string relayListen; // root: address edges connect to, empty = off
+    size_t relayMaxBuffered = 0; // root: unsent bytes per edge before it is dropped
+    int relayShard = 0; // edge: the share of symbols this server serves
+    int relayShards = 1;
+
+    static std::shared_ptr<const ServerConfig> fromEnv(const EnvConfig &env)
+    {
+        auto config = std::make_shared<ServerConfig>();
+        config->clientId = env.get("CLIENT_ID");
+        config->clientSecret = env.get("CLIENT_SECRET");
+        if (config->clientId.empty() || config->clientSecret.empty())
+        {
+            throw std::runtime_error("CLIENT_ID or CLIENT_SECRET missing in .env file");
+        }
+        config->entitlements = std::make_shared<Entitlements>(env.get("CLIENT_ENTITLEMENTS", "*"));
+        config->messagesPerSecond = env.getDouble("CLIENT_MAX_MESSAGES_PER_SEC", 50);
+        config->messageBurst = env.getDouble("CLIENT_MESSAGE_BURST", 200);
+        config->maxSubscriptions = static_cast<size_t>(env.getInt("CLIENT_MAX_SUBSCRIPTIONS", 0));
+        config->traceSampleEvery = static_cast<uint64_t>(env.getInt("TRACE_SAMPLE_EVERY", 0));
+        config->feedSource = env.get("FEED_SOURCE", "deribit");
+        config->feedUrl = env.get("FEED_URL", "wss://test.deribit.com/ws/api/v2");
+        std::stringstream symbols(env.get("FEED_SYMBOLS", "ETH-PERPETUAL"));
+        std::string symbol;
+        while (std::getline(symbols, symbol, ','))
+        {
+            if (!trim(symbol).empty())
+            {
+                config->feedSymbols.push_back(trim(symbol));
+            }
+        }
+        config->feedRecordPath = env.get("FEED_RECORD");
+        config->replayPath = env.get("FEED_REPLAY_FILE", "feed.log");
+        config->replaySpeed = env.getDouble("FEED_REPLAY_SPEED", 1.0);
+        config->feedQueueCapacity = static_cast<size_t>(env.getInt("FEED_QUEUE_CAPACITY", 65536));
+        config->feedBatchWindow = std::chrono::milliseconds(env.getInt("FEED_BATCH_MS", 10));
+        config->feedTeardownDelay = std::chrono::milliseconds(env.getInt("FEED_TEARDOWN_MS", 5000));
+        config->shmName = env.get("SHM_BUS_NAME");
+        config->shmSymbols = static_cast<uint32_t>(env.getInt("SHM_BUS_SYMBOLS", 4096));
+        config->shmLogSize = static_cast<uint64_t>(env.getInt("SHM_BUS_LOG_SIZE", 16384));
+        config->deflate = env.getInt("WS_DEFLATE", 0) != 0;
+        config->deflateLevel = static_cast<int>(env.getInt("WS_DEFLATE_LEVEL", 1));
+        config->deflateContextTakeover = env.getInt("WS_DEFLATE_CONTEXT_TAKEOVER", 0) != 0;
+        config->maxConnections = static_cast<size_t>(env.getInt("WS_MAX_CONNECTIONS", 0));
+        config->handshakesPerIp = env.getDouble("WS_HANDSHAKES_PER_IP_PER_SEC", 0);
+        config->handshakeBurst = env.getDouble("WS_HANDSHAKE_BURST", 20);
+        config->admitRate = env.getDouble("WS_ADMIT_PER_SEC", 2000);
+        config->acceptBacklog = static_cast<int>(env.getInt("WS_ACCEPT_BACKLOG", 4096));
+        config->port = static_cast<uint16_t>(env.getInt("WS_PORT", 9000));
+        config->relayListen = env.get("RELAY_LISTEN");
+        config->relayMaxBuffered = static_cast<size_t>(env.getInt("RELAY_EDGE_BUFFER", 64 << 20));
+        std::string shard = env.get("RELAY_SHARD");
+        if (!shard.empty())
+        {
+            size_t slash = shard.find('/');
+            config->relayShard = std::atoi(shard.c_str());
+            config->relayShards = slash == std::string::npos ? 0 : std::atoi(shard.c_str() + slash + 1);
+            if (config->relayShards < 1 || config->relayShard < 0 || config->relayShard >= config->relayShards)
+            {
+                throw std::runtime_error("RELAY_SHARD must be <index>/<count> with index < count");
+            }
+        }
+        if (config->deflateLevel < 0 || config->deflateLevel > 9)
+        {
+            throw std::runtime_error("WS_DEFLATE_LEVEL must be between 0 and 9");
+        }
+        return config;
+    }
+};
+
+// Per-connection session state. Used as websocketpp's connection_base, so it
+// lives inside the connection object and is reached from a handle with
+// get_con_from_hdl() instead of a separate map lookup.
+struct SessionState
+{
+    bool authenticated = false;
+    std::shared_ptr<const Entitlements> entitlements; // set on successful auth
+    TokenBucket requestBudget;
+    size_t subscriptionCount = 0;
+    int deflateWindowBits = 0; // negotiated permessage-deflate window, 0 = uncompressed
+    std::unique_ptr<MessageDeflater> deflater; // own context (context takeover only)
+    bool counted = false; // holds one of the server's connection slots
+};
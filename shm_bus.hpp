@@ -0,0 +1,339 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "feed_handler.hpp"
+#include "ring_buffer.hpp"
+
+// Shared-memory market data bus for processes on the same host.
+//
+// The server maps a POSIX shared memory segment and writes every normalized
+// MarketUpdate into it twice: into the symbol's latest-state slot for that
+// update kind (book, ticker, last trade), and into an event log that
+// consumers follow in order. Both are seqlocks, so readers never block the
+// writer and need no syscalls after mapping the segment: a read copies the
+// update and retries if the writer was active. The log does not wait for
+// readers; one that falls a full log behind skips ahead and counts the gap.
+//
+// Layout: ShmBusHeader | ShmBusSymbol[symbolCapacity] | ShmBusSlot[logCapacity]
+
+constexpr uint64_t kShmBusMagic = 0x31424d4853425244; // "DRBSHMB1" in little-endian memory
+constexpr uint32_t kShmBusVersion = 1;
+constexpr size_t kShmBusWords = sizeof(MarketUpdate) / sizeof(uint64_t);
+
+static_assert(sizeof(MarketUpdate) % sizeof(uint64_t) == 0, "updates are copied as 64-bit words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be address-free");
+
+// One update behind a seqlock. Latest-state slots use the sequence as an
+// odd/even write counter; log slots store 2 * position + 1 while writing and
+// 2 * position + 2 when done, so readers can also tell which position a slot
+// holds.
+struct alignas(64) ShmBusSlot
+{
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[kShmBusWords];
+};
+
+struct ShmBusSymbol
+{
+    char name[48];
+    ShmBusSlot latest[3]; // indexed by UpdateKind
+};
+
+struct alignas(64) ShmBusHeader
+{
+    std::atomic<uint64_t> magic; // stored last, with release
+    uint32_t version;
+    uint32_t updateSize;
+    uint32_t symbolCapacity;
+    uint32_t reserved;
+    uint64_t logCapacity; // power of two
+    std::atomic<uint32_t> symbolCount; // names below this index are final
+    alignas(64) std::atomic<uint64_t> logCursor; // next log position to write
+};
+
+inline size_t shmBusSize(uint32_t symbolCapacity, uint64_t logCapacity)
+{
+    return sizeof(ShmBusHeader) + sizeof(ShmBusSymbol) * symbolCapacity + sizeof(ShmBusSlot) * logCapacity;
+}
+
+// Publishes updates into the segment; one writer per segment
+class ShmBusWriter
+{
+public:
+    ShmBusWriter(const std::string &name, uint32_t symbolCapacity = 4096, uint64_t logCapacity = 65536)
+        : name(name), size(shmBusSize(symbolCapacity, ringCapacity(logCapacity)))
+    {
+        logCapacity = ringCapacity(logCapacity);
+        // A fresh segment each run: readers of a previous one keep their
+        // mapping but see no more updates
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("ftruncate " + name + ": " + std::strerror(error));
+        }
+        void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            shm_unlink(name.c_str());
+            throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+        }
+        base = static_cast<char *>(mapped);
+
+        // The segment starts zeroed; the magic is stored last with release,
+        // so a reader that loads it with acquire sees the whole header
+        header = reinterpret_cast<ShmBusHeader *>(base);
+        header->version = kShmBusVersion;
+        header->updateSize = sizeof(MarketUpdate);
+        header->symbolCapacity = symbolCapacity;
+        header->logCapacity = logCapacity;
+        symbolTable = reinterpret_cast<ShmBusSymbol *>(base + sizeof(ShmBusHeader));
+        log = reinterpret_cast<ShmBusSlot *>(base + sizeof(ShmBusHeader) + sizeof(ShmBusSymbol) * symbolCapacity);
+        mask = logCapacity - 1;
+        header->magic.store(kShmBusMagic, std::memory_order_release);
+    }
+
+    ~ShmBusWriter()
+    {
+        munmap(base, size);
+        shm_unlink(name.c_str());
+    }
+
+    ShmBusWriter(const ShmBusWriter &) = delete;
+    ShmBusWriter &operator=(const ShmBusWriter &) = delete;
+
+    // Returns false if the symbol table is full (the update still goes to the log)
+    bool publish(const MarketUpdate &update)
+    {
+        bool stored = false;
+        key.assign(update.getSymbol());
+        auto it = symbols.find(key);
+        if (it == symbols.end())
+        {
+            uint32_t count = header->symbolCount.load(std::memory_order_relaxed);
+            if (count < header->symbolCapacity)
+            {
+                std::memcpy(symbolTable[count].name, update.symbol, sizeof(update.symbol));
+                header->symbolCount.store(count + 1, std::memory_order_release);
+                it = symbols.emplace(key, count).first;
+            }
+        }
+        if (it != symbols.end())
+        {
+            ShmBusSlot &slot = symbolTable[it->second].latest[static_cast<int>(update.kind)];
+            uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+            write(slot, sequence + 1, sequence + 2, update);
+            stored = true;
+        }
+
+        uint64_t position = header->logCursor.load(std::memory_order_relaxed);
+        write(log[position & mask], 2 * position + 1, 2 * position + 2, update);
+        header->logCursor.store(position + 1, std::memory_order_release);
+        return stored;
+    }
+
+    uint64_t getPublished() const
+    {
+        return header->logCursor.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::string name;
+    size_t size;
+    char *base = nullptr;
+    ShmBusHeader *header = nullptr;
+    ShmBusSymbol *symbolTable = nullptr;
+    ShmBusSlot *log = nullptr;
+    uint64_t mask = 0;
+    std::unordered_map<std::string, uint32_t> symbols;
+    std::string key; // reused for lookups
+
+    static void write(ShmBusSlot &slot, uint64_t writing, uint64_t done, const MarketUpdate &update)
+    {
+        uint64_t words[kShmBusWords];
+        std::memcpy(words, &update, sizeof(update));
+        slot.sequence.store(writing, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < kShmBusWords; ++i)
+        {
+            slot.words[i].store(words[i], std::memory_order_relaxed);
+        }
+        slot.sequence.store(done, std::memory_order_release);
+    }
+};
+
+// Client side: maps a segment read-only. Not thread-safe; use one reader per
+// consuming thread.
+class ShmBusReader
+{
+public:
+    explicit ShmBusReader(const std::string &name)
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(ShmBusHeader))
+        {
+            close(fd);
+            throw std::runtime_error("shared memory " + name + " is not initialized");
+        }
+        size = static_cast<size_t>(info.st_size);
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw std::runtime_error("mmap " + name + ": " + std::strerror(errno));
+        }
+        base = static_cast<const char *>(mapped);
+        header = reinterpret_cast<const ShmBusHeader *>(base);
+        if (header->magic.load(std::memory_order_acquire) != kShmBusMagic || header->version != kShmBusVersion ||
+            header->updateSize != sizeof(MarketUpdate) || size < shmBusSize(header->symbolCapacity, header->logCapacity))
+        {
+            munmap(const_cast<char *>(base), size);
+            throw std::runtime_error("shared memory " + name + " has an incompatible layout");
+        }
+        symbolTable = reinterpret_cast<const ShmBusSymbol *>(base + sizeof(ShmBusHeader));
+        log = reinterpret_cast<const ShmBusSlot *>(base + sizeof(ShmBusHeader) + sizeof(ShmBusSymbol) * header->symbolCapacity);
+        mask = header->logCapacity - 1;
+        position = header->logCursor.load(std::memory_order_acquire);
+    }
+
+    ~ShmBusReader()
+    {
+        munmap(const_cast<char *>(base), size);
+    }
+
+    ShmBusReader(const ShmBusReader &) = delete;
+    ShmBusReader &operator=(const ShmBusReader &) = delete;
+
+    // Latest update of one kind for a symbol; false if none was published yet
+    bool latest(const std::string &symbol, UpdateKind kind, MarketUpdate &out)
+    {
+        int index = findSymbol(symbol);
+        if (index < 0)
+        {
+            return false;
+        }
+        const ShmBusSlot &slot = symbolTable[index].latest[static_cast<int>(kind)];
+        uint64_t before;
+        do
+        {
+            before = slot.sequence.load(std::memory_order_acquire);
+            if (before == 0)
+            {
+                return false;
+            }
+            copy(slot, out);
+        } while ((before & 1) || before != slot.sequence.load(std::memory_order_relaxed));
+        return true;
+    }
+
+    // Calls handler(update) for up to `limit` log entries published since the
+    // last poll (or since the reader was created); returns how many
+    template <typename Handler>
+    size_t poll(Handler &&handler, size_t limit = std::numeric_limits<size_t>::max())
+    {
+        size_t count = 0;
+        while (count < limit)
+        {
+            const ShmBusSlot &slot = log[position & mask];
+            uint64_t done = 2 * position + 2;
+            uint64_t before = slot.sequence.load(std::memory_order_acquire);
+            if (before < done)
+            {
+                break; // not written yet (or being written)
+            }
+            if (before == done)
+            {
+                copy(slot, scratch);
+                if (slot.sequence.load(std::memory_order_relaxed) == done)
+                {
+                    ++position;
+                    ++count;
+                    handler(static_cast<const MarketUpdate &>(scratch));
+                    continue;
+                }
+            }
+            // Overwritten by a newer lap: skip to the oldest entry still in
+            // the log, with some slack so the writer does not lap us again at once
+            uint64_t cursor = header->logCursor.load(std::memory_order_acquire);
+            uint64_t oldest = cursor - (mask + 1) + (mask + 1) / 8;
+            gaps += oldest - position;
+            position = oldest;
+        }
+        return count;
+    }
+
+    // Updates lost because this reader fell a full log behind
+    uint64_t getGaps() const
+    {
+        return gaps;
+    }
+
+    size_t symbolCount() const
+    {
+        return header->symbolCount.load(std::memory_order_acquire);
+    }
+
+private:
+    const char *base = nullptr;
+    size_t size = 0;
+    const ShmBusHeader *header = nullptr;
+    const ShmBusSymbol *symbolTable = nullptr;
+    const ShmBusSlot *log = nullptr;
+    uint64_t mask = 0;
+    uint64_t position = 0;
+    uint64_t gaps = 0;
+    MarketUpdate scratch{};
+    std::unordered_map<std::string, uint32_t> known; // symbols already located
+    uint32_t scanned = 0;                            // symbol table entries already in `known`
+
+    int findSymbol(const std::string &symbol)
+    {
+        auto it = known.find(symbol);
+        if (it != known.end())
+        {
+            return static_cast<int>(it->second);
+        }
+        uint32_t count = header->symbolCount.load(std::memory_order_acquire);
+        for (; scanned < count; ++scanned)
+        {
+            known.emplace(std::string(symbolTable[scanned].name), scanned);
+        }
+        it = known.find(symbol);
+        return it == known.end() ? -1 : static_cast<int>(it->second);
+    }
+
+    static void copy(const ShmBusSlot &slot, MarketUpdate &out)
+    {
+        uint64_t words[kShmBusWords];
+        for (size_t i = 0; i < kShmBusWords; ++i)
+        {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        std::memcpy(&out, words, sizeof(out));
+    }
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "feed_handler.hpp"
+
+struct SubscriptionStats
+{
+    uint64_t acquires = 0;             // downstream subscriptions
+    uint64_t releases = 0;             // downstream unsubscriptions
+    uint64_t upstreamSubscribes = 0;   // symbols subscribed upstream
+    uint64_t upstreamUnsubscribes = 0; // symbols unsubscribed upstream
+    uint64_t upstreamRequests = 0;     // batched subscribe/unsubscribe calls made
+    uint64_t teardownsAvoided = 0;     // released symbols re-acquired before teardown
+};
+
+// Merges downstream interest into the minimal set of upstream subscriptions.
+//
+// Every downstream subscription acquires its symbol and every unsubscription
+// (or disconnect) releases it; the upstream source only sees the symbols
+// whose reference count is non-zero. Changes are collected and sent in one
+// subscribe and one unsubscribe request per batch window, and a symbol whose
+// count drops to zero stays subscribed for `teardownDelay` so clients that
+// reconnect or flip subscriptions do not cause upstream churn.
+class SubscriptionManager
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    SubscriptionManager(MarketDataSource &source, std::chrono::milliseconds batchWindow = std::chrono::milliseconds(10),
+                        std::chrono::milliseconds teardownDelay = std::chrono::seconds(5))
+        : source(source), batchWindow(batchWindow), teardownDelay(teardownDelay)
+    {
+    }
+
+    ~SubscriptionManager()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        flusher = std::thread([this]()
+                              { run(); });
+    }
+
+    // Flushes pending subscribes; pending teardowns are dropped with the source
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (flusher.joinable())
+        {
+            flusher.join();
+        }
+    }
+
+    // Subscribed upstream for as long as the manager lives
+    void pin(const std::vector<std::string> &symbols)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : symbols)
+        {
+            Entry &entry = entries[symbol];
+            if (!entry.pinned)
+            {
+                entry.pinned = true;
+                addReference(symbol, entry);
+            }
+        }
+    }
+
+    void acquire(const std::string &symbol)
+    {
+        acquire(std::vector<std::string>{symbol});
+    }
+
+    // One reference per entry, under a single lock
+    void acquire(const std::vector<std::string> &symbols)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : symbols)
+        {
+            stats.acquires++;
+            addReference(symbol, entries[symbol]);
+        }
+    }
+
+    void release(const std::string &symbol)
+    {
+        release(std::vector<std::string>{symbol});
+    }
+
+    void release(const std::vector<std::string> &symbols)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::string &symbol : symbols)
+        {
+            auto it = entries.find(symbol);
+            if (it == entries.end() || it->second.references <= (it->second.pinned ? 1u : 0u))
+            {
+                continue;
+            }
+            stats.releases++;
+            if (--it->second.references == 0)
+            {
+                it->second.idleSince = Clock::now();
+                if (idle++ == 0)
+                {
+                    wake.notify_all();
+                }
+            }
+        }
+    }
+
+    size_t references(const std::string &symbol) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(symbol);
+        return it == entries.end() ? 0 : it->second.references;
+    }
+
+    // Symbols currently subscribed (or being subscribed) upstream
+    size_t upstreamCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t count = 0;
+        for (const auto &[symbol, entry] : entries)
+        {
+            count += entry.upstream;
+        }
+        return count;
+    }
+
+    SubscriptionStats getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        size_t references = 0;
+        bool pinned = false;
+        bool upstream = false; // subscribe requested from the source
+        Clock::time_point idleSince;
+    };
+
+    MarketDataSource &source;
+    const std::chrono::milliseconds batchWindow;
+    const std::chrono::milliseconds teardownDelay;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::unordered_map<std::string, Entry> entries;
+    std::vector<std::string> pendingSubscribes;
+    size_t idle = 0; // entries with no references still subscribed upstream
+    bool stopping = false;
+    SubscriptionStats stats;
+    std::thread flusher;
+
+    void addReference(const std::string &symbol, Entry &entry)
+    {
+        if (entry.references++ != 0)
+        {
+            return;
+        }
+        if (entry.upstream)
+        {
+            // Released but not torn down yet
+            stats.teardownsAvoided++;
+            idle--;
+            return;
+        }
+        entry.upstream = true;
+        if (pendingSubscribes.empty())
+        {
+            wake.notify_all();
+        }
+        pendingSubscribes.push_back(symbol);
+    }
+
+    // Collects one batch of changes; called with the mutex held
+    void collect(std::vector<std::string> &subscribes, std::vector<std::string> &unsubscribes)
+    {
+        subscribes.swap(pendingSubscribes);
+        if (idle == 0)
+        {
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        for (auto it = entries.begin(); it != entries.end();)
+        {
+            Entry &entry = it->second;
+            if (entry.references == 0 && entry.upstream && now - entry.idleSince >= teardownDelay)
+            {
+                unsubscribes.push_back(it->first);
+                idle--;
+                it = entries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    void run()
+    {
+        std::vector<std::string> subscribes;
+        std::vector<std::string> unsubscribes;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            // Sleep until something is pending (or, with idle entries, until
+            // the next teardown check), then let the batch window fill up
+            if (pendingSubscribes.empty())
+            {
+                if (idle == 0)
+                {
+                    wake.wait(lock, [this]()
+                              { return stopping || !pendingSubscribes.empty() || idle != 0; });
+                }
+                else
+                {
+                    wake.wait_for(lock, teardownDelay / 4 + batchWindow);
+                }
+            }
+            if (stopping)
+            {
+                break;
+            }
+            lock.unlock();
+            std::this_thread::sleep_for(batchWindow);
+            lock.lock();
+
+            subscribes.clear();
+            unsubscribes.clear();
+            collect(subscribes, unsubscribes);
+            stats.upstreamSubscribes += subscribes.size();
+            stats.upstreamUnsubscribes += unsubscribes.size();
+            stats.upstreamRequests += !subscribes.empty() + !unsubscribes.empty();
+            lock.unlock();
+            if (!subscribes.empty())
+            {
+                source.subscribe(subscribes);
+            }
+            if (!unsubscribes.empty())
+            {
+                source.unsubscribe(unsubscribes);
+            }
+            lock.lock();
+        }
+        if (!pendingSubscribes.empty())
+        {
+            subscribes.swap(pendingSubscribes);
+            lock.unlock();
+            source.subscribe(subscribes);
+        }
+    }
+};
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "include/json.hpp"
+
+// One issued access token. Instances are immutable once published.
+struct AccessToken
+{
+    std::string value;
+    std::string refreshToken;
+    std::chrono::steady_clock::time_point expiresAt;
+};
+
+// Owns the Deribit access token for the lifetime of the process.
+//
+// A background thread refreshes the token with its refresh_token well before
+// expiry (falling back to client credentials if that fails), so an order never
+// pays for an auth round-trip. Readers get the current token through a single
+// atomic pointer load: superseded tokens are retired but kept alive until the
+// manager is destroyed, which makes the read path wait-free with no reference
+// counting. A refresh every few hours retires only a handful of strings.
+class TokenManager
+{
+public:
+    using RequestFn = std::function<std::string(const std::string &url, const nlohmann::json &payload, const std::string &accessToken)>;
+
+    TokenManager(RequestFn sendRequest, std::string clientId, std::string clientSecret,
+                 std::string scope = "session:apiconsole-c5i26ds6dsr expires:2592000",
+                 double refreshFraction = 0.8)
+        : sendRequest(std::move(sendRequest)), clientId(std::move(clientId)), clientSecret(std::move(clientSecret)),
+          scope(std::move(scope)), refreshFraction(refreshFraction) {}
+
+    ~TokenManager()
+    {
+        stop();
+    }
+
+    TokenManager(const TokenManager &) = delete;
+    TokenManager &operator=(const TokenManager &) = delete;
+
+    // Authenticates synchronously and starts the refresh thread.
+    // Returns false if the initial authentication failed.
+    bool start()
+    {
+        auto token = requestToken(clientCredentialsParams());
+        if (!token)
+        {
+            return false;
+        }
+        publish(std::move(token));
+        refresher = std::thread([this]()
+                                { refreshLoop(); });
+        return true;
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        if (refresher.joinable())
+        {
+            refresher.join();
+        }
+    }
+
+    // Current access token; never blocks. Empty before start() succeeds.
+    const std::string &accessToken() const
+    {
+        const AccessToken *token = current.load(std::memory_order_acquire);
+        return token ? token->value : noToken;
+    }
+
+    std::chrono::steady_clock::time_point expiresAt() const
+    {
+        const AccessToken *token = current.load(std::memory_order_acquire);
+        return token ? token->expiresAt : std::chrono::steady_clock::time_point{};
+    }
+
+private:
+    static constexpr const char *kAuthUrl = "https://test.deribit.com/api/v2/public/auth";
+
+    RequestFn sendRequest;
+    std::string clientId;
+    std::string clientSecret;
+    std::string scope;
+    double refreshFraction;
+    const std::string noToken;
+
+    std::atomic<const AccessToken *> current{nullptr};
+    std::vector<std::unique_ptr<const AccessToken>> tokens; // owns current and all retired tokens
+
+    static constexpr std::chrono::seconds kMinRefreshDelay{1};
+
+    std::thread refresher;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    nlohmann::json clientCredentialsParams() const
+    {
+        return {{"grant_type", "client_credentials"}, {"scope", scope}, {"client_id", clientId}, {"client_secret", clientSecret}};
+    }
+
+    std::unique_ptr<AccessToken> requestToken(const nlohmann::json &params)
+    {
+        nlohmann::json payload = {
+            {"id", 0},
+            {"method", "public/auth"},
+            {"params", params},
+            {"jsonrpc", "2.0"}};
+
+        auto requestedAt = std::chrono::steady_clock::now();
+        std::string response = sendRequest(kAuthUrl, payload, "");
+        auto responseJson = nlohmann::json::parse(response, nullptr, false);
+
+        if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].contains("access_token"))
+        {
+            std::cerr << "Failed to retrieve access token." << std::endl;
+            return nullptr;
+        }
+
+        const auto &result = responseJson["result"];
+        long long expiresIn = result.value("expires_in", 0LL);
+        if (expiresIn <= 0)
+        {
+            // Would be due for refresh immediately, every time
+            std::cerr << "Access token without a positive expires_in, ignoring it." << std::endl;
+            return nullptr;
+        }
+        auto token = std::make_unique<AccessToken>();
+        token->value = result["access_token"].get<std::string>();
+        token->refreshToken = result.value("refresh_token", "");
+        // Measured from when the request was sent, so network time only makes us refresh earlier
+        token->expiresAt = requestedAt + std::chrono::seconds(expiresIn);
+        return token;
+    }
+
+    void publish(std::unique_ptr<AccessToken> token)
+    {
+        const AccessToken *raw = token.get();
+        tokens.push_back(std::move(token));
+        current.store(raw, std::memory_order_release);
+    }
+
+    void refreshLoop()
+    {
+        using namespace std::chrono;
+        auto retryDelay = seconds(1);
+        auto nextRefresh = refreshTime(*current.load());
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            if (wakeup.wait_until(lock, nextRefresh, [this]()
+                                  { return stopping; }))
+            {
+                break;
+            }
+            lock.unlock();
+
+            const AccessToken *active = current.load();
+            std::unique_ptr<AccessToken> token;
+            if (!active->refreshToken.empty())
+            {
+                token = requestToken({{"grant_type", "refresh_token"}, {"refresh_token", active->refreshToken}});
+            }
+            if (!token)
+            {
+                token = requestToken(clientCredentialsParams());
+            }
+
+            if (token)
+            {
+                nextRefresh = refreshTime(*token);
+                publish(std::move(token));
+                retryDelay = seconds(1);
+            }
+            else
+            {
+                // Keep serving the old token and retry with backoff until it expires
+                std::cerr << "Access token refresh failed, retrying in " << retryDelay.count() << "s." << std::endl;
+                nextRefresh = steady_clock::now() + retryDelay;
+                retryDelay = std::min(retryDelay * 2, duration_cast<seconds>(minutes(1)));
+            }
+            lock.lock();
+        }
+    }
+
+    // Never sooner than kMinRefreshDelay, so a short-lived token cannot make
+    // the loop call public/auth back to back
+    std::chrono::steady_clock::time_point refreshTime(const AccessToken &token) const
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto lifetime = token.expiresAt - now;
+        auto delay = std::chrono::duration_cast<std::chrono::steady_clock::duration>(lifetime * refreshFraction);
+        return now + std::max<std::chrono::steady_clock::duration>(delay, kMinRefreshDelay);
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include "latency.hpp"
+
+// Pipeline stages stamped on every broadcast update, in pipeline order.
+// Wire keys are kept short because they ride on every message.
+enum class TraceStage
+{
+    SourceReceive, // update received from (or produced by) the market data source
+    BookUpdate,    // local book/state updated with it
+    Serialize,     // JSON serialization finished
+    Enqueue,       // handed to the broadcaster
+    SocketWrite,   // passed to the connection's send queue (sampled messages only)
+    ClientReceive, // client read it off the socket (echoed back)
+    EchoReceive,   // server received the client's echo
+    Count
+};
+
+inline const char *traceStageKey(TraceStage stage)
+{
+    static const char *keys[] = {"src", "book", "ser", "enq", "wr", "rx", "echo"};
+    return keys[static_cast<int>(stage)];
+}
+
+// Timestamps (nanoseconds since epoch) carried by one update
+struct StageTimestamps
+{
+    std::array<int64_t, static_cast<size_t>(TraceStage::Count)> ns{};
+
+    void stamp(TraceStage stage, int64_t value = nowNanos())
+    {
+        ns[static_cast<size_t>(stage)] = value;
+    }
+
+    int64_t at(TraceStage stage) const
+    {
+        return ns[static_cast<size_t>(stage)];
+    }
+
+    // Appends `"ts":{"src":..,...}` for every stage stamped so far.
+    void appendJson(std::string &out) const
+    {
+        out += "\"ts\":{";
+        bool first = true;
+        for (size_t i = 0; i < ns.size(); ++i)
+        {
+            if (ns[i] == 0)
+            {
+                continue;
+            }
+            if (!first)
+            {
+                out += ',';
+            }
+            first = false;
+            out += '"';
+            out += traceStageKey(static_cast<TraceStage>(i));
+            out += "\":";
+            out += std::to_string(ns[i]);
+        }
+        out += '}';
+    }
+};
+
+// Per-hop latency histograms fed by sampled messages. A hop is the time
+// between two consecutive stamped stages, so the hops of one message add up
+// to its full round trip. Histograms are kept per (from, to) pair: a message
+// that skips a stage records a different hop than one that has it.
+class TraceRecorder
+{
+public:
+    explicit TraceRecorder(uint64_t sampleEvery = 0) : sampleEvery(sampleEvery) {}
+
+    bool enabled() const { return sampleEvery != 0; }
+
+    // Returns true if the message with this sequence number should be traced
+    bool shouldSample(uint64_t sequence) const
+    {
+        return sampleEvery != 0 && sequence % sampleEvery == 0;
+    }
+
+    void record(const StageTimestamps &ts)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t previous = 0;
+        size_t previousStage = 0;
+        for (size_t i = 0; i < ts.ns.size(); ++i)
+        {
+            if (ts.ns[i] == 0)
+            {
+                continue;
+            }
+            if (previous != 0)
+            {
+                hops[previousStage][i].record(ts.ns[i] - previous);
+            }
+            previous = ts.ns[i];
+            previousStage = i;
+        }
+    }
+
+    // Summary of every hop seen so far, in microseconds
+    template <typename Json>
+    Json summary() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Json result = Json::object();
+        for (size_t from = 0; from < hops.size(); ++from)
+        {
+            for (size_t to = from + 1; to < hops.size(); ++to)
+            {
+                const LatencyHistogram &h = hops[from][to];
+                if (h.count() == 0)
+                {
+                    continue;
+                }
+                std::string name = std::string(traceStageKey(static_cast<TraceStage>(from))) + "->" +
+                                   traceStageKey(static_cast<TraceStage>(to));
+                result[name] = {
+                    {"count", h.count()},
+                    {"p50_us", h.percentile(50) / 1000.0},
+                    {"p99_us", h.percentile(99) / 1000.0},
+                    {"p999_us", h.percentile(99.9) / 1000.0},
+                    {"max_us", h.max() / 1000.0}};
+            }
+        }
+        return result;
+    }
+
+private:
+    uint64_t sampleEvery;
+    mutable std::mutex mutex;
+    static constexpr size_t kStages = static_cast<size_t>(TraceStage::Count);
+    std::array<std::array<LatencyHistogram, kStages>, kStages> hops; // [from][to]
+};
@@ -1,46 +1,37 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <curl/curl.h>
 #include "include/json.hpp"
-#include <fstream>
 #include <chrono>
+#include <cmath>
+#include <ctime>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "config.hpp"
+#include "exec_algos.hpp"
+#include "greeks.hpp"
+#include "instruments.hpp"
+#include "journal.hpp"
+#include "portfolio_risk.hpp"
+#include "positions.hpp"
+#include "quote_engine.hpp"
+#include "rate_limiter.hpp"
+#include "risk.hpp"
+#include "token_manager.hpp"
 
 using json = nlohmann::json;
 
-std::string trim(const std::string &str)
-{
-    size_t first = str.find_first_not_of(" \t\r\n");
-    size_t last = str.find_last_not_of(" \t\r\n");
-    return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
-}
-
-std::string getEnvVariable(const std::string &key)
-{
-    std::ifstream envFile(".env");
-    if (!envFile.is_open())
-    {
-        std::cerr << "Error: Could not open .env file.\n";
-        return "";
-    }
-    std::string line;
-    while (std::getline(envFile, line))
-    {
-        size_t pos = line.find('=');
-        if (pos != std::string::npos)
-        {
-            std::string currentKey = line.substr(0, pos);
-            std::string value = line.substr(pos + 1);
-            currentKey = trim(currentKey);
-            value = trim(value); // Trim whitespace and carriage return
-            if (currentKey == key)
-            {
-                return value;
-            }
-        }
-    }
-    return "";
-}
-
 // Function to handle the response from the cURL request
 size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
@@ -55,7 +46,6 @@ std::string sendRequest(const std::string &url, const json &payload, const std::
     CURL *curl;
     CURLcode res;
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
     curl = curl_easy_init();
 
     if (curl)
@@ -72,111 +62,1101 @@ std::string sendRequest(const std::string &url, const json &payload, const std::
         headers = curl_slist_append(headers, "Content-Type: application/json");
         if (!accessToken.empty())
         {
-            headers = curl_slist_append(headers, ("Authorization: Bearer " + accessToken).c_str());
+            headers = curl_slist_append(headers, ("Authorization: Bearer " + accessToken).c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        // Set up the write callback to capture the response
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+
+        // Perform the request
+        res = curl_easy_perform(curl);
+        if (res != CURLE_OK)
+        {
+            std::cerr << "Request failed: " << curl_easy_strerror(res) << std::endl;
+        }
+
+        // Free Resources
+        curl_slist_free_all(headers);
+        curl_easy_cleanup(curl);
+    }
+
+    return readBuffer;
+}
+
+// An order accepted by the risk layer and believed to be resting at the exchange
+struct TrackedOrder
+{
+    int instrumentId;
+    Side side;
+    double amount; // total order amount, as the exchange reports it
+    double price;
+    std::string label;
+    std::string instrument;
+    uint64_t intentSeq = 0; // journal Intent record this order belongs to
+    double filled = 0;      // cumulative filled amount
+
+    // The risk reservation always covers exactly this
+    double remaining() const
+    {
+        return amount - filled;
+    }
+};
+
+// State shared by the menu actions
+struct TradingContext
+{
+    TokenManager &tokens;
+    const EnvConfig &config;
+    PreTradeRisk risk;
+    CreditRateLimiter limiter;
+    std::chrono::milliseconds maxThrottleWait;
+    std::unordered_map<std::string, TrackedOrder> openOrders;
+    std::unique_ptr<OrderJournal> journal;
+    PositionKeeper positions;
+    PortfolioRisk portfolio;
+    InstrumentCache instruments;
+    std::unordered_map<std::string, double> filledByLabel; // cumulative fills of labelled orders (quotes, algo children)
+    std::unordered_map<std::string, double> fillCredit;    // per order: filled_amount already in risk but not yet seen as trades
+    int64_t tradeCursorMs = 0;                             // exchange timestamp the trade poll resumes from
+
+    // Guards the order state above and the risk registrations. The menu holds
+    // it for the whole of each action, the background threads while they
+    // apply what they fetched.
+    std::mutex stateMutex;
+
+    TradingContext(TokenManager &tokens, const EnvConfig &config)
+        : tokens(tokens), config(config),
+          risk(static_cast<int>(config.getInt("RISK_MAX_OPEN_ORDERS", 200)), config.getInt("RISK_REQUIRE_MID", 0) != 0),
+          limiter({matchingRule(config), CreditRule{50000, 10000, 500, 0}}),
+          maxThrottleWait(config.getInt("RATE_MAX_WAIT_MS", 1000))
+    {
+        std::string path = config.get("JOURNAL_PATH", "orders.journal");
+        if (path.empty() || path == "none")
+        {
+            return;
+        }
+        JournalDurability durability = config.get("JOURNAL_DURABILITY", "async") == "batched" ? JournalDurability::BatchedSync
+                                                                                            : JournalDurability::Async;
+        try
+        {
+            journal = std::make_unique<OrderJournal>(path, static_cast<size_t>(config.getInt("JOURNAL_CAPACITY", 1000000)), durability,
+                                                     std::chrono::microseconds(config.getInt("JOURNAL_SYNC_US", 1000)));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << ", running without an order journal." << std::endl;
+        }
+    }
+
+    // RATE_MATCHING_BURST / RATE_MATCHING_PER_SEC are in requests; one costs 500 credits
+    static CreditRule matchingRule(const EnvConfig &config)
+    {
+        return CreditRule{config.getDouble("RATE_MATCHING_BURST", 20) * 500, config.getDouble("RATE_MATCHING_PER_SEC", 5) * 500, 500, 500};
+    }
+
+    // Appends one event for an order to the journal; returns its sequence (0 without a journal)
+    uint64_t journalEvent(JournalEvent event, const TrackedOrder &order, const std::string &orderId, double amount, double price)
+    {
+        if (!journal)
+        {
+            return 0;
+        }
+        uint64_t sequence = journal->append(event, order.intentSeq, orderId, order.instrument, order.label, order.side, amount, price);
+        if (sequence == 0)
+        {
+            std::cerr << "Warning: order journal " << journal->getPath() << " is full." << std::endl;
+        }
+        return sequence;
+    }
+
+    const std::string &accessToken() const
+    {
+        return tokens.accessToken();
+    }
+
+    // Waits for exchange credits, up to RATE_MAX_WAIT_MS (0 = reject at once)
+    bool admit(RequestClass requestClass, RequestPriority priority)
+    {
+        if (limiter.acquire(requestClass, priority, maxThrottleWait))
+        {
+            return true;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(limiter.estimatedWait(requestClass, priority));
+        std::cerr << "Request throttled locally: exchange credits exhausted, retry in " << wait.count() << " ms." << std::endl;
+        return false;
+    }
+
+    // If the exchange still reports too_many_requests our credit model is
+    // ahead of it, so empty the local bucket to resynchronise
+    void checkThrottled(const json &responseJson, RequestClass requestClass)
+    {
+        if (responseJson.is_object() && responseJson.contains("error") && responseJson["error"].value("code", 0) == 10028)
+        {
+            limiter.drain(requestClass);
+        }
+    }
+
+    // Instruments not listed in the limits file get default limits on first
+    // use. -1 once the risk tables are full: orders for it are rejected.
+    int instrumentId(const std::string &instrument)
+    {
+        int id = risk.findInstrument(instrument);
+        if (id >= 0)
+        {
+            return id;
+        }
+        id = risk.registerInstrument(instrument, currencyOf(instrument), defaultLimitsFor(instrument));
+        if (id < 0)
+        {
+            std::cerr << "Warning: risk tables are full, " << instrument << " is not tracked." << std::endl;
+        }
+        return id;
+    }
+
+    static std::string currencyOf(const std::string &instrument)
+    {
+        return instrument.substr(0, instrument.find('-'));
+    }
+
+    // Currency the account summary is kept in: the coin for inverse
+    // instruments, the quote for linear ones (ETH_USDC-PERPETUAL -> USDC)
+    static std::string settlementCurrencyOf(const std::string &instrument)
+    {
+        std::string currency = currencyOf(instrument);
+        size_t underscore = currency.find('_');
+        return underscore == std::string::npos ? currency : currency.substr(underscore + 1);
+    }
+
+    // Inverse futures/perpetuals (BTC-PERPETUAL) take amounts in USD; options
+    // and linear instruments (ETH_USDC-PERPETUAL) take amounts in the base coin
+    InstrumentLimits defaultLimitsFor(const std::string &instrument) const
+    {
+        InstrumentLimits limits;
+        limits.maxOrderAmount = config.getDouble("RISK_MAX_ORDER_AMOUNT", limits.maxOrderAmount);
+        limits.priceBand = config.getDouble("RISK_PRICE_BAND", limits.priceBand);
+        limits.maxPosition = config.getDouble("RISK_MAX_POSITION", limits.maxPosition);
+        limits.maxNotional = config.getDouble("RISK_MAX_NOTIONAL", limits.maxNotional);
+        limits.maxOpenOrders = static_cast<int>(config.getInt("RISK_MAX_OPEN_ORDERS_PER_INSTRUMENT", limits.maxOpenOrders));
+        limits.amountIsNotional = isInverseInstrument(instrument);
+        return limits;
+    }
+
+    // Precomputes the limit tables from the optional JSON limits file:
+    // {"instruments": {"BTC-PERPETUAL": {"max_order_amount": 10000, ...}}, "currencies": {"BTC": 5e6}}
+    void loadRiskLimits(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            return;
+        }
+        json limitsJson = json::parse(file, nullptr, false);
+        if (limitsJson.is_discarded())
+        {
+            std::cerr << "Error: Could not parse risk limits file " << path << std::endl;
+            return;
+        }
+        for (auto &[name, entry] : limitsJson.value("instruments", json::object()).items())
+        {
+            InstrumentLimits limits = defaultLimitsFor(name);
+            limits.maxOrderAmount = entry.value("max_order_amount", limits.maxOrderAmount);
+            limits.priceBand = entry.value("price_band", limits.priceBand);
+            limits.maxPosition = entry.value("max_position", limits.maxPosition);
+            limits.maxNotional = entry.value("max_notional", limits.maxNotional);
+            limits.amountIsNotional = entry.value("amount_is_notional", limits.amountIsNotional);
+            limits.maxOpenOrders = entry.value("max_open_orders", limits.maxOpenOrders);
+            risk.registerInstrument(name, currencyOf(name), limits);
+        }
+        for (auto &[currency, maxNotional] : limitsJson.value("currencies", json::object()).items())
+        {
+            risk.setCurrencyLimit(currency, maxNotional.get<double>());
+        }
+    }
+};
+
+// Async order gateway: waits for exchange credits and sends a matching-engine
+// request on its own thread (with its own curl handle), so a batch of requests
+// goes out in parallel. Yields an empty response if the request was throttled.
+std::future<std::string> sendRequestAsync(TradingContext &context, const std::string &method, const json &payload, RequestPriority priority)
+{
+    std::string accessToken = context.accessToken();
+    return std::async(std::launch::async, [&context, method, payload, accessToken, priority]()
+                      {
+                          if (!context.admit(RequestClass::MatchingEngine, priority))
+                          {
+                              return std::string();
+                          }
+                          return sendRequest("https://test.deribit.com/api/v2/" + method, payload, accessToken); });
+}
+
+bool parseNumber(const std::string &text, double &value)
+{
+    char *end = nullptr;
+    value = std::strtod(text.c_str(), &end);
+    return end != text.c_str() && *end == '\0';
+}
+
+// Downloads every listed instrument (public/get_instruments) into the
+// metadata cache and saves the snapshot; returns false if the download failed
+bool refreshInstruments(TradingContext &context)
+{
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return false;
+    }
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "public/get_instruments"},
+        {"params", {{"currency", "any"}, {"expired", false}}},
+        {"id", 40}};
+    std::string response = sendRequest("https://test.deribit.com/api/v2/public/get_instruments", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_array())
+    {
+        std::cerr << "Error: Could not refresh instrument metadata." << std::endl;
+        return false;
+    }
+    size_t count = context.instruments.load({responseJson["result"]});
+    std::string path = context.config.get("INSTRUMENTS_SNAPSHOT", "instruments.snapshot");
+    if (!path.empty() && path != "none" && !context.instruments.save(path))
+    {
+        std::cerr << "Error: Could not write instrument snapshot " << path << std::endl;
+    }
+    return count > 0;
+}
+
+// Loads instrument metadata at startup: from the snapshot if it is recent
+// enough, else from the exchange
+void loadInstruments(TradingContext &context)
+{
+    std::string path = context.config.get("INSTRUMENTS_SNAPSHOT", "instruments.snapshot");
+    int64_t maxAgeMs = context.config.getInt("INSTRUMENTS_REFRESH_SEC", 3600) * 1000;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (path != "none" && context.instruments.loadSnapshot(path) &&
+        nowNanos() / 1000000 - context.instruments.current()->getLoadedAtMs() < maxAgeMs)
+    {
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Loaded " << context.instruments.size() << " instruments from " << path << " in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms." << std::endl;
+        return;
+    }
+    refreshInstruments(context);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Downloaded " << context.instruments.size() << " instruments in " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms." << std::endl;
+}
+
+// Finds an instrument's specs, reporting unknown names; returns false if unknown
+bool lookupInstrument(TradingContext &context, const std::string &instrument, InstrumentSpec &spec)
+{
+    if (context.instruments.lookup(instrument, spec))
+    {
+        return true;
+    }
+    std::cerr << "Error: Unknown instrument " << instrument << std::endl;
+    return false;
+}
+
+// Rounds an order's price onto the tick grid and checks it against the
+// instrument's specs; returns false (and says why) if the order would be
+// rejected. Passes everything when no metadata could be loaded.
+bool validateOrder(TradingContext &context, const std::string &instrument, Side side, double &price, double amount)
+{
+    if (context.instruments.size() == 0)
+    {
+        return true;
+    }
+    InstrumentSpec spec;
+    if (!lookupInstrument(context, instrument, spec))
+    {
+        return false;
+    }
+    double rounded = InstrumentCache::roundPrice(spec, price, side);
+    if (rounded != price)
+    {
+        std::cout << "Price " << price << " rounded to " << rounded << " (tick size " << spec.tickAt(price) << ")." << std::endl;
+        price = rounded;
+    }
+    if (const char *error = InstrumentCache::validate(spec, price, amount))
+    {
+        std::cerr << "Order rejected: " << error << " (minimum " << spec.minTradeAmount << ")." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Copies an instrument's position and marks from the keeper into the portfolio risk view
+void syncPortfolio(TradingContext &context, const std::string &instrument)
+{
+    int id = context.positions.findInstrument(instrument);
+    if (id >= 0)
+    {
+        PositionSnapshot position = context.positions.position(id);
+        context.portfolio.update(instrument, position.size, position.markPrice, position.indexPrice);
+    }
+}
+
+// Applies one of our trades, from an order response or the trade poll, to
+// positions and then pre-trade risk. Positions drop trades already applied;
+// risk skips the part a filled_amount already accounted for. `order` is the
+// tracked order the trade belongs to, or null if none is (placed elsewhere
+// or already closed), whose fill then holds no reservation. Returns the
+// amount newly filled into risk.
+double applyTrade(TradingContext &context, const json &trade, TrackedOrder *order)
+{
+    if (!trade.is_object() || !context.positions.onTrade(trade))
+    {
+        return 0;
+    }
+    std::string instrument = trade.value("instrument_name", "");
+    syncPortfolio(context, instrument);
+
+    double amount = trade.value("amount", 0.0);
+    auto credit = context.fillCredit.find(trade.value("order_id", ""));
+    if (credit != context.fillCredit.end())
+    {
+        double covered = std::min(credit->second, amount);
+        amount -= covered;
+        credit->second -= covered;
+        if (credit->second <= 0)
+        {
+            context.fillCredit.erase(credit);
+        }
+    }
+    if (!(amount > 0))
+    {
+        return 0;
+    }
+    double price = trade.value("price", 0.0);
+    if (order == nullptr)
+    {
+        Side side = trade.value("direction", "") == "sell" ? Side::Sell : Side::Buy;
+        context.risk.onFill(context.instrumentId(instrument), side, amount, price, false);
+        return amount;
+    }
+    context.risk.onFill(order->instrumentId, order->side, amount, price);
+    context.journalEvent(JournalEvent::Fill, *order, trade.value("order_id", ""), amount, price);
+    if (!order->label.empty())
+    {
+        context.filledByLabel[order->label] += amount;
+    }
+    order->filled += amount;
+    return amount;
+}
+
+// Applies an order response (result.order and result.trades) to the risk
+// counters, positions and the journal. `request` is the order as sent, with
+// the fills already accounted for; filled_amount is cumulative, so only the
+// increase is new. Responses without trades (get_order_state) leave the
+// increase as credit against the trades the poll brings in later.
+void applyOrderState(TradingContext &context, const json &result, TrackedOrder request)
+{
+    for (const json &trade : result.value("trades", json::array()))
+    {
+        applyTrade(context, trade, &request);
+    }
+    const json &order = result["order"];
+    std::string orderId = order.value("order_id", "");
+    double filled = order.value("filled_amount", 0.0);
+    if (filled > request.filled)
+    {
+        double fillPrice = order.value("average_price", request.price);
+        context.risk.onFill(request.instrumentId, request.side, filled - request.filled, fillPrice);
+        context.journalEvent(JournalEvent::Fill, request, orderId, filled - request.filled, fillPrice);
+        if (!request.label.empty())
+        {
+            context.filledByLabel[request.label] += filled - request.filled;
+        }
+        if (!orderId.empty())
+        {
+            context.fillCredit[orderId] += filled - request.filled;
+        }
+        request.filled = filled;
+    }
+    if (order.value("order_state", "") == "open" && !orderId.empty())
+    {
+        context.openOrders[orderId] = request;
+    }
+    else
+    {
+        context.risk.release(request.instrumentId, request.side, request.remaining(), request.price, true);
+        context.journalEvent(JournalEvent::Closed, request, orderId, request.remaining(), request.price);
+    }
+}
+
+// Function to place an order
+void placeOrder(TradingContext &context, const std::string &price, const std::string &amount, const std::string &instrument)
+{
+    double priceValue = 0, amountValue = 0;
+    if (!parseNumber(price, priceValue) || !parseNumber(amount, amountValue))
+    {
+        std::cerr << "Order rejected: amount and price must be numbers." << std::endl;
+        return;
+    }
+    if (!validateOrder(context, instrument, Side::Buy, priceValue, amountValue))
+    {
+        return;
+    }
+    int instrumentId = context.instrumentId(instrument);
+
+    auto riskStart = std::chrono::high_resolution_clock::now();
+    RiskResult riskResult = context.risk.checkAndReserve(instrumentId, Side::Buy, amountValue, priceValue);
+    auto riskEnd = std::chrono::high_resolution_clock::now();
+    if (riskResult != RiskResult::Accepted)
+    {
+        std::cerr << "Order rejected by pre-trade risk: " << riskResultName(riskResult) << std::endl;
+        return;
+    }
+    if (!context.admit(RequestClass::MatchingEngine, RequestPriority::Normal))
+    {
+        context.risk.release(instrumentId, Side::Buy, amountValue, priceValue, true);
+        return;
+    }
+
+    // Write-ahead: the intent is journaled before the request leaves
+    TrackedOrder request{instrumentId, Side::Buy, amountValue, priceValue, "", instrument};
+    request.intentSeq = context.journalEvent(JournalEvent::Intent, request, "", amountValue, priceValue);
+
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "private/buy"},
+        {"params", {{"instrument_name", instrument}, {"type", "limit"}, {"price", priceValue}, {"amount", amountValue}}},
+        {"id", 1}};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/buy", payload, context.accessToken());
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> latency = end - start;
+
+    auto responseJson = json::parse(response, nullptr, false);
+    context.checkThrottled(responseJson, RequestClass::MatchingEngine);
+    if (!responseJson.is_discarded() && responseJson.contains("result") && responseJson["result"].contains("order"))
+    {
+        context.journalEvent(JournalEvent::Ack, request, responseJson["result"]["order"].value("order_id", ""), amountValue, priceValue);
+        applyOrderState(context, responseJson["result"], request);
+    }
+    else
+    {
+        context.risk.release(instrumentId, Side::Buy, amountValue, priceValue, true);
+        context.journalEvent(JournalEvent::Reject, request, "", amountValue, priceValue);
+    }
+
+    std::cout << "Place Order Response: " << response << std::endl;
+    std::cout << "Pre-trade risk check latency: " << std::chrono::duration<double, std::nano>(riskEnd - riskStart).count() << " ns." << std::endl;
+    std::cout << "Order placement latency: " << latency.count() << " seconds." << std::endl;
+}
+
+// Function to cancel an order
+void cancelOrder(TradingContext &context, const std::string &orderID)
+{
+    if (!context.admit(RequestClass::MatchingEngine, RequestPriority::Cancel))
+    {
+        return;
+    }
+
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "private/cancel"},
+        {"params", {{"order_id", orderID}}},
+        {"id", 6}};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/cancel", payload, context.accessToken());
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> latency = end - start;
+
+    auto responseJson = json::parse(response, nullptr, false);
+    context.checkThrottled(responseJson, RequestClass::MatchingEngine);
+    auto tracked = context.openOrders.find(orderID);
+    if (!responseJson.is_discarded() && responseJson.contains("result") && tracked != context.openOrders.end())
+    {
+        const TrackedOrder &order = tracked->second;
+        context.risk.release(order.instrumentId, order.side, order.remaining(), order.price, true);
+        context.journalEvent(JournalEvent::Cancel, order, orderID, order.remaining(), order.price);
+        context.openOrders.erase(tracked);
+    }
+
+    std::cout << "Cancel Order Response: " << response << std::endl;
+    std::cout << "Order cancellation latency: " << latency.count() << " seconds." << std::endl;
+}
+
+// Function to modify an order
+void modifyOrder(TradingContext &context, const std::string &orderID, double amount, double price)
+{
+    // Re-check the order at its new size and price. Orders placed outside this
+    // session are not tracked (their instrument is unknown) and pass unchecked.
+    auto tracked = context.openOrders.find(orderID);
+    if (tracked != context.openOrders.end())
+    {
+        if (!validateOrder(context, tracked->second.instrument, tracked->second.side, price, amount))
+        {
+            return;
+        }
+        // The new amount is a total; what is already filled stays filled
+        TrackedOrder previous = tracked->second;
+        context.risk.release(previous.instrumentId, previous.side, previous.remaining(), previous.price, true);
+        RiskResult riskResult = context.risk.checkAndReserve(previous.instrumentId, previous.side, amount - previous.filled, price);
+        if (riskResult != RiskResult::Accepted)
+        {
+            context.risk.reserve(previous.instrumentId, previous.side, previous.remaining(), previous.price);
+            std::cerr << "Modification rejected by pre-trade risk: " << riskResultName(riskResult) << std::endl;
+            return;
+        }
+    }
+    if (!context.admit(RequestClass::MatchingEngine, RequestPriority::Normal))
+    {
+        if (tracked != context.openOrders.end())
+        {
+            const TrackedOrder &previous = tracked->second;
+            context.risk.release(previous.instrumentId, previous.side, amount - previous.filled, price, true);
+            context.risk.reserve(previous.instrumentId, previous.side, previous.remaining(), previous.price);
+        }
+        return;
+    }
+
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "private/edit"},
+        {"params", {{"order_id", orderID}, {"amount", amount}, {"price", price}}},
+        {"id", 11}};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/edit", payload, context.accessToken());
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> latency = end - start;
+    context.checkThrottled(json::parse(response, nullptr, false), RequestClass::MatchingEngine);
+
+    if (tracked != context.openOrders.end())
+    {
+        TrackedOrder previous = tracked->second;
+        context.openOrders.erase(tracked);
+        TrackedOrder order = previous;
+        order.amount = amount;
+        order.price = price;
+        auto responseJson = json::parse(response, nullptr, false);
+        if (!responseJson.is_discarded() && responseJson.contains("result") && responseJson["result"].contains("order"))
+        {
+            context.journalEvent(JournalEvent::Modify, order, orderID, amount, price);
+            applyOrderState(context, responseJson["result"], order);
+        }
+        else
+        {
+            // Edit rejected: the original order is still resting as before
+            context.risk.release(order.instrumentId, order.side, order.remaining(), price, true);
+            context.risk.reserve(previous.instrumentId, previous.side, previous.remaining(), previous.price);
+            context.openOrders[orderID] = previous;
+        }
+    }
+
+    std::cout << "Modify Order Response: " << response << std::endl;
+    std::cout << "Order modification latency: " << latency.count() << " seconds." << std::endl;
+}
+
+// Releases the risk reservations of tracked orders a batch cancel removed
+template <typename Predicate>
+void releaseCancelled(TradingContext &context, Predicate cancelled)
+{
+    for (auto it = context.openOrders.begin(); it != context.openOrders.end();)
+    {
+        if (cancelled(it->second))
+        {
+            const TrackedOrder &order = it->second;
+            context.risk.release(order.instrumentId, order.side, order.remaining(), order.price, true);
+            context.journalEvent(JournalEvent::Cancel, order, it->first, order.remaining(), order.price);
+            it = context.openOrders.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+// Sends one of the private/cancel_all* / cancel_by_label methods; returns true on success
+bool sendBatchCancel(TradingContext &context, const std::string &method, const json &params)
+{
+    if (!context.admit(RequestClass::MatchingEngine, RequestPriority::Cancel))
+    {
+        return false;
+    }
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", method},
+        {"params", params},
+        {"id", 30}};
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::string response = sendRequest("https://test.deribit.com/api/v2/" + method, payload, context.accessToken());
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> latency = end - start;
+
+    auto responseJson = json::parse(response, nullptr, false);
+    context.checkThrottled(responseJson, RequestClass::MatchingEngine);
+    bool ok = !responseJson.is_discarded() && responseJson.contains("result");
+    if (ok)
+    {
+        std::cout << "Cancelled " << responseJson["result"] << " order(s)." << std::endl;
+    }
+    else
+    {
+        std::cerr << "Batch cancel failed: " << response << std::endl;
+    }
+    std::cout << "Batch cancellation latency: " << latency.count() << " seconds." << std::endl;
+    return ok;
+}
+
+// Function to cancel every open order in one request
+void cancelAllOrders(TradingContext &context)
+{
+    if (sendBatchCancel(context, "private/cancel_all", json::object()))
+    {
+        releaseCancelled(context, [](const TrackedOrder &)
+                         { return true; });
+    }
+}
+
+// Function to cancel every open order of one instrument
+void cancelOrdersByInstrument(TradingContext &context, const std::string &instrument)
+{
+    if (sendBatchCancel(context, "private/cancel_all_by_instrument", {{"instrument_name", instrument}}))
+    {
+        int instrumentId = context.risk.findInstrument(instrument);
+        releaseCancelled(context, [instrumentId](const TrackedOrder &order)
+                         { return order.instrumentId == instrumentId; });
+    }
+}
+
+// Function to cancel every open order carrying a label
+void cancelOrdersByLabel(TradingContext &context, const std::string &label)
+{
+    if (sendBatchCancel(context, "private/cancel_by_label", {{"label", label}}))
+    {
+        releaseCancelled(context, [&label](const TrackedOrder &order)
+                         { return order.label == label; });
+    }
+}
+
+// One side of a two-sided quote
+struct Quote
+{
+    std::string instrument;
+    Side side;
+    double amount;
+    double price;
+};
+
+// The live quotes carrying `label`, as the quote engine sees them
+std::vector<LiveQuote> liveQuotes(const TradingContext &context, const std::string &label)
+{
+    std::vector<LiveQuote> live;
+    for (const auto &[orderId, order] : context.openOrders)
+    {
+        if (order.label == label)
+        {
+            live.push_back({orderId, order.instrument, order.side, order.price, order.remaining()});
+        }
+    }
+    return live;
+}
+
+// Sends quote actions (from diffQuotes, the quote engine or an execution
+// algo) in one parallel round and applies the responses; returns how many
+// succeeded. New orders are post-only unless `postOnly` is false.
+//
+// Deribit's private/mass_quote is only enabled for designated market makers,
+// so the requests are fanned out through the async gateway: edits go out as
+// private/edit, new quotes as post-only buy/sell orders and the rest as
+// cancels. Risk checks and reservation updates run on the calling thread; only
+// the requests run in parallel.
+int sendQuoteActions(TradingContext &context, const std::string &label, const std::vector<QuoteAction> &actions, bool postOnly = true)
+{
+    struct Pending
+    {
+        QuoteActionType action;
+        std::string orderId;
+        TrackedOrder order;    // the quote as it will be after this request
+        TrackedOrder previous; // edits and cancels: the quote as it rests now
+        std::future<std::string> response;
+    };
+
+    std::vector<Pending> pending;
+    for (const QuoteAction &action : actions)
+    {
+        if (action.type == QuoteActionType::New)
+        {
+            TrackedOrder order{context.instrumentId(action.instrument), action.side, action.amount, action.price, label, action.instrument};
+            RiskResult riskResult = context.risk.checkAndReserve(order.instrumentId, order.side, order.amount, order.price);
+            if (riskResult != RiskResult::Accepted)
+            {
+                std::cerr << "Quote " << action.instrument << " rejected by pre-trade risk: " << riskResultName(riskResult) << std::endl;
+                continue;
+            }
+            order.intentSeq = context.journalEvent(JournalEvent::Intent, order, "", order.amount, order.price);
+            pending.push_back({action.type, "", order, {}, {}});
+            continue;
+        }
+
+        auto tracked = context.openOrders.find(action.orderId);
+        if (tracked == context.openOrders.end())
+        {
+            continue;
+        }
+        TrackedOrder previous = tracked->second;
+        if (action.type == QuoteActionType::Cancel)
+        {
+            pending.push_back({action.type, action.orderId, previous, previous, {}});
+            continue;
+        }
+
+        // Edits set the total amount, so keep what has already filled on top of the size to rest
+        TrackedOrder order = previous;
+        order.amount = previous.filled + action.amount;
+        order.price = action.price;
+        context.risk.release(previous.instrumentId, previous.side, previous.remaining(), previous.price, true);
+        RiskResult riskResult = context.risk.checkAndReserve(order.instrumentId, order.side, order.remaining(), order.price);
+        if (riskResult != RiskResult::Accepted)
+        {
+            // Leave the existing quote untouched
+            context.risk.reserve(previous.instrumentId, previous.side, previous.remaining(), previous.price);
+            std::cerr << "Quote " << action.instrument << " rejected by pre-trade risk: " << riskResultName(riskResult) << std::endl;
+            continue;
+        }
+        pending.push_back({action.type, action.orderId, order, previous, {}});
+    }
+
+    for (Pending &request : pending)
+    {
+        json payload = {{"jsonrpc", "2.0"}, {"id", 31}};
+        std::string method;
+        RequestPriority priority = RequestPriority::Normal;
+        if (request.action == QuoteActionType::Cancel)
+        {
+            method = "private/cancel";
+            payload["params"] = {{"order_id", request.orderId}};
+            priority = RequestPriority::Cancel;
+        }
+        else if (request.action == QuoteActionType::Edit)
+        {
+            method = "private/edit";
+            payload["params"] = {{"order_id", request.orderId}, {"amount", request.order.amount}, {"price", request.order.price}};
+        }
+        else
+        {
+            method = request.order.side == Side::Buy ? "private/buy" : "private/sell";
+            payload["params"] = {{"instrument_name", request.order.instrument}, {"type", "limit"}, {"post_only", postOnly},
+                                 {"amount", request.order.amount}, {"price", request.order.price}, {"label", label}};
+        }
+        payload["method"] = method;
+        request.response = sendRequestAsync(context, method, payload, priority);
+    }
+
+    int succeeded = 0;
+    for (Pending &request : pending)
+    {
+        auto responseJson = json::parse(request.response.get(), nullptr, false);
+        context.checkThrottled(responseJson, RequestClass::MatchingEngine);
+        bool ok = !responseJson.is_discarded() && responseJson.contains("result");
+        succeeded += ok;
+        const TrackedOrder &order = request.order;
+        switch (request.action)
+        {
+        case QuoteActionType::Cancel:
+            if (ok)
+            {
+                context.risk.release(order.instrumentId, order.side, order.remaining(), order.price, true);
+                context.journalEvent(JournalEvent::Cancel, order, request.orderId, order.remaining(), order.price);
+                context.openOrders.erase(request.orderId);
+            }
+            break;
+        case QuoteActionType::Edit:
+            context.openOrders.erase(request.orderId);
+            if (ok && responseJson["result"].contains("order"))
+            {
+                context.journalEvent(JournalEvent::Modify, order, request.orderId, order.amount, order.price);
+                applyOrderState(context, responseJson["result"], order);
+            }
+            else
+            {
+                const TrackedOrder &previous = request.previous;
+                context.risk.release(order.instrumentId, order.side, order.remaining(), order.price, true);
+                context.risk.reserve(previous.instrumentId, previous.side, previous.remaining(), previous.price);
+                context.openOrders[request.orderId] = previous;
+            }
+            break;
+        case QuoteActionType::New:
+            if (ok && responseJson["result"].contains("order"))
+            {
+                context.journalEvent(JournalEvent::Ack, order, responseJson["result"]["order"].value("order_id", ""), order.amount, order.price);
+                applyOrderState(context, responseJson["result"], order);
+            }
+            else
+            {
+                context.risk.release(order.instrumentId, order.side, order.amount, order.price, true);
+                context.journalEvent(JournalEvent::Reject, order, "", order.amount, order.price);
+            }
+            break;
+        }
+        if (!ok)
+        {
+            std::cerr << "Quote request failed: " << responseJson.dump() << std::endl;
+        }
+    }
+    return succeeded;
+}
+
+// Replaces every live quote carrying `label` with `quotes` in one parallel
+// round. Only the differences are sent: quotes already resting at the right
+// price and size are left alone, the rest are edited in place, placed or
+// cancelled (see diffQuotes).
+void massQuote(TradingContext &context, const std::string &label, const std::vector<Quote> &quotes)
+{
+    std::vector<LiveQuote> live = liveQuotes(context, label);
+    std::vector<std::string> instruments;
+    std::unordered_map<std::string, QuoteLadder> ladders;
+    for (const Quote &quote : quotes)
+    {
+        QuoteLadder &ladder = ladders[quote.instrument];
+        (quote.side == Side::Buy ? ladder.bids : ladder.asks).push_back({quote.price, quote.amount});
+    }
+    for (const LiveQuote &quote : live)
+    {
+        ladders[quote.instrument];
+    }
+
+    std::vector<QuoteAction> actions;
+    for (const auto &[instrument, ladder] : ladders)
+    {
+        std::vector<QuoteAction> planned = diffQuotes(instrument, ladder, live);
+        actions.insert(actions.end(), planned.begin(), planned.end());
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int succeeded = sendQuoteActions(context, label, actions);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> latency = end - start;
+
+    std::cout << "Mass quote: " << succeeded << "/" << actions.size() << " requests succeeded ("
+              << live.size() + quotes.size() - actions.size() << " saved by diffing)." << std::endl;
+    std::cout << "Mass quote latency: " << latency.count() << " seconds." << std::endl;
+}
+
+// Fetches an instrument's ticker, refreshing the local mid and marks; returns the mid (0 if unavailable)
+double fetchMid(TradingContext &context, const std::string &instrument)
+{
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return 0;
+    }
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "public/ticker"},
+        {"params", {{"instrument_name", instrument}}},
+        {"id", 36}};
+    std::string response = sendRequest("https://test.deribit.com/api/v2/public/ticker", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result"))
+    {
+        return 0;
+    }
+    const json &ticker = responseJson["result"];
+    double bid = ticker["best_bid_price"].is_number() ? ticker["best_bid_price"].get<double>() : 0.0;
+    double ask = ticker["best_ask_price"].is_number() ? ticker["best_ask_price"].get<double>() : 0.0;
+    context.positions.updateMark(instrument, ticker.value("mark_price", 0.0), ticker.value("index_price", 0.0));
+    syncPortfolio(context, instrument);
+    if (bid > 0 && ask > 0)
+    {
+        int id = context.instrumentId(instrument);
+        if (id >= 0)
+        {
+            context.risk.updateMid(id, bid, ask);
         }
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        return (bid + ask) / 2;
+    }
+    return ticker.value("mark_price", 0.0);
+}
 
-        // Set up the write callback to capture the response
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+// Runs the quote engine for `ticks` rounds: each round re-prices a symmetric
+// ladder around every instrument's mid, skewed against the current position,
+// and sends only the changes. All quotes are pulled at the end.
+void runQuoteEngine(TradingContext &context, const std::string &label, const std::vector<std::string> &instruments, double spread,
+                    int levels, double size, int ticks, std::chrono::milliseconds interval)
+{
+    std::unordered_map<std::string, InstrumentSpec> specs;
+    for (const std::string &instrument : instruments)
+    {
+        if (!lookupInstrument(context, instrument, specs[instrument]))
+        {
+            return;
+        }
+    }
 
-        // Perform the request
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK)
+    auto pricer = [&](const std::string &instrument, QuoteLadder &ladder)
+    {
+        double mid = fetchMid(context, instrument);
+        if (!(mid > 0))
         {
-            std::cerr << "Request failed: " << curl_easy_strerror(res) << std::endl;
+            return false;
         }
+        const InstrumentSpec &spec = specs[instrument];
+        double amount = std::max(spec.minTradeAmount, InstrumentCache::roundAmount(spec, size));
+        // Lean the ladder away from the position: long positions quote lower
+        int id = context.positions.findInstrument(instrument);
+        double position = id >= 0 ? context.positions.position(id).size : 0;
+        double center = mid * (1 - spread * std::max(-1.0, std::min(1.0, position / (amount * levels))));
+        for (int level = 0; level < levels; ++level)
+        {
+            double offset = center * spread * (level + 1);
+            ladder.bids.push_back({InstrumentCache::roundPrice(spec, center - offset, Side::Buy), amount});
+            ladder.asks.push_back({InstrumentCache::roundPrice(spec, center + offset, Side::Sell), amount});
+        }
+        return true;
+    };
+    QuoteEngine engine(instruments, pricer);
 
-        // Free Resources
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+    LatencyHistogram tickLatency;
+    for (int tick = 0; tick < ticks; ++tick)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<QuoteAction> actions = engine.tick(liveQuotes(context, label));
+        sendQuoteActions(context, label, actions);
+        auto end = std::chrono::high_resolution_clock::now();
+        tickLatency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        std::this_thread::sleep_until(start + interval);
     }
+    // Pull everything
+    QuoteEngine pull({}, pricer);
+    sendQuoteActions(context, label, pull.tick(liveQuotes(context, label)));
 
-    curl_global_cleanup();
-    return readBuffer;
+    const QuoteEngineStats &stats = engine.getStats();
+    std::cout << "Quote engine: " << stats.ticks << " ticks, " << stats.requests() << " requests (" << stats.edits << " edits, "
+              << stats.news << " new, " << stats.cancels << " cancels), " << stats.kept << " quotes left resting; cancel-and-replace would have sent "
+              << stats.naiveRequests << "." << std::endl;
+    std::cout << "Quote tick latency p50 " << tickLatency.percentile(50) / 1e6 << " ms, p99 " << tickLatency.percentile(99) / 1e6 << " ms." << std::endl;
 }
 
-// Function to get the access token
-std::string getAccessToken(const std::string &clientId, const std::string &clientSecret)
+// Fetches the top levels of an instrument's book, refreshing the local mid and marks
+bool fetchDepth(TradingContext &context, const std::string &instrument, MarketDepth &depth)
 {
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return false;
+    }
     json payload = {
-        {"id", 0},
-        {"method", "public/auth"},
-        {"params", {{"grant_type", "client_credentials"}, {"scope", "session:apiconsole-c5i26ds6dsr expires:2592000"}, {"client_id", clientId}, {"client_secret", clientSecret}}},
-        {"jsonrpc", "2.0"}};
-
-    std::string response = sendRequest("https://test.deribit.com/api/v2/public/auth", payload);
-    auto responseJson = json::parse(response);
-
-    if (responseJson.contains("result") && responseJson["result"].contains("access_token"))
+        {"jsonrpc", "2.0"},
+        {"method", "public/get_order_book"},
+        {"params", {{"instrument_name", instrument}, {"depth", 5}}},
+        {"id", 38}};
+    std::string response = sendRequest("https://test.deribit.com/api/v2/public/get_order_book", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result"))
     {
-        // std::cout << "Payload: " << payload.dump(4) << std::endl;
-        return responseJson["result"]["access_token"];
+        return false;
     }
-    else
+    const json &book = responseJson["result"];
+    for (const json &level : book.value("bids", json::array()))
+    {
+        depth.bids.push_back({level[0].get<double>(), level[1].get<double>()});
+    }
+    for (const json &level : book.value("asks", json::array()))
+    {
+        depth.asks.push_back({level[0].get<double>(), level[1].get<double>()});
+    }
+    int id = context.instrumentId(instrument);
+    if (id >= 0 && !depth.bids.empty() && !depth.asks.empty())
     {
-        std::cerr << "Failed to retrieve access token." << std::endl;
-        return "";
+        context.risk.updateMid(id, depth.bids.front().price, depth.asks.front().price);
     }
+    context.positions.updateMark(instrument, book.value("mark_price", 0.0), book.value("index_price", 0.0));
+    syncPortfolio(context, instrument);
+    return true;
 }
 
-// Function to place an order
-void placeOrder(const std::string &price, const std::string &accessToken, const std::string &amount, const std::string &instrument)
+// Re-reads a tracked order (private/get_order_state) to pick up fills since its last response
+void refreshOrder(TradingContext &context, const std::string &orderId)
 {
+    auto tracked = context.openOrders.find(orderId);
+    if (tracked == context.openOrders.end() || !context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return;
+    }
     json payload = {
         {"jsonrpc", "2.0"},
-        {"method", "private/buy"},
-        {"params", {{"instrument_name", instrument}, {"type", "limit"}, {"price", price}, {"amount", amount}}},
-        {"id", 1}};
-
-    auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/private/buy", payload, accessToken);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> latency = end - start;
-
-    std::cout << "Place Order Response: " << response << std::endl;
-    std::cout << "Order placement latency: " << latency.count() << " seconds." << std::endl;
+        {"method", "private/get_order_state"},
+        {"params", {{"order_id", orderId}}},
+        {"id", 39}};
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_order_state", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_object())
+    {
+        return;
+    }
+    TrackedOrder order = tracked->second;
+    context.openOrders.erase(tracked);
+    applyOrderState(context, {{"order", responseJson["result"]}}, order);
 }
 
-// Function to cancel an order
-void cancelOrder(const std::string &accessToken, const std::string &orderID)
+// Works parent orders with the execution scheduler until all are done.
+// Each parent's children carry the label "algo<id>", which is how the
+// scheduler's gateway finds them and their fills.
+void runExecutionAlgos(TradingContext &context, const std::vector<AlgoParams> &orders)
 {
-    json payload = {
-        {"jsonrpc", "2.0"},
-        {"method", "private/cancel"},
-        {"params", {{"order_id", orderID}}},
-        {"id", 6}};
-
-    auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/private/cancel", payload, accessToken);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> latency = end - start;
+    auto labelOf = [](uint64_t parent)
+    { return "algo" + std::to_string(parent); };
 
-    std::cout << "Cancel Order Response: " << response << std::endl;
-    std::cout << "Order cancellation latency: " << latency.count() << " seconds." << std::endl;
-}
+    ExecutionGateway gateway;
+    gateway.depth = [&context](const std::string &instrument, MarketDepth &depth)
+    { return fetchDepth(context, instrument, depth); };
+    gateway.state = [&context, &labelOf](uint64_t parent, std::vector<LiveQuote> &live)
+    {
+        std::string label = labelOf(parent);
+        for (const LiveQuote &quote : liveQuotes(context, label))
+        {
+            refreshOrder(context, quote.orderId);
+        }
+        live = liveQuotes(context, label);
+        return context.filledByLabel[label];
+    };
+    gateway.send = [&context, &labelOf](uint64_t parent, const std::vector<QuoteAction> &actions)
+    { sendQuoteActions(context, labelOf(parent), actions, false); };
 
-// Function to modify an order
-void modifyOrder(const std::string &accessToken, const std::string &orderID, int amount, double price)
-{
-    json payload = {
-        {"jsonrpc", "2.0"},
-        {"method", "private/edit"},
-        {"params", {{"order_id", orderID}, {"amount", amount}, {"price", price}}},
-        {"id", 11}};
+    ExecutionScheduler scheduler(gateway);
+    for (AlgoParams params : orders)
+    {
+        InstrumentSpec spec;
+        if (!lookupInstrument(context, params.instrument, spec))
+        {
+            continue;
+        }
+        params.tickSize = spec.tickSize;
+        params.minAmount = spec.minTradeAmount;
+        uint64_t id = scheduler.submit(params);
+        // A restarted session numbers parents from 1 again
+        context.filledByLabel.erase(labelOf(id));
+    }
 
     auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/private/edit", payload, accessToken);
+    scheduler.runUntilDone();
     auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> latency = end - start;
 
-    std::cout << "Modify Order Response: " << response << std::endl;
-    std::cout << "Order modification latency: " << latency.count() << " seconds." << std::endl;
+    for (const AlgoStatus &status : scheduler.status())
+    {
+        std::cout << algoTypeName(status.params.type) << " " << (status.params.side == Side::Buy ? "buy " : "sell ") << status.params.amount
+                  << " " << status.params.instrument << ": filled " << status.filled << " in " << status.decisions << " decisions, "
+                  << status.requests << " child requests." << std::endl;
+    }
+    std::cout << "Execution time: " << std::chrono::duration<double>(end - start).count() << " seconds." << std::endl;
 }
 
 // Function to retrieve the order book
-void getOrderBook(const std::string &accessToken, const std::string &instrument)
+void getOrderBook(TradingContext &context, const std::string &instrument)
 {
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return;
+    }
+
     json payload = {
         {"jsonrpc", "2.0"},
         {"method", "public/get_order_book"},
@@ -184,11 +1164,26 @@ void getOrderBook(const std::string &accessToken, const std::string &instrument)
         {"id", 15}};
 
     auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/public/get_order_book", payload, accessToken);
+    std::string response = sendRequest("https://test.deribit.com/api/v2/public/get_order_book", payload, context.accessToken());
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> latency = end - start;
 
     auto responseJson = json::parse(response);
+    if (responseJson.contains("result") && responseJson["result"]["best_bid_price"].is_number() &&
+        responseJson["result"]["best_ask_price"].is_number())
+    {
+        // The local mid is the reference for the pre-trade price band
+        int id = context.instrumentId(instrument);
+        if (id >= 0)
+        {
+            context.risk.updateMid(id, responseJson["result"]["best_bid_price"].get<double>(), responseJson["result"]["best_ask_price"].get<double>());
+        }
+    }
+    if (responseJson.contains("result"))
+    {
+        context.positions.updateMark(instrument, responseJson["result"].value("mark_price", 0.0), responseJson["result"].value("index_price", 0.0));
+        syncPortfolio(context, instrument);
+    }
     std::cout << "Order Book for " << instrument << ":\n\n";
     std::cout << "Best Bid Price: " << responseJson["result"]["best_bid_price"] << ", Amount: " << responseJson["result"]["best_bid_amount"] << '\n';
     std::cout << "Best Ask Price: " << responseJson["result"]["best_ask_price"] << ", Amount: " << responseJson["result"]["best_ask_amount"] << '\n';
@@ -196,56 +1191,296 @@ void getOrderBook(const std::string &accessToken, const std::string &instrument)
     std::cout << "Market data processing latency: " << latency.count() << " seconds." << std::endl;
 }
 
-// Function to get position details of a specific instrument
-void getPosition(const std::string &accessToken, const std::string &instrument)
+// Overwrites the local positions with the exchange's (private/get_positions)
+// and reports any drift. Runs periodically in the background.
+void reconcilePositions(TradingContext &context)
 {
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return;
+    }
+
     json payload = {
         {"jsonrpc", "2.0"},
-        {"method", "private/get_position"},
-        {"params", {{"instrument_name", instrument}}},
+        {"method", "private/get_positions"},
+        {"params", {{"currency", "any"}}},
         {"id", 20}};
 
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_positions", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_array())
+    {
+        std::cerr << "Error: Could not retrieve positions for reconciliation." << std::endl;
+        return;
+    }
+    std::set<std::string> currencies;
+    {
+        std::lock_guard<std::mutex> lock(context.stateMutex);
+        for (const json &position : responseJson["result"])
+        {
+            std::string instrument = position.value("instrument_name", "");
+            double drift = context.positions.reconcile(position);
+            if (std::fabs(drift) > 1e-9)
+            {
+                std::cerr << "Position drift on " << instrument << ": local size was off by " << drift << std::endl;
+            }
+            // Pre-trade risk checks position limits against its own copy
+            double price = position.value("mark_price", 0.0);
+            context.risk.setPosition(context.instrumentId(instrument), position.value("size", 0.0),
+                                     price > 0 ? price : position.value("average_price", 0.0));
+            syncPortfolio(context, instrument);
+            currencies.insert(TradingContext::settlementCurrencyOf(instrument));
+        }
+    }
+
+    // Equity and margin of every currency with a position
+    for (const std::string &currency : currencies)
+    {
+        if (currency.empty() || !context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+        {
+            continue;
+        }
+        json summaryPayload = {
+            {"jsonrpc", "2.0"},
+            {"method", "private/get_account_summary"},
+            {"params", {{"currency", currency}}},
+            {"id", 21}};
+        std::string summary = sendRequest("https://test.deribit.com/api/v2/private/get_account_summary", summaryPayload, context.accessToken());
+        auto summaryJson = json::parse(summary, nullptr, false);
+        if (!summaryJson.is_discarded() && summaryJson.contains("result") && summaryJson["result"].is_object())
+        {
+            context.positions.onAccountSummary(summaryJson["result"]);
+        }
+    }
+}
+
+// Fetches our trades since the last poll (private/get_user_trades_by_currency)
+// and applies the ones no order response has shown: resting orders that fill
+// after their response are only seen here. trade_seq only orders the trades
+// of one instrument, so the cursor is the newest trade's timestamp; trades in
+// that millisecond come back next time and are dropped by trade_id.
+void pollTrades(TradingContext &context)
+{
+    for (int page = 0; page < 10; page++)
+    {
+        if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+        {
+            return;
+        }
+        json payload = {
+            {"jsonrpc", "2.0"},
+            {"method", "private/get_user_trades_by_currency"},
+            {"params", {{"currency", "any"}, {"start_timestamp", context.tradeCursorMs}, {"count", 1000}, {"sorting", "asc"}}},
+            {"id", 22}};
+        std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_user_trades_by_currency", payload, context.accessToken());
+        auto responseJson = json::parse(response, nullptr, false);
+        if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_object() ||
+            !responseJson["result"].contains("trades") || !responseJson["result"]["trades"].is_array())
+        {
+            std::cerr << "Error: Could not retrieve user trades." << std::endl;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(context.stateMutex);
+        for (const json &trade : responseJson["result"]["trades"])
+        {
+            if (!trade.is_object())
+            {
+                continue;
+            }
+            context.tradeCursorMs = std::max(context.tradeCursorMs, trade.value("timestamp", context.tradeCursorMs));
+            auto tracked = context.openOrders.find(trade.value("order_id", ""));
+            if (tracked == context.openOrders.end())
+            {
+                applyTrade(context, trade, nullptr);
+                continue;
+            }
+            TrackedOrder &order = tracked->second;
+            if (applyTrade(context, trade, &order) > 0 && !(order.remaining() > 0))
+            {
+                context.risk.release(order.instrumentId, order.side, 0, order.price, true);
+                context.journalEvent(JournalEvent::Closed, order, tracked->first, 0, order.price);
+                context.openOrders.erase(tracked);
+            }
+        }
+        if (!responseJson["result"].value("has_more", false))
+        {
+            return;
+        }
+    }
+}
+
+// Function to get position details of a specific instrument
+void getPosition(TradingContext &context, const std::string &instrument)
+{
     auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_position", payload, accessToken);
-    auto responseJson = json::parse(response);
+    int id = context.positions.findInstrument(instrument);
+    PositionSnapshot position = context.positions.position(id);
     auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> latency = end - start;
 
-    if (responseJson.contains("result"))
+    if (id < 0)
     {
-        std::cout << "Position Details for " << instrument << ":\n\n";
-        auto result = responseJson["result"];
-        std::cout << "Estimated Liquidation Price: " << result["estimated_liquidation_price"] << '\n';
-        std::cout << "Size Currency: " << result["size_currency"] << '\n';
-        std::cout << "Realized Funding: " << result["realized_funding"] << '\n';
-        std::cout << "Total Profit Loss: " << result["total_profit_loss"] << '\n';
-        std::cout << "Realized Profit Loss: " << result["realized_profit_loss"] << '\n';
-        std::cout << "Floating Profit Loss: " << result["floating_profit_loss"] << '\n';
-        std::cout << "Leverage: " << result["leverage"] << '\n';
-        std::cout << "Average Price: " << result["average_price"] << '\n';
-        std::cout << "Delta: " << result["delta"] << '\n';
-        std::cout << "Interest Value: " << result["interest_value"] << '\n';
-        std::cout << "Mark Price: " << result["mark_price"] << '\n';
-        std::cout << "Settlement Price: " << result["settlement_price"] << '\n';
-        std::cout << "Index Price: " << result["index_price"] << '\n';
-        std::cout << "Direction: " << result["direction"] << '\n';
-        std::cout << "Open Orders Margin: " << result["open_orders_margin"] << '\n';
-        std::cout << "Initial Margin: " << result["initial_margin"] << '\n';
-        std::cout << "Maintenance Margin: " << result["maintenance_margin"] << '\n';
-        std::cout << "Kind: " << result["kind"] << '\n';
-        std::cout << "Size: " << result["size"] << '\n';
+        std::cout << "No position in " << instrument << ".\n";
+        return;
     }
-    else
+    PortfolioSnapshot portfolio = context.positions.portfolio(TradingContext::settlementCurrencyOf(instrument));
+
+    std::cout << "Position Details for " << instrument << ":\n\n";
+    std::cout << "Size: " << position.size << '\n';
+    std::cout << "Direction: " << (position.size > 0 ? "buy" : position.size < 0 ? "sell" : "zero") << '\n';
+    std::cout << "Average Price: " << position.averagePrice << '\n';
+    std::cout << "Realized Profit Loss: " << position.realizedPnl << '\n';
+    std::cout << "Floating Profit Loss: " << position.floatingPnl << '\n';
+    std::cout << "Total Profit Loss: " << position.realizedPnl + position.floatingPnl << '\n';
+    std::cout << "Fees: " << position.fees << '\n';
+    std::cout << "Mark Price: " << position.markPrice << '\n';
+    std::cout << "Index Price: " << position.indexPrice << '\n';
+    if (portfolio.updatedNs)
+    {
+        std::cout << "Equity: " << portfolio.equity << '\n';
+        std::cout << "Available Funds: " << portfolio.availableFunds << '\n';
+        std::cout << "Initial Margin: " << portfolio.initialMargin << '\n';
+        std::cout << "Maintenance Margin: " << portfolio.maintenanceMargin << '\n';
+    }
+    std::cout << "Last updated: " << (nowNanos() - position.updatedNs) / 1000000 << " ms ago\n";
+
+    std::cout << "Position query latency: " << std::chrono::duration<double, std::nano>(end - start).count() << " ns." << std::endl;
+}
+
+// Function to show the exposure of every currency and a spot x vol stress grid
+void getPortfolioRisk(TradingContext &context)
+{
+    std::vector<std::string> currencies = context.portfolio.currencies();
+    if (currencies.empty())
+    {
+        std::cout << "No positions.\n";
+        return;
+    }
+    std::cout << std::left << std::setw(8) << "Currency" << std::right << std::setw(12) << "Delta" << std::setw(14) << "Gamma"
+              << std::setw(12) << "Vega" << std::setw(12) << "Theta" << std::setw(16) << "Notional" << std::setw(14) << "Margin" << '\n';
+    for (const std::string &currency : currencies)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        CurrencyExposure exposure = context.portfolio.exposure(currency);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << std::left << std::setw(8) << currency << std::right << std::fixed << std::setprecision(4) << std::setw(12) << exposure.delta
+                  << std::setprecision(6) << std::setw(14) << exposure.gamma << std::setprecision(2) << std::setw(12) << exposure.vega
+                  << std::setw(12) << exposure.theta << std::setw(16) << exposure.notional << std::setw(14) << exposure.margin
+                  << "  (" << std::chrono::duration<double, std::nano>(end - start).count() << " ns)\n";
+    }
+    std::cout << std::defaultfloat;
+
+    std::vector<double> spotShocks = {-0.2, -0.1, -0.05, -0.02, 0, 0.02, 0.05, 0.1, 0.2};
+    std::vector<double> volShocks = {-0.1, -0.05, 0, 0.05, 0.1};
+    auto start = std::chrono::high_resolution_clock::now();
+    ScenarioGrid grid = context.portfolio.scenarios(spotShocks, volShocks);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::vector<double> total = grid.total();
+    std::cout << "\nPnL (USD), spot shock x vol shock:\n" << std::setw(8) << "";
+    for (double volShock : volShocks)
+    {
+        std::cout << std::setw(12) << std::showpos << volShock * 100 << "v" << std::noshowpos;
+    }
+    std::cout << '\n' << std::fixed << std::setprecision(0);
+    for (size_t s = 0; s < spotShocks.size(); ++s)
+    {
+        std::cout << std::setw(7) << std::showpos << spotShocks[s] * 100 << "%" << std::noshowpos;
+        for (size_t v = 0; v < volShocks.size(); ++v)
+        {
+            std::cout << std::setw(13) << total[s * volShocks.size() + v];
+        }
+        std::cout << '\n';
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+    std::cout << "Worst scenario PnL: " << *std::min_element(total.begin(), total.end()) << " USD\n";
+    std::cout << "Scenario grid latency: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms." << std::endl;
+}
+
+// Function to compute implied vols and Greeks for every option of a currency
+void getOptionChain(TradingContext &context, const std::string &currency)
+{
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return;
+    }
+
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "public/get_book_summary_by_currency"},
+        {"params", {{"currency", currency}, {"kind", "option"}}},
+        {"id", 35}};
+
+    std::string response = sendRequest("https://test.deribit.com/api/v2/public/get_book_summary_by_currency", payload, context.accessToken());
+    auto responseJson = json::parse(response, nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_array())
+    {
+        std::cerr << "Error: Could not retrieve the option chain." << std::endl;
+        return;
+    }
+
+    OptionChain chain;
+    std::vector<std::string> names;
+    std::vector<double> exchangeIv;
+    std::time_t now = std::time(nullptr);
+    for (const json &summary : responseJson["result"])
+    {
+        std::string name = summary.value("instrument_name", "");
+        std::time_t expiry;
+        double strike;
+        bool call;
+        double underlying = summary["underlying_price"].is_number() ? summary["underlying_price"].get<double>() : 0.0;
+        if (!parseOptionName(name, expiry, strike, call) || expiry <= now || !(underlying > 0))
+        {
+            continue;
+        }
+        // Premiums are quoted in the coin; the mid where there is a two-sided market, else the mark
+        double bid = summary["bid_price"].is_number() ? summary["bid_price"].get<double>() : 0.0;
+        double ask = summary["ask_price"].is_number() ? summary["ask_price"].get<double>() : 0.0;
+        double premium = bid > 0 && ask > 0 ? (bid + ask) / 2 : (summary["mark_price"].is_number() ? summary["mark_price"].get<double>() : 0.0);
+        double markIv = summary["mark_iv"].is_number() ? summary["mark_iv"].get<double>() / 100 : 0.5;
+        double rate = summary["interest_rate"].is_number() ? summary["interest_rate"].get<double>() : 0.0;
+        chain.add(underlying, strike, (expiry - now) / (365.0 * 86400), call, premium * underlying, markIv > 0 ? markIv : 0.5, rate);
+        names.push_back(name);
+        exchangeIv.push_back(markIv);
+    }
+
+    SimdLevel level = detectSimdLevel();
+    auto start = std::chrono::high_resolution_clock::now();
+    evaluateChain(chain, level);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // Show the options closest to the money
+    std::vector<size_t> order(chain.size());
+    for (size_t i = 0; i < order.size(); ++i)
     {
-        std::cerr << "Error: Could not retrieve position data." << std::endl;
+        order[i] = i;
     }
+    auto distance = [&chain](size_t i)
+    { return std::fabs(std::log(chain.forward[i] / chain.strike[i])) + chain.expiry[i]; };
+    std::sort(order.begin(), order.end(), [&distance](size_t a, size_t b)
+              { return distance(a) < distance(b); });
 
-    std::cout << "End-to-end trading loop latency: " << latency.count() << " seconds." << std::endl;
+    std::cout << "Option chain for " << currency << " (" << chain.size() << " options):\n\n";
+    for (size_t k = 0; k < std::min<size_t>(order.size(), 10); ++k)
+    {
+        size_t i = order[k];
+        std::cout << names[i] << ": IV " << chain.impliedVol[i] * 100 << "% (exchange " << exchangeIv[i] * 100
+                  << "%), Delta " << chain.delta[i] << ", Gamma " << chain.gamma[i] << ", Vega " << chain.vega[i] / 100
+                  << ", Theta " << chain.theta[i] / 365 << "/day\n";
+    }
+    std::cout << "Option chain pricing latency (" << simdLevelName(level) << "): "
+              << std::chrono::duration<double, std::micro>(end - start).count() << " microseconds." << std::endl;
 }
 
 // Function to print all open orders with instrument, order ID, price, and amount
-void getOpenOrders(const std::string &accessToken)
+void getOpenOrders(TradingContext &context)
 {
+    if (!context.admit(RequestClass::NonMatching, RequestPriority::Normal))
+    {
+        return;
+    }
+
     json payload = {
         {"jsonrpc", "2.0"},
         {"method", "private/get_open_orders"},
@@ -253,7 +1488,7 @@ void getOpenOrders(const std::string &accessToken)
         {"id", 25}};
 
     auto start = std::chrono::high_resolution_clock::now();
-    std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_open_orders", payload, accessToken);
+    std::string response = sendRequest("https://test.deribit.com/api/v2/private/get_open_orders", payload, context.accessToken());
     auto end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> latency = end - start;
 
@@ -277,21 +1512,181 @@ void getOpenOrders(const std::string &accessToken)
     std::cout << "Open orders latency: " << latency.count() << " seconds." << std::endl;
 }
 
+// Rebuilds the order state the journal had at the last shutdown or crash and
+// reconciles it with the orders actually resting at the exchange:
+//   - journaled orders still open are tracked again with the exchange's fills
+//   - intents that never got an ack are matched to an unknown exchange order of
+//     the same instrument, side, amount and price, or else dropped
+//   - journaled orders no longer open are closed
+//   - exchange orders the journal does not know (placed elsewhere) are adopted
+// The journal is then compacted down to the live set.
+void recoverOrders(TradingContext &context)
+{
+    if (!context.journal)
+    {
+        return;
+    }
+    std::vector<RecoveredOrder> recovered = context.journal->recover();
+
+    json payload = {
+        {"jsonrpc", "2.0"},
+        {"method", "private/get_open_orders"},
+        {"params", json::object()},
+        {"id", 40}};
+    context.admit(RequestClass::NonMatching, RequestPriority::Normal);
+    auto responseJson = json::parse(sendRequest("https://test.deribit.com/api/v2/private/get_open_orders", payload, context.accessToken()), nullptr, false);
+    if (responseJson.is_discarded() || !responseJson.contains("result") || !responseJson["result"].is_array())
+    {
+        // Without the exchange's view keep what the journal says, minus unacknowledged intents
+        std::cerr << "Warning: could not fetch open orders, recovering from the journal alone." << std::endl;
+        recovered.erase(std::remove_if(recovered.begin(), recovered.end(), [](const RecoveredOrder &order)
+                                       { return order.orderId.empty(); }),
+                        recovered.end());
+        responseJson = {{"result", json::array()}};
+        for (const RecoveredOrder &order : recovered)
+        {
+            responseJson["result"].push_back({{"order_id", order.orderId}, {"instrument_name", order.instrument}, {"label", order.label},
+                                              {"direction", order.side == Side::Buy ? "buy" : "sell"}, {"amount", order.amount},
+                                              {"filled_amount", order.filled}, {"price", order.price}});
+        }
+    }
+
+    std::unordered_map<std::string, json> exchangeOrders;
+    for (const json &order : responseJson["result"])
+    {
+        exchangeOrders[order.value("order_id", "")] = order;
+    }
+    auto sameOrder = [](const RecoveredOrder &order, const json &exchangeOrder)
+    {
+        return exchangeOrder.value("instrument_name", "") == order.instrument &&
+               (exchangeOrder.value("direction", "") == "sell") == (order.side == Side::Sell) &&
+               exchangeOrder.value("amount", 0.0) == order.amount && exchangeOrder.value("price", 0.0) == order.price;
+    };
+
+    std::vector<RecoveredOrder> live;
+    int closed = 0;
+    for (RecoveredOrder &order : recovered)
+    {
+        auto match = exchangeOrders.end();
+        if (!order.orderId.empty())
+        {
+            match = exchangeOrders.find(order.orderId);
+        }
+        else
+        {
+            match = std::find_if(exchangeOrders.begin(), exchangeOrders.end(), [&](const auto &entry)
+                                 { return sameOrder(order, entry.second); });
+        }
+        if (match == exchangeOrders.end())
+        {
+            closed++;
+            continue;
+        }
+        order.orderId = match->first;
+        order.amount = match->second.value("amount", order.amount);
+        order.price = match->second.value("price", order.price);
+        order.filled = match->second.value("filled_amount", order.filled);
+        live.push_back(order);
+        exchangeOrders.erase(match);
+    }
+    for (const auto &[orderId, exchangeOrder] : exchangeOrders)
+    {
+        RecoveredOrder order;
+        order.orderId = orderId;
+        order.instrument = exchangeOrder.value("instrument_name", "");
+        order.label = exchangeOrder.value("label", "");
+        order.side = exchangeOrder.value("direction", "") == "sell" ? Side::Sell : Side::Buy;
+        order.amount = exchangeOrder.value("amount", 0.0);
+        order.filled = exchangeOrder.value("filled_amount", 0.0);
+        order.price = exchangeOrder.value("price", 0.0);
+        live.push_back(order);
+    }
+
+    context.journal->compact(live);
+    for (const RecoveredOrder &order : live)
+    {
+        TrackedOrder tracked{context.instrumentId(order.instrument), order.side, order.amount, order.price, order.label, order.instrument};
+        tracked.intentSeq = order.intentSeq;
+        tracked.filled = order.filled;
+        if (tracked.instrumentId >= 0)
+        {
+            context.risk.reserve(tracked.instrumentId, tracked.side, tracked.remaining(), tracked.price);
+        }
+        context.openOrders[order.orderId] = tracked;
+    }
+    std::cout << "Recovered " << live.size() << " open order(s) (" << recovered.size() - closed << " from the journal, "
+              << live.size() - (recovered.size() - closed) << " adopted from the exchange), closed " << closed << "." << std::endl;
+}
+
 int main()
 {
-    std::string clientId = getEnvVariable("CLIENT_ID");
-    std::string clientSecret = getEnvVariable("CLIENT_SECRET");
+    const std::string &clientId = envConfig().get("CLIENT_ID");
+    const std::string &clientSecret = envConfig().get("CLIENT_SECRET");
 
     if (clientId.empty() || clientSecret.empty())
     {
         std::cerr << "Error: CLIENT_ID or CLIENT_SECRET is missing in .env file.\n";
         return 1;
     }
+    std::string rateError = CreditRateLimiter::validate(TradingContext::matchingRule(envConfig()));
+    if (!rateError.empty())
+    {
+        std::cerr << "Error: invalid RATE_MATCHING_BURST / RATE_MATCHING_PER_SEC: " << rateError
+                  << ". The burst must be at least 2 requests and the rate positive.\n";
+        return 1;
+    }
 
-    std::string accessToken = getAccessToken(clientId, clientSecret);
+    // curl_global_init is not thread-safe, and the token refresher sends requests
+    // concurrently with the menu, so initialise once before any thread starts
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    TokenManager tokens(sendRequest, clientId, clientSecret);
 
-    if (!accessToken.empty())
+    if (tokens.start())
     {
+        TradingContext context(tokens, envConfig());
+        context.loadRiskLimits(envConfig().get("RISK_LIMITS_FILE", "risk_limits.json"));
+        loadInstruments(context);
+        // Fills before this are in the positions reconciled below
+        context.tradeCursorMs = nowNanos() / 1000000;
+        recoverOrders(context);
+        reconcilePositions(context);
+
+        // Positions are kept from fills, polled every TRADE_POLL_MS; REST
+        // positions are only a periodic cross-check
+        std::mutex reconcileMutex;
+        std::condition_variable reconcileWake;
+        bool exiting = false;
+        std::chrono::milliseconds pollInterval(envConfig().getInt("TRADE_POLL_MS", 1000));
+        std::chrono::seconds reconcileInterval(envConfig().getInt("POSITION_RECONCILE_SEC", 60));
+        std::thread reconciler([&]()
+                               {
+                                   auto nextReconcile = std::chrono::steady_clock::now() + reconcileInterval;
+                                   std::unique_lock<std::mutex> lock(reconcileMutex);
+                                   while (!reconcileWake.wait_for(lock, pollInterval, [&exiting]()
+                                                                  { return exiting; }))
+                                   {
+                                       lock.unlock();
+                                       pollTrades(context);
+                                       if (std::chrono::steady_clock::now() >= nextReconcile)
+                                       {
+                                           reconcilePositions(context);
+                                           nextReconcile = std::chrono::steady_clock::now() + reconcileInterval;
+                                       }
+                                       lock.lock();
+                                   } });
+        // New expiries and strikes are listed daily; the snapshot is refreshed in the background
+        std::chrono::seconds refreshInterval(envConfig().getInt("INSTRUMENTS_REFRESH_SEC", 3600));
+        std::thread instrumentRefresher([&]()
+                                        {
+                                            std::unique_lock<std::mutex> lock(reconcileMutex);
+                                            while (!reconcileWake.wait_for(lock, refreshInterval, [&exiting]()
+                                                                           { return exiting; }))
+                                            {
+                                                lock.unlock();
+                                                refreshInstruments(context);
+                                                lock.lock();
+                                            } });
+
         int choice;
         do
         {
@@ -303,8 +1698,18 @@ int main()
             std::cout << "4. Get Order Book\n";
             std::cout << "5. Get Position\n";
             std::cout << "6. Get Open Orders\n";
+            std::cout << "7. Cancel All Orders\n";
+            std::cout << "8. Cancel Orders by Instrument\n";
+            std::cout << "9. Cancel Orders by Label\n";
+            std::cout << "10. Mass Quote\n";
+            std::cout << "11. Option Chain Greeks\n";
+            std::cout << "12. Portfolio Risk\n";
+            std::cout << "13. Run Quote Engine\n";
+            std::cout << "14. Run Execution Algos\n";
             std::cout << "Enter your choice: ";
             std::cin >> choice;
+            // Polled fills are applied between actions, not in the middle of one
+            std::lock_guard<std::mutex> state(context.stateMutex);
 
             switch (choice)
             {
@@ -320,7 +1725,7 @@ int main()
                 std::cin >> price;
                 std::cout << "Enter instrument (e.g., ETH-PERPETUAL): ";
                 std::cin >> instrument;
-                placeOrder(price, accessToken, amount, instrument);
+                placeOrder(context, price, amount, instrument);
                 break;
             }
             case 2:
@@ -328,7 +1733,7 @@ int main()
                 std::string orderId;
                 std::cout << "Enter order ID to cancel: ";
                 std::cin >> orderId;
-                cancelOrder(accessToken, orderId);
+                cancelOrder(context, orderId);
                 break;
             }
             case 3:
@@ -341,7 +1746,7 @@ int main()
                 std::cin >> newAmount;
                 std::cout << "Enter new price: ";
                 std::cin >> newPrice;
-                modifyOrder(accessToken, orderId, newAmount, newPrice);
+                modifyOrder(context, orderId, newAmount, newPrice);
                 break;
             }
             case 4:
@@ -349,7 +1754,7 @@ int main()
                 std::string instrument;
                 std::cout << "Enter instrument (e.g., ETH-PERPETUAL): ";
                 std::cin >> instrument;
-                getOrderBook(accessToken, instrument);
+                getOrderBook(context, instrument);
                 break;
             }
             case 5:
@@ -357,22 +1762,161 @@ int main()
                 std::string instrument;
                 std::cout << "Enter instrument (e.g., ETH-PERPETUAL): ";
                 std::cin >> instrument;
-                getPosition(accessToken, instrument);
+                getPosition(context, instrument);
                 break;
             }
             case 6:
-                getOpenOrders(accessToken);
+                getOpenOrders(context);
+                break;
+            case 7:
+                cancelAllOrders(context);
+                break;
+            case 8:
+            {
+                std::string instrument;
+                std::cout << "Enter instrument (e.g., ETH-PERPETUAL): ";
+                std::cin >> instrument;
+                cancelOrdersByInstrument(context, instrument);
+                break;
+            }
+            case 9:
+            {
+                std::string label;
+                std::cout << "Enter label: ";
+                std::cin >> label;
+                cancelOrdersByLabel(context, label);
+                break;
+            }
+            case 10:
+            {
+                std::string label;
+                int count = 0;
+                std::cout << "Enter quote label: ";
+                std::cin >> label;
+                std::cout << "Enter number of quotes: ";
+                std::cin >> count;
+                std::vector<Quote> quotes;
+                for (int i = 0; i < count; ++i)
+                {
+                    Quote quote;
+                    std::string side;
+                    std::cout << "Quote " << i + 1 << " (instrument buy|sell amount price): ";
+                    std::cin >> quote.instrument >> side >> quote.amount >> quote.price;
+                    quote.side = side == "sell" ? Side::Sell : Side::Buy;
+                    quotes.push_back(quote);
+                }
+                massQuote(context, label, quotes);
+                break;
+            }
+            case 11:
+            {
+                std::string currency;
+                std::cout << "Enter currency (e.g., BTC): ";
+                std::cin >> currency;
+                getOptionChain(context, currency);
+                break;
+            }
+            case 12:
+                getPortfolioRisk(context);
+                break;
+            case 13:
+            {
+                std::string label, list;
+                double spread = 0, size = 0;
+                int levels = 0, ticks = 0, intervalMs = 0;
+                std::cout << "Enter quote label: ";
+                std::cin >> label;
+                std::cout << "Enter instruments (comma-separated, e.g., BTC-PERPETUAL,ETH-PERPETUAL): ";
+                std::cin >> list;
+                std::cout << "Enter spread per level (e.g., 0.001 for 0.1%): ";
+                std::cin >> spread;
+                std::cout << "Enter levels per side: ";
+                std::cin >> levels;
+                std::cout << "Enter size per level: ";
+                std::cin >> size;
+                std::cout << "Enter number of ticks and tick interval in ms: ";
+                std::cin >> ticks >> intervalMs;
+                std::vector<std::string> instruments;
+                std::stringstream stream(list);
+                for (std::string instrument; std::getline(stream, instrument, ',');)
+                {
+                    if (!instrument.empty())
+                    {
+                        instruments.push_back(instrument);
+                    }
+                }
+                runQuoteEngine(context, label, instruments, spread, levels, size, ticks, std::chrono::milliseconds(intervalMs));
                 break;
+            }
+            case 14:
+            {
+                int count = 0;
+                std::cout << "Enter number of parent orders: ";
+                std::cin >> count;
+                std::vector<AlgoParams> orders;
+                for (int i = 0; i < count; ++i)
+                {
+                    AlgoParams params;
+                    std::string type, side;
+                    std::cout << "Parent " << i + 1 << " (twap|vwap|iceberg|peg instrument buy|sell amount limit-price, 0 = none): ";
+                    std::cin >> type >> params.instrument >> side >> params.amount >> params.limitPrice;
+                    params.side = side == "sell" ? Side::Sell : Side::Buy;
+                    int seconds = 0, intervalMs = 1000;
+                    if (type == "twap" || type == "vwap")
+                    {
+                        params.type = type == "vwap" ? AlgoType::Vwap : AlgoType::Twap;
+                        std::cout << "Enter duration in seconds and interval in ms: ";
+                        std::cin >> seconds >> intervalMs;
+                        params.duration = std::chrono::seconds(seconds);
+                    }
+                    if (type == "vwap")
+                    {
+                        std::string curve;
+                        std::cout << "Enter volume curve (comma-separated bucket weights, e.g., 3,2,1,1,2,3): ";
+                        std::cin >> curve;
+                        std::stringstream stream(curve);
+                        for (std::string weight; std::getline(stream, weight, ',');)
+                        {
+                            params.volumeCurve.push_back(std::strtod(weight.c_str(), nullptr));
+                        }
+                    }
+                    if (type == "iceberg" || type == "peg")
+                    {
+                        params.type = type == "peg" ? AlgoType::Peg : AlgoType::Iceberg;
+                        std::cout << "Enter display amount and check interval in ms: ";
+                        std::cin >> params.displayAmount >> intervalMs;
+                    }
+                    if (type == "peg")
+                    {
+                        std::cout << "Enter peg offset from the touch: ";
+                        std::cin >> params.pegOffset;
+                    }
+                    params.interval = std::chrono::milliseconds(std::max(1, intervalMs));
+                    orders.push_back(params);
+                }
+                runExecutionAlgos(context, orders);
+                break;
+            }
             default:
                 std::cout << "Invalid choice. Please try again.\n";
                 break;
             }
         } while (choice != 0);
+
+        {
+            std::lock_guard<std::mutex> lock(reconcileMutex);
+            exiting = true;
+        }
+        reconcileWake.notify_all();
+        reconciler.join();
+        instrumentRefresher.join();
     }
     else
     {
         std::cerr << "Unable to obtain access token, aborting operations." << std::endl;
     }
 
+    tokens.stop();
+    curl_global_cleanup();
     return 0;
 }
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "feed_handler.hpp"
+
+// The wire format is written straight into the caller's buffer, which keeps
+// its capacity between messages, so a steady-state update costs no heap
+// allocations. The appenders lay values out like nlohmann::json::dump() and
+// the keys keep the order it wrote them in (sorted). Numbers use the shortest
+// digits that round-trip, where nlohmann's Grisu2 occasionally printed one
+// digit more or a different last digit for 16-17 digit values; both parse to
+// the same double.
+
+inline void appendJsonString(std::string &out, std::string_view text)
+{
+    static const char kHex[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\b':
+            out += "\\b";
+            break;
+        case '\f':
+            out += "\\f";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out += "\\u00";
+                out += kHex[c >> 4];
+                out += kHex[c & 0xf];
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+template <typename Integer>
+inline void appendJsonInteger(std::string &out, Integer value)
+{
+    char buffer[24];
+    out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+// Shortest round-trip digits, laid out like nlohmann: fixed notation with a
+// trailing ".0" for whole numbers when the decimal point falls within 15
+// digits (or 4 zeros after it), otherwise d.ddde+XX
+inline void appendJsonNumber(std::string &out, double value)
+{
+    if (!std::isfinite(value))
+    {
+        out += "null";
+        return;
+    }
+    char buffer[32];
+    char *end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::scientific).ptr;
+    char text[40];
+    char *t = text;
+    const char *p = buffer;
+    if (*p == '-')
+    {
+        *t++ = *p++;
+    }
+    char digits[20];
+    int count = 0;
+    for (; *p != 'e'; ++p)
+    {
+        if (*p != '.')
+        {
+            digits[count++] = *p;
+        }
+    }
+    int exponent = 0;
+    std::from_chars(p + (p[1] == '+' ? 2 : 1), end, exponent);
+    int point = exponent + 1; // digits before the decimal point
+
+    if (count <= point && point <= 15)
+    {
+        t = std::copy(digits, digits + count, t);
+        t = std::fill_n(t, point - count, '0');
+        *t++ = '.';
+        *t++ = '0';
+    }
+    else if (0 < point && point <= 15)
+    {
+        t = std::copy(digits, digits + point, t);
+        *t++ = '.';
+        t = std::copy(digits + point, digits + count, t);
+    }
+    else if (-4 < point && point <= 0)
+    {
+        *t++ = '0';
+        *t++ = '.';
+        t = std::fill_n(t, -point, '0');
+        t = std::copy(digits, digits + count, t);
+    }
+    else
+    {
+        *t++ = digits[0];
+        if (count > 1)
+        {
+            *t++ = '.';
+            t = std::copy(digits + 1, digits + count, t);
+        }
+        *t++ = 'e';
+        *t++ = exponent < 0 ? '-' : '+';
+        int magnitude = std::abs(exponent);
+        if (magnitude < 10)
+        {
+            *t++ = '0';
+        }
+        t = std::to_chars(t, text + sizeof(text), magnitude).ptr;
+    }
+    out.append(text, t);
+}
+
+// [price,amount], preceded by a comma unless it opens the array
+inline void appendJsonLevel(std::string &out, double price, double amount)
+{
+    out += out.back() == '[' ? "[" : ",[";
+    appendJsonNumber(out, price);
+    out += ',';
+    appendJsonNumber(out, amount);
+    out += ']';
+}
+
+inline void appendJsonLevels(std::string &out, const PriceLevel *side, int count)
+{
+    out += '[';
+    for (int i = 0; i < count; ++i)
+    {
+        appendJsonLevel(out, side[i].price, side[i].amount);
+    }
+    out += ']';
+}
+
+// Serializes one normalized update into the client wire format. Every type
+// carries "symbol", "type", "timestamp" (exchange ms) and a per-symbol "seq";
+// book and ticker updates keep the best_bid/best_ask fields.
+inline void serializeUpdate(const MarketUpdate &update, uint64_t sequence, std::string &message)
+{
+    message.clear();
+    switch (update.kind)
+    {
+    case UpdateKind::Book:
+        message += "{\"asks\":";
+        appendJsonLevels(message, update.asks, update.askCount);
+        message += ",\"best_ask\":";
+        appendJsonNumber(message, update.askCount ? update.asks[0].price : 0.0);
+        message += ",\"best_bid\":";
+        appendJsonNumber(message, update.bidCount ? update.bids[0].price : 0.0);
+        message += ",\"bids\":";
+        appendJsonLevels(message, update.bids, update.bidCount);
+        break;
+    case UpdateKind::Ticker:
+        message += "{\"best_ask\":";
+        appendJsonNumber(message, update.asks[0].price);
+        message += ",\"best_ask_amount\":";
+        appendJsonNumber(message, update.asks[0].amount);
+        message += ",\"best_bid\":";
+        appendJsonNumber(message, update.bids[0].price);
+        message += ",\"best_bid_amount\":";
+        appendJsonNumber(message, update.bids[0].amount);
+        message += ",\"index_price\":";
+        appendJsonNumber(message, update.indexPrice);
+        message += ",\"last_price\":";
+        appendJsonNumber(message, update.lastPrice);
+        message += ",\"mark_price\":";
+        appendJsonNumber(message, update.markPrice);
+        break;
+    case UpdateKind::Trade:
+        message += "{\"amount\":";
+        appendJsonNumber(message, update.amount);
+        message += ",\"direction\":";
+        message += update.direction == 's' ? "\"sell\"" : "\"buy\"";
+        message += ",\"price\":";
+        appendJsonNumber(message, update.price);
+        break;
+    }
+    message += ",\"seq\":";
+    appendJsonInteger(message, sequence);
+    message += ",\"symbol\":";
+    appendJsonString(message, update.getSymbol());
+    message += ",\"timestamp\":";
+    appendJsonInteger(message, update.exchangeMs);
+    if (update.kind == UpdateKind::Trade)
+    {
+        message += ",\"trade_seq\":";
+        appendJsonInteger(message, update.sequence);
+    }
+    message += ",\"type\":\"";
+    message += update.kind == UpdateKind::Book ? "book" : update.kind == UpdateKind::Ticker ? "ticker" : "trade";
+    message += "\"}";
+}